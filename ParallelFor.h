@@ -0,0 +1,174 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// whether the calling thread is a worker of ParallelFor or ThreadPool; the
+// loops started on it run serially, so that a parallel loop over jobs that
+// contain parallel loops themselves keeps one thread per core
+inline bool&
+InParallelWorker()
+{
+    static thread_local bool inWorker = false;
+    return inWorker;
+}
+
+//
+// calls func(i) for i in [begin, end) on worker threads
+template <typename Func>
+void
+ParallelFor(
+    int begin,
+    int end,
+    Func func,
+    int numThreads = 0)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = InParallelWorker() ? 1 : static_cast<int>(std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, end - begin);
+    if (numThreads <= 1)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            func(i);
+        }
+        return;
+    }
+    std::atomic<int> next(begin);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            InParallelWorker() = true;
+            for (int i = next++; i < end; i = next++)
+            {
+                func(i);
+            }
+        }));
+    }
+    for (auto& th : threads)
+    {
+        th.join();
+    }
+}
+
+//
+// worker threads kept over many parallel loops, e.g. the iterations of a
+// solver, where starting threads for each loop would cost more than the loop;
+// run calls func(i) for i in [begin, end) on them and the calling thread
+class ThreadPool
+{
+public:
+    explicit ThreadPool(
+        int numThreads = 0)
+        : endIndex(0),
+        generation(0),
+        numBusy(0),
+        quit(false)
+    {
+        if (numThreads <= 0)
+        {
+            numThreads = InParallelWorker() ? 1 : static_cast<int>(std::thread::hardware_concurrency());
+        }
+        for (int t = 1; t < numThreads; ++t)
+        {
+            threads.push_back(std::thread(&ThreadPool::work, this));
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& th : threads)
+        {
+            th.join();
+        }
+    }
+    template <typename Func>
+    void
+    run(
+        int begin,
+        int end,
+        Func func)
+    {
+        if (threads.empty() || end - begin <= 1)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                func(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = [&func](int i) { func(i); };
+            nextIndex = begin;
+            endIndex = end;
+            numBusy = static_cast<int>(threads.size());
+            ++generation;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return numBusy == 0; });
+        task = nullptr;
+    }
+private:
+    void
+    drain()
+    {
+        for (int i = nextIndex++; i < endIndex; i = nextIndex++)
+        {
+            task(i);
+        }
+    }
+    void
+    work()
+    {
+        InParallelWorker() = true;
+        long seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [&]() { return quit || generation != seen; });
+            if (quit)
+            {
+                return;
+            }
+            seen = generation;
+            lock.unlock();
+            drain();
+            lock.lock();
+            if (--numBusy == 0)
+            {
+                done.notify_one();
+            }
+        }
+    }
+    std::vector<std::thread>  threads;
+    std::mutex                mutex;
+    std::condition_variable   wake;
+    std::condition_variable   done;
+    std::function<void(int)>  task;
+    std::atomic<int>          nextIndex;
+    int                       endIndex;
+    long                      generation;
+    int                       numBusy;
+    bool                      quit;
+};
+
+#endif //PARALLEL_FOR_H
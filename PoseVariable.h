@@ -6,6 +6,7 @@
 #include <maya/MQuaternion.h>
 #include <maya/MTransformationMatrix.h>
 #include <vector>
+#include <functional>
 #include <maya/MGlobal.h>
 #include <maya/MMatrix.h>
 
@@ -126,7 +127,8 @@ public:
         MQuaternion a,
         MQuaternion b)
     {
-        return 2.0 * std::acos(qdot(a, b));
+        // the dot product of equal quaternions may round beyond 1
+        return 2.0 * std::acos(std::max(std::min(qdot(a, b), 1.0), -1.0));
     }
 
     static double
@@ -224,6 +226,92 @@ public:
         return std::sqrt(sqe);
     }
 
+    static double
+    dissimilaritySq(
+        const PoseVariable& a,
+        const PoseVariable& b,
+        int distType = 0,
+        double ws = 1.0,
+        double wr = 1.0,
+        double wt = 1.0)
+    {
+        if (distType == 3) //Frobenious norm of diff matrix
+        {
+            double fnrm = 0.0;
+            MMatrix dm = toMatrix(a) - toMatrix(b);
+            for (int j = 0; j < 16; ++j)
+            {
+                fnrm += std::pow(dm(j / 4, j % 4), 2.0);
+            }
+            return fnrm;
+        }
+        MVector sv = a.scale - b.scale;
+        MVector tv = a.translate - b.translate;
+        double sqe = ws * vdot(sv, sv) + wt * vdot(tv, tv);
+        switch (distType)
+        {
+        case 1: // Euclidean distance in tangent vector space
+            sqe += wr * PoseVariable::lqdistsq(a.rotate, b.rotate);
+            break;
+        case 2: // Shortest angle
+            sqe += wr * std::pow(PoseVariable::qangleShortest(a.rotate, b.rotate), 2.0);
+            break;
+        case 0: // Angle on 3-hemisphere
+        default:
+            sqe += wr * std::pow(PoseVariable::qangle(a.rotate, b.rotate), 2.0);
+            break;
+        }
+        return sqe;
+    }
+
+    static void
+    dissimilarityTerms(
+        const std::vector<PoseVariable>& a,
+        const std::vector<PoseVariable>& b,
+        int distType,
+        double& dssq,
+        double& drsq,
+        double& dtsq)
+    {
+        dssq = drsq = dtsq = 0.0;
+        if (distType == 3) // not separable; returned as the translation term
+        {
+            dtsq = std::pow(dissimilarity(a, b, distType), 2.0);
+            return;
+        }
+        for (int i = 0; i < a.size(); ++i)
+        {
+            MVector sv = a[i].scale - b[i].scale;
+            MVector tv = a[i].translate - b[i].translate;
+            dssq += vdot(sv, sv);
+            dtsq += vdot(tv, tv);
+            switch (distType)
+            {
+            case 1:
+                drsq += PoseVariable::lqdistsq(a[i].rotate, b[i].rotate);
+                break;
+            case 2:
+                drsq += std::pow(PoseVariable::qangleShortest(a[i].rotate, b[i].rotate), 2.0);
+                break;
+            case 0:
+            default:
+                drsq += std::pow(PoseVariable::qangle(a[i].rotate, b[i].rotate), 2.0);
+                break;
+            }
+        }
+    }
+
+    static double
+    rbf(
+        double d,
+        int rbfType = 1,
+        double param = 10.0)
+    {
+        static std::function<double(double, double)> ftable[3] = {
+            linear, thinplate, gaussian };
+        return ftable[rbfType](d, param);
+    }
+
     static double
     kernel(
         const std::vector<PoseVariable>& a,
@@ -234,10 +322,8 @@ public:
         double wr = 10.0,
         double wt = 1.0)
     {
-        static std::function<double(double, double)> ftable[3] = {
-            linear, thinplate, gaussian };
         double d = dissimilarity(a, b, distType, ws, wr, wt);
-        return ftable[rbfType](d, 10.0);
+        return rbf(d, rbfType, 10.0);
     }
 
 public:
@@ -281,6 +367,36 @@ public:
             setPoseTo(plug, eid * numInputs + iid, poses[iid]);
         }
     }
+    static void
+    setPoseTo(
+        double* data,
+        int offset,
+        const PoseVariable& pose)
+    {
+        data += offset * 10;
+        data[0] = pose.scale.x;
+        data[1] = pose.scale.y;
+        data[2] = pose.scale.z;
+        data[3] = pose.rotate.x;
+        data[4] = pose.rotate.y;
+        data[5] = pose.rotate.z;
+        data[6] = pose.rotate.w;
+        data[7] = pose.translate.x;
+        data[8] = pose.translate.y;
+        data[9] = pose.translate.z;
+    }
+    static PoseVariable
+    getPoseFrom(
+        const double* data,
+        int offset)
+    {
+        data += offset * 10;
+        PoseVariable pose;
+        pose.scale     = MVector(data[0], data[1], data[2]);
+        pose.rotate    = MQuaternion(data[3], data[4], data[5], data[6]);
+        pose.translate = MVector(data[7], data[8], data[9]);
+        return pose;
+    }
     static PoseVariable
     getPoseFrom(
         MPlug& plug,
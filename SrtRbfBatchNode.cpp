@@ -0,0 +1,271 @@
+#include "SrtRbfBatchNode.h"
+#include "SrtRbfNode.h"
+#include "SrtRbfModelData.h"
+#include "ParallelFor.h"
+#include <vector>
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnPluginData.h>
+#include <maya/MFnMatrixAttribute.h>
+#include <maya/MFnCompoundAttribute.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMatrixData.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MArrayDataBuilder.h>
+#include <maya/MTransformationMatrix.h>
+#include <maya/MMatrix.h>
+#include <maya/MPlugArray.h>
+#include <maya/MStringArray.h>
+#include <maya/MDGModifier.h>
+#include <maya/MGlobal.h>
+#include <maya/MArgList.h>
+
+const MString SrtRbfBatchNode::className = "SrtRbfBatchNode";
+const MTypeId SrtRbfBatchNode::SrtRbfBatchNodeID = 0x00011; // TO BE CHANGED
+const MString SrtRbfBatchNode::modelAttrName[3]         = { "model",         "mdl",  "Model" };
+const MString SrtRbfBatchNode::instanceAttrName[3]      = { "instance",      "inst", "Instance" };
+const MString SrtRbfBatchNode::instanceInputAttrName[3] = { "instanceInput", "iim",  "Instance Input" };
+const MString SrtRbfBatchNode::outputAttrName[3]        = { "output",        "out",  "Output" };
+MObject SrtRbfBatchNode::modelAttr         = MObject::kNullObj;
+MObject SrtRbfBatchNode::instanceAttr      = MObject::kNullObj;
+MObject SrtRbfBatchNode::instanceInputAttr = MObject::kNullObj;
+MObject SrtRbfBatchNode::outputAttr        = MObject::kNullObj;
+
+// utilities of SrtRbfNode.cpp
+MMatrix
+GetMatrix(
+    MPlug plug);
+std::vector<SrtRbfNode*>
+NodesFromActiveSelection();
+
+///
+
+MStatus
+SrtRbfBatchNode::initSrtRbfBatchNode()
+{
+    MFnTypedAttribute tAttr;
+    MFnMatrixAttribute mAttr;
+    MFnCompoundAttribute cAttr;
+
+    // trained data, connected from SrtRbfNode.trainedModel
+    modelAttr = tAttr.create(
+        modelAttrName[0],
+        modelAttrName[1],
+        SrtRbfModelData::SrtRbfModelDataID);
+    tAttr.setNiceNameOverride(modelAttrName[2]);
+    tAttr.setStorable(false);
+    tAttr.setHidden(true);
+    addAttribute(modelAttr);
+
+    // input matrices of each instance
+    instanceInputAttr = mAttr.create(
+        instanceInputAttrName[0],
+        instanceInputAttrName[1],
+        MFnMatrixAttribute::kDouble);
+    mAttr.setNiceNameOverride(instanceInputAttrName[2]);
+    mAttr.setReadable(false);
+    mAttr.setArray(true);
+    mAttr.setDisconnectBehavior(MFnAttribute::kReset);
+    instanceAttr = cAttr.create(
+        instanceAttrName[0],
+        instanceAttrName[1]);
+    cAttr.setNiceNameOverride(instanceAttrName[2]);
+    cAttr.addChild(instanceInputAttr);
+    cAttr.setArray(true);
+    cAttr.setReadable(false);
+    addAttribute(instanceAttr);
+
+    // output matrix of each instance
+    outputAttr = mAttr.create(
+        outputAttrName[0],
+        outputAttrName[1],
+        MFnMatrixAttribute::kDouble);
+    mAttr.setNiceNameOverride(outputAttrName[2]);
+    mAttr.setArray(true);
+    mAttr.setWritable(false);
+    mAttr.setStorable(false);
+    mAttr.setUsesArrayDataBuilder(true);
+    addAttribute(outputAttr);
+
+    // any dirty instance dirties the whole output so that all are evaluated together
+    attributeAffects(modelAttr, outputAttr);
+    attributeAffects(instanceAttr, outputAttr);
+    attributeAffects(instanceInputAttr, outputAttr);
+    return MS::kSuccess;
+}
+
+MStatus
+SrtRbfBatchNode::compute(
+    const MPlug& plug,
+    MDataBlock& dataBlock)
+{
+    if (plug.attribute() != outputAttr)
+    {
+        return MS::kUnknownParameter;
+    }
+    // the snapshot of the trained data is shared with the source node, not copied
+    const SrtRbfModelData* data = dynamic_cast<const SrtRbfModelData*>(
+        dataBlock.inputValue(modelAttr).asPluginData());
+    MArrayDataHandle outputHandle = dataBlock.outputArrayValue(outputAttr);
+    if (data == nullptr || !data->model || data->model->numExs == 0)
+    {
+        model.reset();
+        outputHandle.setAllClean();
+        return MS::kSuccess;
+    }
+    if (data->model != model)
+    {
+        model = data->model;
+        std::vector<int> centers;
+        model->dualCoefficients(centers, coefficients);
+    }
+    const SrtRbfModel& trained = *model;
+
+    // input matrices of all the instances
+    const int numInputs = trained.numInputs;
+    MArrayDataHandle instanceHandle = dataBlock.inputArrayValue(instanceAttr);
+    const int numInstances = static_cast<int>(instanceHandle.elementCount());
+    std::vector<MMatrix> inputs(numInstances * numInputs);
+    instanceIds.resize(numInstances);
+    for (int k = 0; k < numInstances; ++k)
+    {
+        instanceHandle.jumpToArrayElement(k);
+        instanceIds[k] = instanceHandle.elementIndex();
+        MArrayDataHandle inputHandle(instanceHandle.inputValue().child(instanceInputAttr));
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            inputs[k * numInputs + iid] = inputHandle.jumpToElement(iid) == MS::kSuccess
+                ? inputHandle.inputValue().asMatrix()
+                : MMatrix::identity;
+        }
+    }
+
+    // relativized in parallel, blended by a single product, and composed in parallel
+    poses.resize(inputs.size());
+    ParallelFor(0, static_cast<int>(inputs.size()), [&](int j)
+    {
+        poses[j] = trained.relativize(j % numInputs, MTransformationMatrix(inputs[j]));
+    });
+    trained.evaluateBatch(poses, coefficients, features);
+    std::vector<MMatrix> outputs(numInstances);
+    ParallelFor(0, numInstances, [&](int k)
+    {
+        outputs[k] = trained.compose(features.row(k).transpose());
+    });
+
+    MArrayDataBuilder builder = outputHandle.builder();
+    for (int k = 0; k < numInstances; ++k)
+    {
+        MDataHandle elementHandle = builder.addElement(instanceIds[k]);
+        elementHandle.setMMatrix(outputs[k]);
+    }
+    outputHandle.set(builder);
+    outputHandle.setAllClean();
+    return MS::kSuccess;
+}
+
+///
+
+// moves the selected SrtRbfNodes with identical trained data onto one SrtRbfBatchNode per group;
+// the first node of each group keeps the trained data for all of them
+MStatus
+BatchSrtRbf::doIt(
+    const MArgList& args)
+{
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    std::vector<std::vector<SrtRbfNode*>> groups;
+    for (SrtRbfNode* node : controllers)
+    {
+        bool grouped = false;
+        for (auto& group : groups)
+        {
+            if (group[0]->trainedModel().sameTraining(node->trainedModel()))
+            {
+                group.push_back(node);
+                grouped = true;
+                break;
+            }
+        }
+        if (!grouped)
+        {
+            groups.push_back(std::vector<SrtRbfNode*>(1, node));
+        }
+    }
+
+    MStringArray result;
+    for (const auto& group : groups)
+    {
+        MObject batch = dgModifier.createNode(SrtRbfBatchNode::className);
+        dgModifier.doIt();
+        MFnDependencyNode fnBatch(batch);
+        MFnDependencyNode fnSource(group[0]->thisMObject());
+        dgModifier.connect(
+            fnSource.findPlug(SrtRbfNode::trainedModelAttrName[0], true),
+            fnBatch.findPlug(SrtRbfBatchNode::modelAttrName[0], true));
+        MPlug instancePlug = fnBatch.findPlug(SrtRbfBatchNode::instanceAttrName[0], true);
+        MPlug batchOutputPlug = fnBatch.findPlug(SrtRbfBatchNode::outputAttrName[0], true);
+        MObject instanceInput = fnBatch.attribute(SrtRbfBatchNode::instanceInputAttrName[0]);
+        for (unsigned int k = 0; k < group.size(); ++k)
+        {
+            // inputs move with their connections or values
+            MFnDependencyNode fnNode(group[k]->thisMObject());
+            MPlug inputPlug = fnNode.findPlug(SrtRbfNode::inputAttrName[0], true);
+            MPlug dstInputPlug = instancePlug.elementByLogicalIndex(k).child(instanceInput);
+            for (unsigned int i = 0; i < inputPlug.numElements(); ++i)
+            {
+                MPlug src = inputPlug.elementByPhysicalIndex(i);
+                MPlug dst = dstInputPlug.elementByLogicalIndex(src.logicalIndex());
+                MPlugArray sources;
+                src.connectedTo(sources, true, false);
+                if (sources.length() > 0)
+                {
+                    dgModifier.disconnect(sources[0], src);
+                    dgModifier.connect(sources[0], dst);
+                }
+                else
+                {
+                    MFnMatrixData fnData;
+                    dgModifier.newPlugValue(dst, fnData.create(GetMatrix(src)));
+                }
+            }
+            // and so do the destinations of the output
+            MPlug outputPlug = fnNode.findPlug(SrtRbfNode::outputAttrName[0], true);
+            MPlugArray destinations;
+            outputPlug.connectedTo(destinations, false, true);
+            for (unsigned int d = 0; d < destinations.length(); ++d)
+            {
+                dgModifier.disconnect(outputPlug, destinations[d]);
+                dgModifier.connect(batchOutputPlug.elementByLogicalIndex(k), destinations[d]);
+            }
+        }
+        dgModifier.doIt();
+
+        MString msg = fnBatch.name();
+        msg += ": ";
+        msg += static_cast<int>(group.size());
+        msg += " instances of ";
+        msg += fnSource.name();
+        MGlobal::displayInfo(msg);
+        result.append(fnBatch.name());
+    }
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+BatchSrtRbf::undoIt()
+{
+    return dgModifier.undoIt();
+}
+
+MStatus
+BatchSrtRbf::redoIt()
+{
+    return dgModifier.doIt();
+}
+
+bool
+BatchSrtRbf::isUndoable() const
+{
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef SRTRBF_BATCH_NODE_H
+#define SRTRBF_BATCH_NODE_H
+#pragma once
+
+#include <maya/MPxNode.h>
+#include <maya/MPxCommand.h>
+#include <maya/MString.h>
+#include <maya/MPlug.h>
+#include <maya/MDGModifier.h>
+#include <Eigen/Dense>
+#include <vector>
+#include <memory>
+#include "PoseVariable.h"
+#include "SrtRbfModel.h"
+
+//
+// evaluates many instances of the trained data of a single SrtRbfNode at once
+//
+// Each element of instance holds the input matrices of one instance, and the
+// same element of output receives its secondary transformation. The trained
+// data come from SrtRbfNode.trainedModel through the model attribute. The kernel
+// values of all the instances form one matrix that is multiplied with the
+// coefficients in a single product.
+class SrtRbfBatchNode : public MPxNode
+{
+//
+// attribute names
+public:
+    static const MString className;
+    static const MString modelAttrName[3];
+    static const MString instanceAttrName[3];
+    static const MString instanceInputAttrName[3];
+    static const MString outputAttrName[3];
+//
+// attributes
+protected:
+    static MObject modelAttr;
+    static MObject instanceAttr;
+    static MObject instanceInputAttr;
+    static MObject outputAttr;
+//
+// coefficients of the trained data, reused while the snapshot stays the same
+private:
+    std::shared_ptr<const SrtRbfModel> model;
+    RowMatrixXd coefficients;
+//
+// per-evaluation buffers
+private:
+    std::vector<unsigned int> instanceIds;
+    std::vector<PoseVariable> poses;
+    RowMatrixXd features;
+//
+// constructor & destructor
+public:
+    SrtRbfBatchNode() { };
+    virtual ~SrtRbfBatchNode() { };
+//
+// overrides
+public:
+    MStatus
+    compute(
+        const MPlug& plug,
+        MDataBlock& dataBlock) override;
+//
+// node generation
+public:
+    static MStatus
+    initSrtRbfBatchNode();
+    static const MTypeId SrtRbfBatchNodeID;
+};
+
+///
+
+class BatchSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    MDGModifier dgModifier;
+};
+
+#endif //SRTRBF_BATCH_NODE_H
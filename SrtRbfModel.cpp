@@ -0,0 +1,2465 @@
+#include "SrtRbfModel.h"
+#include "ParallelFor.h"
+#include "runtime/SrtRbfFormat.h"
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <Eigen/Dense>
+#include <Eigen/LU>
+#include <Eigen/Eigenvalues>
+#include <maya/MVector.h>
+#include <maya/MQuaternion.h>
+
+bool
+SrtRbfModel::fitDense()
+{
+    Eigen::MatrixXd kerMat;
+    if (affinity)
+    {
+        kerMat.resize(numExs + 1, numExs + 1);
+        kerMat.setOnes();
+        kerMat(numExs, numExs) = 0.0;
+    }
+    else
+    {
+        kerMat.resize(numExs, numExs);
+        kerMat.setOnes();
+    }
+    for (int r = 0; r < numExs; ++r)
+    {
+        for (int c = r; c < numExs; ++c)
+        {
+            kerMat(r, c) = kernel(distance(primary[r], primary[c]));
+            kerMat(c, r) = kerMat(r, c);
+        }
+    }
+    Eigen::FullPivLU<Eigen::MatrixXd> kerMatLU(kerMat);
+    if (kerMatLU.rank() < kerMat.rows())
+    {
+        return false;
+    }
+    invKerMat = kerMatLU.inverse();
+    landmarks.clear();
+    coef.resize(0, 0);
+    return true;
+}
+
+bool
+SrtRbfModel::fitLowRank(
+    int numLandmarks,
+    double& residual)
+{
+    update();
+    selectLandmarks(numLandmarks);
+    const int m = static_cast<int>(landmarks.size());
+    Eigen::MatrixXd kerMat(numExs, m);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        for (int j = 0; j < m; ++j)
+        {
+            kerMat(eid, j) = kernel(distance(primary[eid], primary[landmarks[j]]));
+        }
+    }
+
+    // least squares in the landmark basis;
+    // the affinity constraint adds a constant term whose coefficients sum to zero
+    const int size = affinity ? m + 2 : m;
+    Eigen::MatrixXd sysMat(size, size);
+    Eigen::MatrixXd rhs(size, 10);
+    sysMat.topLeftCorner(m, m) = kerMat.transpose() * kerMat;
+    rhs.topRows(m) = kerMat.transpose() * secFeatures;
+    if (affinity)
+    {
+        const Eigen::VectorXd colSum = kerMat.colwise().sum().transpose();
+        sysMat.block(0, m, m, 1) = colSum;
+        sysMat.block(m, 0, 1, m) = colSum.transpose();
+        sysMat.block(0, m + 1, m, 1).setOnes();
+        sysMat.block(m + 1, 0, 1, m).setOnes();
+        sysMat.bottomRightCorner(2, 2).setZero();
+        sysMat(m, m) = numExs;
+        rhs.row(m) = secFeatures.colwise().sum();
+        rhs.row(m + 1).setZero();
+    }
+    Eigen::FullPivLU<Eigen::MatrixXd> sysMatLU(sysMat);
+    if (sysMatLU.rank() < sysMat.rows())
+    {
+        return false;
+    }
+    const Eigen::MatrixXd sol = sysMatLU.solve(rhs);
+    coef = sol.topRows(affinity ? m + 1 : m);
+    invKerMat.resize(0, 0);
+
+    // max abs error of the secondary transformations over the examples
+    Eigen::MatrixXd fitted = kerMat * coef.topRows(m);
+    if (affinity)
+    {
+        fitted.rowwise() += coef.row(m);
+    }
+    residual = numExs > 0 ? (fitted - secFeatures).cwiseAbs().maxCoeff() : 0.0;
+    // update() above built the single-precision data from the previous coefficients
+    if (singlePrecision)
+    {
+        buildSingle();
+    }
+    return true;
+}
+
+void
+SrtRbfModel::selectLandmarks(
+    int numLandmarks)
+{
+    numLandmarks = std::min(numLandmarks, numExs);
+    landmarks.clear();
+    if (numLandmarks <= 0)
+    {
+        return;
+    }
+    // greedy pivoted Cholesky for the positive definite gaussian kernel,
+    // farthest point sampling under the distance metric otherwise
+    const bool cholesky = rbfType == 2;
+    Eigen::MatrixXd factor;
+    std::vector<double> score(numExs, std::numeric_limits<double>::max());
+    if (cholesky)
+    {
+        factor.setZero(numExs, numLandmarks);
+        score.assign(numExs, kernel(0.0));
+    }
+    int pivot = 0; // the first example is always a landmark
+    for (int j = 0; j < numLandmarks; ++j)
+    {
+        landmarks.push_back(pivot);
+        if (cholesky)
+        {
+            const double pd = std::sqrt(score[pivot]);
+            for (int eid = 0; eid < numExs; ++eid)
+            {
+                const double kv = kernel(distance(primary[eid], primary[pivot]));
+                factor(eid, j) = (kv - factor.row(eid).head(j).dot(factor.row(pivot).head(j))) / pd;
+                score[eid] -= factor(eid, j) * factor(eid, j);
+            }
+        }
+        else
+        {
+            for (int eid = 0; eid < numExs; ++eid)
+            {
+                score[eid] = std::min(score[eid], distance(primary[eid], primary[pivot]));
+            }
+        }
+        for (int lid : landmarks)
+        {
+            score[lid] = 0.0;
+        }
+        pivot = static_cast<int>(std::max_element(score.begin(), score.end()) - score.begin());
+        if (score[pivot] <= 1.0e-12)
+        {
+            break;
+        }
+    }
+}
+
+// memory for the kernel matrix of the iterative solver, which evaluates the
+// products on the fly when the matrix is larger (about 8000 examples)
+static const double kKernelCacheBytes = 512.0 * 1024.0 * 1024.0;
+
+// coefficients of all the examples solved with preconditioned MINRES, which
+// needs only products of the symmetric (indefinite under affinity) system with
+// vectors; the kernel matrix is stored when it fits in kKernelCacheBytes, and
+// the products of all iterations share one pool of threads. The coefficients
+// of a previous iterative solve (prevLandmarks and prevCoef, which may be the
+// members of the model) are the initial guess when examples have been appended.
+bool
+SrtRbfModel::fitIterative(
+    double tolerance,
+    int maxIterations,
+    const std::function<bool(int, double)>& progress,
+    const std::vector<int>& prevLandmarks,
+    const RowMatrixXd& prevCoef,
+    int& numIterations,
+    double& residual)
+{
+    numIterations = 0;
+    const int border = affinity ? 1 : 0;
+    const int size = numExs + border;
+    const int numPrev = static_cast<int>(prevLandmarks.size());
+    RowMatrixXd x = RowMatrixXd::Zero(size, 10);
+    bool warm = solver == 2 && numPrev <= numExs && prevCoef.rows() == numPrev + border && prevCoef.cols() == 10;
+    for (int j = 0; warm && j < numPrev; ++j)
+    {
+        warm = prevLandmarks[j] == j;
+    }
+    if (warm)
+    {
+        x.topRows(numPrev) = prevCoef.topRows(numPrev);
+        if (affinity)
+        {
+            x.row(numExs) = prevCoef.row(numPrev);
+        }
+    }
+    landmarks.clear();
+    coef.resize(0, 0);
+    invKerMat.resize(0, 0);
+    if (numExs == 0)
+    {
+        return false;
+    }
+    update();
+    ThreadPool pool;
+    const int tileSize = 64;
+    const int numTiles = (numExs + tileSize - 1) / tileSize;
+    RowMatrixXd kerMat;
+    if (static_cast<double>(numExs) * numExs * sizeof(double) <= kKernelCacheBytes)
+    {
+        kerMat.resize(numExs, numExs);
+        pool.run(0, numTiles, [&](int t)
+        {
+            const int end = std::min((t + 1) * tileSize, numExs);
+            for (int r = t * tileSize; r < end; ++r)
+            {
+                for (int c = r; c < numExs; ++c)
+                {
+                    kerMat(r, c) = kernel(distance(primary[r], primary[c]));
+                    kerMat(c, r) = kerMat(r, c);
+                }
+            }
+        });
+    }
+
+    // block-diagonal preconditioner |B|^-1 on the kernel matrices of nearby
+    // examples in the order of the vantage-point tree; the absolute eigenvalues
+    // keep it positive definite as MINRES requires. The border is scaled by the
+    // inverse of the approximate Schur complement 1^T |B|^-1 1.
+    const int blockSize = 64;
+    const int numBlocks = (numExs + blockSize - 1) / blockSize;
+    std::vector<Eigen::MatrixXd> blockInv(numBlocks);
+    pool.run(0, numBlocks, [&](int b)
+    {
+        const int begin = b * blockSize;
+        const int n = std::min(blockSize, numExs - begin);
+        Eigen::MatrixXd blockMat(n, n);
+        for (int r = 0; r < n; ++r)
+        {
+            for (int c = r; c < n; ++c)
+            {
+                const int er = vpTree[begin + r].eid;
+                const int ec = vpTree[begin + c].eid;
+                blockMat(r, c) = kerMat.size() > 0 ? kerMat(er, ec) : kernel(distance(primary[er], primary[ec]));
+                blockMat(c, r) = blockMat(r, c);
+            }
+        }
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(blockMat);
+        Eigen::VectorXd lambda = eigen.eigenvalues().cwiseAbs();
+        const double floor = lambda.maxCoeff() > 0.0 ? lambda.maxCoeff() * 1.0e-10 : 1.0;
+        for (int i = 0; i < n; ++i)
+        {
+            lambda[i] = 1.0 / std::max(lambda[i], floor);
+        }
+        blockInv[b] = eigen.eigenvectors() * lambda.asDiagonal() * eigen.eigenvectors().transpose();
+    });
+    double schur = 0.0;
+    for (const Eigen::MatrixXd& inv : blockInv)
+    {
+        schur += inv.sum();
+    }
+    auto precondition = [&](const RowMatrixXd& r, RowMatrixXd& z)
+    {
+        z.resize(size, 10);
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            const int begin = b * blockSize;
+            const int n = static_cast<int>(blockInv[b].rows());
+            Eigen::MatrixXd rb(n, 10);
+            for (int i = 0; i < n; ++i)
+            {
+                rb.row(i) = r.row(vpTree[begin + i].eid);
+            }
+            const Eigen::MatrixXd zb = blockInv[b] * rb;
+            for (int i = 0; i < n; ++i)
+            {
+                z.row(vpTree[begin + i].eid) = zb.row(i);
+            }
+        }
+        if (affinity)
+        {
+            z.row(numExs) = r.row(numExs) / schur;
+        }
+    };
+
+    // MINRES on the 10 right-hand sides at once, sharing the products with the
+    // kernel matrix; the recurrences have a scalar per column
+    typedef Eigen::Array<double, 1, Eigen::Dynamic> ColumnArray;
+    auto dot = [](const RowMatrixXd& a, const RowMatrixXd& b) -> ColumnArray
+    {
+        return (a.array() * b.array()).colwise().sum();
+    };
+    auto scale = [](const RowMatrixXd& a, const ColumnArray& s) -> RowMatrixXd
+    {
+        return (a.array().rowwise() * s).matrix();
+    };
+    auto quotient = [](const ColumnArray& a, const ColumnArray& b) -> ColumnArray
+    {
+        ColumnArray q(b.size());
+        for (int i = 0; i < b.size(); ++i)
+        {
+            q[i] = b[i] != 0.0 ? a[i] / b[i] : 0.0;
+        }
+        return q;
+    };
+    RowMatrixXd rhs = RowMatrixXd::Zero(size, 10);
+    rhs.topRows(numExs) = secFeatures;
+    RowMatrixXd y;
+    precondition(rhs, y);
+    const ColumnArray rhsNorm = dot(rhs, y).max(ColumnArray::Zero(10)).sqrt();
+    RowMatrixXd r1;
+    multiplyKernel(kerMat, pool, x, r1);
+    r1 = rhs - r1;
+    precondition(r1, y);
+    RowMatrixXd r2 = r1;
+    ColumnArray beta = dot(r1, y).max(ColumnArray::Zero(10)).sqrt();
+    ColumnArray oldb = ColumnArray::Zero(10);
+    ColumnArray dbar = ColumnArray::Zero(10);
+    ColumnArray epsln = ColumnArray::Zero(10);
+    ColumnArray phibar = beta;
+    ColumnArray cs = ColumnArray::Constant(10, -1.0);
+    ColumnArray sn = ColumnArray::Zero(10);
+    RowMatrixXd w = RowMatrixXd::Zero(size, 10);
+    RowMatrixXd w1, w2 = w, v;
+    auto relativeResidual = [&]()
+    {
+        double relative = 0.0;
+        for (int i = 0; i < 10; ++i)
+        {
+            relative = std::max(relative, rhsNorm[i] > 0.0 ? phibar[i] / rhsNorm[i] : phibar[i]);
+        }
+        return relative;
+    };
+    for (double relative = relativeResidual(); relative > tolerance && numIterations < maxIterations; )
+    {
+        ++numIterations;
+        v = scale(y, quotient(ColumnArray::Ones(10), beta));
+        multiplyKernel(kerMat, pool, v, y);
+        if (numIterations >= 2)
+        {
+            y -= scale(r1, quotient(beta, oldb));
+        }
+        const ColumnArray alfa = dot(v, y);
+        y -= scale(r2, quotient(alfa, beta));
+        r1.swap(r2);
+        r2 = y;
+        precondition(r2, y);
+        oldb = beta;
+        beta = dot(r2, y).max(ColumnArray::Zero(10)).sqrt();
+
+        // the QR factorization of the tridiagonal matrix by Givens rotations
+        const ColumnArray oldeps = epsln;
+        const ColumnArray delta = cs * dbar + sn * alfa;
+        const ColumnArray gbar = sn * dbar - cs * alfa;
+        epsln = sn * beta;
+        dbar = -cs * beta;
+        const ColumnArray gamma = (gbar.square() + beta.square()).sqrt().max(ColumnArray::Constant(10, std::numeric_limits<double>::epsilon()));
+        cs = gbar / gamma;
+        sn = beta / gamma;
+        const ColumnArray phi = cs * phibar;
+        phibar = sn * phibar;
+        w1.swap(w2);
+        w2.swap(w);
+        w = scale(v - scale(w1, oldeps) - scale(w2, delta), gamma.inverse());
+        x += scale(w, phi);
+
+        relative = relativeResidual();
+        if (!std::isfinite(relative) || (progress && !progress(numIterations, relative)))
+        {
+            return false;
+        }
+    }
+
+    // max abs error of the secondary transformations over the examples
+    RowMatrixXd fitted;
+    multiplyKernel(kerMat, pool, x, fitted);
+    residual = (fitted.topRows(numExs) - secFeatures).cwiseAbs().maxCoeff();
+    landmarks.resize(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        landmarks[eid] = eid;
+    }
+    coef = x;
+    // update() above built the single-precision data from the cleared coefficients
+    if (singlePrecision)
+    {
+        buildSingle();
+    }
+    return true;
+}
+
+// y = K x with the kernel matrix K (bordered under affinity), stored or
+// evaluated on the fly from the examples when kerMat is empty, in parallel
+// over tiles of rows
+void
+SrtRbfModel::multiplyKernel(
+    const RowMatrixXd& kerMat,
+    ThreadPool& pool,
+    const RowMatrixXd& x,
+    RowMatrixXd& y) const
+{
+    const int tileSize = 64;
+    const int numTiles = (numExs + tileSize - 1) / tileSize;
+    y.setZero(x.rows(), x.cols());
+    pool.run(0, numTiles, [&](int t)
+    {
+        const int begin = t * tileSize;
+        const int end = std::min(begin + tileSize, numExs);
+        if (kerMat.size() > 0)
+        {
+            y.middleRows(begin, end - begin).noalias() = kerMat.middleRows(begin, end - begin) * x.topRows(numExs);
+        }
+        else
+        {
+            for (int r = begin; r < end; ++r)
+            {
+                for (int c = 0; c < numExs; ++c)
+                {
+                    y.row(r) += kernel(distance(primary[r], primary[c])) * x.row(c);
+                }
+            }
+        }
+        if (affinity)
+        {
+            y.middleRows(begin, end - begin).rowwise() += x.row(numExs);
+        }
+    });
+    if (affinity)
+    {
+        y.row(numExs) = x.topRows(numExs).colwise().sum();
+    }
+}
+
+void
+SrtRbfModel::update()
+{
+    secFeatures.resize(numExs, 10);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        PoseVariable pose = secondary[eid];
+        // the first example holds the reference rotation under the affinity constraint
+        if (affinity && eid == 0)
+        {
+            pose.rotate = MQuaternion(0, 0, 0, 0);
+        }
+        PoseVariable::setPoseTo(secFeatures.data(), eid, pose);
+    }
+    buildIndex();
+    buildHash();
+    if (singlePrecision)
+    {
+        buildSingle();
+    }
+    else
+    {
+        singleCenters.resize(0, 0);
+        singleCoef.resize(0, 0);
+        singleBuilt = false;
+    }
+}
+
+// whether the other model is trained with the same examples and parameters
+bool
+SrtRbfModel::sameTraining(
+    const SrtRbfModel& other) const
+{
+    if (numInputs != other.numInputs || numExs != other.numExs
+        || rbfType != other.rbfType || distType != other.distType
+        || solver != other.solver || affinity != other.affinity
+        || scaleWeight != other.scaleWeight || rotateWeight != other.rotateWeight
+        || translateWeight != other.translateWeight || width != other.width)
+    {
+        return false;
+    }
+    auto flatten = [](const SrtRbfModel& m)
+    {
+        std::vector<double> data((m.numInputs + m.numExs * (m.numInputs + 1)) * 10);
+        int offset = 0;
+        for (const PoseVariable& pose : m.primRef)
+        {
+            PoseVariable::setPoseTo(data.data(), offset++, pose);
+        }
+        for (int eid = 0; eid < m.numExs; ++eid)
+        {
+            for (const PoseVariable& pose : m.primary[eid])
+            {
+                PoseVariable::setPoseTo(data.data(), offset++, pose);
+            }
+            PoseVariable::setPoseTo(data.data(), offset++, m.secondary[eid]);
+        }
+        return data;
+    };
+    return flatten(*this) == flatten(other);
+}
+
+// inverse of a matrix whose p-th row and column are removed
+static Eigen::MatrixXd
+RemoveIndex(
+    const Eigen::MatrixXd& invMat,
+    int p)
+{
+    const int n = static_cast<int>(invMat.rows());
+    Eigen::MatrixXd retval(n - 1, n - 1);
+    for (int r = 0; r < n - 1; ++r)
+    {
+        const int ir = r < p ? r : r + 1;
+        for (int c = 0; c < n - 1; ++c)
+        {
+            const int ic = c < p ? c : c + 1;
+            retval(r, c) = invMat(ir, ic) - invMat(ir, p) * invMat(p, ic) / invMat(p, p);
+        }
+    }
+    return retval;
+}
+
+std::vector<int>
+SrtRbfModel::prune(
+    double tolerance) const
+{
+    const int border = affinity ? 1 : 0;
+    std::vector<int> kept(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        kept[eid] = eid;
+    }
+    Eigen::MatrixXd kerMat(numExs + border, numExs + border);
+    kerMat.setOnes();
+    if (affinity)
+    {
+        kerMat(numExs, numExs) = 0.0;
+    }
+    for (int r = 0; r < numExs; ++r)
+    {
+        for (int c = r; c < numExs; ++c)
+        {
+            kerMat(r, c) = kernel(distance(primary[r], primary[c]));
+            kerMat(c, r) = kerMat(r, c);
+        }
+    }
+    Eigen::FullPivLU<Eigen::MatrixXd> kerMatLU(kerMat);
+    if (kerMatLU.rank() < kerMat.rows())
+    {
+        return kept;
+    }
+    Eigen::MatrixXd invMat = kerMatLU.inverse();
+
+    // greedy backward elimination;
+    // the first example holds the reference transformations and is never removed
+    std::vector<int> removed;
+    while (kept.size() > 1)
+    {
+        const int n = static_cast<int>(kept.size());
+        RowMatrixXd secMat = RowMatrixXd::Zero(n + border, 10);
+        for (int i = 0; i < n; ++i)
+        {
+            secMat.row(i) = secFeatures.row(kept[i]);
+        }
+        // closed-form leave-one-out residuals
+        const Eigen::MatrixXd coefMat = invMat * secMat;
+        std::vector<std::pair<double, int>> loo;
+        for (int i = 1; i < n; ++i)
+        {
+            loo.push_back(std::make_pair(coefMat.row(i).cwiseAbs().maxCoeff() / std::abs(invMat(i, i)), i));
+        }
+        std::sort(loo.begin(), loo.end());
+
+        // the leave-one-out residual bounds the error at the removed example only,
+        // so the examples removed earlier are checked again
+        bool accepted = false;
+        for (int t = 0; t < static_cast<int>(loo.size()) && t < 16 && loo[t].first < tolerance; ++t)
+        {
+            const int p = loo[t].second;
+            const Eigen::MatrixXd nextInvMat = RemoveIndex(invMat, p);
+            std::vector<int> nextKept = kept;
+            nextKept.erase(nextKept.begin() + p);
+            RowMatrixXd nextSecMat = RowMatrixXd::Zero(n - 1 + border, 10);
+            for (int i = 0; i < n - 1; ++i)
+            {
+                nextSecMat.row(i) = secFeatures.row(nextKept[i]);
+            }
+            const Eigen::MatrixXd nextCoefMat = nextInvMat * nextSecMat;
+            std::vector<int> checked = removed;
+            checked.push_back(kept[p]);
+            double maxError = 0.0;
+            for (int r : checked)
+            {
+                Eigen::RowVectorXd fitted = Eigen::RowVectorXd::Zero(10);
+                for (int i = 0; i < n - 1; ++i)
+                {
+                    fitted += kerMat(r, nextKept[i]) * nextCoefMat.row(i);
+                }
+                if (affinity)
+                {
+                    fitted += nextCoefMat.row(n - 1);
+                }
+                maxError = std::max(maxError, (fitted - secFeatures.row(r)).cwiseAbs().maxCoeff());
+            }
+            if (maxError < tolerance)
+            {
+                invMat = nextInvMat;
+                kept = nextKept;
+                removed = checked;
+                accepted = true;
+                break;
+            }
+        }
+        if (!accepted)
+        {
+            break;
+        }
+    }
+    return kept;
+}
+
+void
+SrtRbfModel::distanceTerms(
+    const std::vector<int>& ids,
+    std::vector<Eigen::MatrixXd>& terms) const
+{
+    const int numIds = static_cast<int>(ids.size());
+    terms.assign(3, Eigen::MatrixXd::Zero(numIds, numIds));
+    ParallelFor(0, numIds, [&](int r)
+    {
+        for (int c = r + 1; c < numIds; ++c)
+        {
+            double dsq[3];
+            PoseVariable::dissimilarityTerms(primary[ids[r]], primary[ids[c]], distType, dsq[0], dsq[1], dsq[2]);
+            for (int i = 0; i < 3; ++i)
+            {
+                terms[i](r, c) = terms[i](c, r) = dsq[i];
+            }
+        }
+    });
+}
+
+// mean squared closed-form leave-one-out residual alpha_i / invK_ii of the
+// examples of the distance terms; one factorization of the kernel matrix gives
+// both the coefficients and the diagonal of the inverse
+double
+SrtRbfModel::looError(
+    const std::vector<Eigen::MatrixXd>& terms,
+    const RowMatrixXd& secMat,
+    const double* params) const
+{
+    // params: scale weight, rotate weight, translate weight, gaussian width
+    const int numIds = static_cast<int>(terms[0].rows());
+    const int size = static_cast<int>(secMat.rows());
+    const double ws = distType == 3 ? 0.0 : params[0];
+    const double wr = distType == 3 ? 0.0 : params[1];
+    const double wt = distType == 3 ? 1.0 : params[2];
+    Eigen::MatrixXd kerMat(size, size);
+    kerMat.setOnes();
+    for (int c = 0; c < numIds; ++c)
+    {
+        for (int r = c; r < numIds; ++r)
+        {
+            const double dsq = ws * terms[0](r, c) + wr * terms[1](r, c) + wt * terms[2](r, c);
+            kerMat(r, c) = kerMat(c, r) = PoseVariable::rbf(std::sqrt(dsq), rbfType, params[3]);
+        }
+    }
+    if (size > numIds)
+    {
+        kerMat(numIds, numIds) = 0.0;
+    }
+    const double minRcond = std::numeric_limits<double>::epsilon();
+    Eigen::MatrixXd coefMat;
+    Eigen::VectorXd invDiag;
+    if (rbfType == 2)
+    {
+        // the gaussian kernel has a unit diagonal and factors symmetrically,
+        // indefinite only by the border of the affinity constraint
+        const Eigen::LDLT<Eigen::MatrixXd> kerMatLDLT(kerMat);
+        if (kerMatLDLT.info() != Eigen::Success || !(kerMatLDLT.rcond() > minRcond))
+        {
+            return std::numeric_limits<double>::max();
+        }
+        coefMat = kerMatLDLT.solve(secMat);
+        // diagonal of P^T L^-T D^-1 L^-1 P from the inverse of the unit lower factor
+        Eigen::MatrixXd invL = Eigen::MatrixXd::Identity(size, size);
+        kerMatLDLT.matrixL().solveInPlace(invL);
+        const Eigen::VectorXd permuted = (invL.array().square().colwise()
+            / kerMatLDLT.vectorD().array()).colwise().sum().transpose();
+        invDiag = kerMatLDLT.transpositionsP().transpose() * permuted;
+    }
+    else
+    {
+        // the linear and thin-plate kernels vanish on the diagonal, which the
+        // symmetric factorization cannot pivot on
+        const Eigen::PartialPivLU<Eigen::MatrixXd> kerMatLU(kerMat);
+        if (!(kerMatLU.rcond() > minRcond))
+        {
+            return std::numeric_limits<double>::max();
+        }
+        const Eigen::MatrixXd invMat = kerMatLU.inverse();
+        coefMat = invMat * secMat;
+        invDiag = invMat.diagonal();
+    }
+
+    double sqe = 0.0;
+    for (int i = 0; i < numIds; ++i)
+    {
+        sqe += coefMat.row(i).squaredNorm() / (invDiag[i] * invDiag[i]);
+    }
+    return sqe / numIds;
+}
+
+double
+SrtRbfModel::tune(
+    int numPasses,
+    double& initialError)
+{
+    // the leave-one-out error of a large node is estimated over a spread
+    // subset of its examples, which bounds the factorization of each candidate
+    const int maxTuneExamples = 1000;
+    const int numIds = std::min(numExs, maxTuneExamples);
+    std::vector<int> ids(numIds);
+    for (int i = 0; i < numIds; ++i)
+    {
+        ids[i] = static_cast<int>(static_cast<long long>(i) * numExs / numIds);
+    }
+    std::vector<Eigen::MatrixXd> terms;
+    distanceTerms(ids, terms);
+    RowMatrixXd secMat = RowMatrixXd::Zero(affinity ? numIds + 1 : numIds, 10);
+    for (int i = 0; i < numIds; ++i)
+    {
+        secMat.row(i) = secFeatures.row(ids[i]);
+    }
+    double params[4] = { scaleWeight, rotateWeight, translateWeight, width };
+    double bestError = looError(terms, secMat, params);
+    initialError = bestError;
+
+    // line search along each parameter, evaluating the candidates in parallel
+    const double factors[] = { 0.25, 0.5, 0.7071, 1.4142, 2.0, 4.0 };
+    const int numFactors = sizeof(factors) / sizeof(factors[0]);
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        for (int p = 0; p < 4; ++p)
+        {
+            // the weights are ignored by the Frobenius norm, the width by non-gaussian kernels
+            if ((p < 3 && distType == 3) || (p == 3 && rbfType != 2))
+            {
+                continue;
+            }
+            std::vector<double> errors(numFactors);
+            ParallelFor(0, numFactors, [&](int f)
+            {
+                double candidate[4] = { params[0], params[1], params[2], params[3] };
+                candidate[p] *= factors[f];
+                errors[f] = looError(terms, secMat, candidate);
+            });
+            const int best = static_cast<int>(std::min_element(errors.begin(), errors.end()) - errors.begin());
+            if (errors[best] < bestError)
+            {
+                bestError = errors[best];
+                params[p] *= factors[best];
+            }
+        }
+    }
+    scaleWeight     = params[0];
+    rotateWeight    = params[1];
+    translateWeight = params[2];
+    width           = params[3];
+    return bestError;
+}
+
+double
+SrtRbfModel::distance(
+    const std::vector<PoseVariable>& a,
+    const std::vector<PoseVariable>& b) const
+{
+    return PoseVariable::dissimilarity(a, b, distType, scaleWeight, rotateWeight, translateWeight);
+}
+
+double
+SrtRbfModel::kernel(
+    double d) const
+{
+    return PoseVariable::rbf(d, rbfType, width);
+}
+
+PoseVariable
+SrtRbfModel::relativize(
+    int iid,
+    const MTransformationMatrix& tm) const
+{
+    return relativize(iid, PoseVariable::fromMatrix(tm));
+}
+
+PoseVariable
+SrtRbfModel::relativize(
+    int iid,
+    const PoseVariable& pose) const
+{
+    MQuaternion bq = primRef[iid].rotate;
+    PoseVariable rel(pose);
+    rel.ontoHemisphere(bq);
+    rel.rotate = bq.conjugate() * rel.rotate;
+    return rel;
+}
+
+int
+SrtRbfModel::numCenters() const
+{
+    return solver != 0 ? static_cast<int>(landmarks.size()) : numExs;
+}
+
+void
+SrtRbfModel::partialDistance(
+    int iid,
+    const PoseVariable& pose,
+    double* distSq) const
+{
+    const int n = numCenters();
+    for (int j = 0; j < n; ++j)
+    {
+        const int eid = solver != 0 ? landmarks[j] : j;
+        distSq[j] = PoseVariable::dissimilaritySq(primary[eid][iid], pose,
+            distType, scaleWeight, rotateWeight, translateWeight);
+    }
+}
+
+void
+SrtRbfModel::weightFromDistance(
+    const Eigen::VectorXd& distSq,
+    SrtRbfWorkspace& workspace,
+    Eigen::VectorXd& weight) const
+{
+    Eigen::VectorXd& distVec = workspace.kernelVec;
+    if (affinity)
+    {
+        distVec.resize(numExs + 1);
+        distVec[numExs] = 1.0;
+    }
+    else
+    {
+        distVec.resize(numExs);
+    }
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        distVec[eid] = kernel(std::sqrt(distSq[eid]));
+    }
+    weight.resize(invKerMat.rows());
+    weight.noalias() = invKerMat * distVec;
+}
+
+void
+SrtRbfModel::featuresFromDistance(
+    const Eigen::VectorXd& distSq,
+    Eigen::VectorXd& feature) const
+{
+    const int numLandmarks = static_cast<int>(landmarks.size());
+    if (affinity)
+    {
+        feature = coef.row(numLandmarks).transpose();
+    }
+    else
+    {
+        feature.setZero(10);
+    }
+    for (int j = 0; j < numLandmarks; ++j)
+    {
+        feature += kernel(std::sqrt(distSq[j])) * coef.row(j).transpose();
+    }
+}
+
+void
+SrtRbfModel::fullWeight(
+    const std::vector<PoseVariable>& poses,
+    SrtRbfWorkspace& workspace,
+    Eigen::VectorXd& weight) const
+{
+    Eigen::VectorXd& distVec = workspace.kernelVec;
+    if (affinity)
+    {
+        distVec.resize(numExs + 1);
+        distVec[numExs] = 1.0;
+    }
+    else
+    {
+        distVec.resize(numExs);
+    }
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        distVec[eid] = kernel(distance(primary[eid], poses));
+    }
+    weight.resize(invKerMat.rows());
+    weight.noalias() = invKerMat * distVec;
+}
+
+bool
+SrtRbfModel::localWeight(
+    const std::vector<PoseVariable>& poses,
+    int k,
+    SrtRbfWorkspace& workspace,
+    std::vector<int>& ids,
+    Eigen::VectorXd& weight)
+{
+    // only the gaussian kernel decays, so that the examples beyond the nearest
+    // ones can be dropped; the others blend all examples
+    if (rbfType != 2)
+    {
+        ids.clear();
+        return false;
+    }
+    nearest(poses, k, workspace, ids);
+    std::sort(ids.begin(), ids.end());
+    const int numIds = static_cast<int>(ids.size());
+    const int size = affinity ? numIds + 1 : numIds;
+
+    // reuse the local system while the neighborhood does not change;
+    // the buffers keep their size while k does, so a new neighborhood does not allocate
+    if (ids != localIds)
+    {
+        Eigen::MatrixXd& kerMat = workspace.localKernel;
+        kerMat.resize(size, size);
+        kerMat.setOnes();
+        if (affinity)
+        {
+            kerMat(numIds, numIds) = 0.0;
+        }
+        for (int r = 0; r < numIds; ++r)
+        {
+            for (int c = r; c < numIds; ++c)
+            {
+                kerMat(r, c) = kernel(distance(primary[ids[r]], primary[ids[c]]));
+                kerMat(c, r) = kerMat(r, c);
+            }
+        }
+        localLU.compute(kerMat);
+        if (localLU.rank() < kerMat.rows())
+        {
+            localIds.clear();
+            return false;
+        }
+        // inverse Q U^-1 L^-1 P solved in place of the factorized kernel matrix;
+        // inverse() would copy the decomposition
+        Eigen::MatrixXd& solved = workspace.localKernel;
+        solved = localLU.permutationP();
+        localLU.matrixLU().triangularView<Eigen::UnitLower>().solveInPlace(solved);
+        localLU.matrixLU().triangularView<Eigen::Upper>().solveInPlace(solved);
+        localInvKerMat.resize(size, size);
+        localInvKerMat.noalias() = localLU.permutationQ() * solved;
+        localIds = ids;
+    }
+
+    // the head of the kernel buffer keeps its size for the blend of all examples
+    if (workspace.kernelVec.size() < size)
+    {
+        workspace.kernelVec.resize(size);
+    }
+    Eigen::VectorXd::SegmentReturnType distVec = workspace.kernelVec.head(size);
+    if (affinity)
+    {
+        distVec[numIds] = 1.0;
+    }
+    for (int i = 0; i < numIds; ++i)
+    {
+        distVec[i] = kernel(distance(primary[ids[i]], poses));
+    }
+    weight.resize(size);
+    weight.noalias() = localInvKerMat * distVec;
+    return true;
+}
+
+// max abs difference of the output matrix of the blend of the k nearest
+// examples from the blend of all examples, at the poses of testInputs around
+// the examples; both blends interpolate the examples themselves, which are
+// skipped. Infinite for the kernels that do not decay.
+double
+SrtRbfModel::nearestError(
+    int k,
+    int numSamples)
+{
+    if (rbfType != 2)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    std::vector<MMatrix> inputs;
+    testInputs(numSamples, inputs);
+    const int numPoses = numInputs == 0 ? 0 : static_cast<int>(inputs.size()) / numInputs;
+    SrtRbfWorkspace workspace;
+    workspace.reserve(*this);
+    std::vector<PoseVariable> poses(numInputs);
+    std::vector<int> ids;
+    Eigen::VectorXd weight, feature, exactFeature;
+    double maxError = 0.0;
+    for (int pid = std::min(numExs, numPoses); pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            poses[iid] = relativize(iid, MTransformationMatrix(inputs[pid * numInputs + iid]));
+        }
+        if (!localWeight(poses, k, workspace, ids, weight))
+        {
+            continue;
+        }
+        features(weight, ids, feature);
+        evaluate(poses, workspace, exactFeature);
+        const MMatrix approx = compose(feature);
+        const MMatrix exact = compose(exactFeature);
+        for (int j = 0; j < 16; ++j)
+        {
+            maxError = std::max(maxError, std::abs(approx(j / 4, j % 4) - exact(j / 4, j % 4)));
+        }
+    }
+    return maxError;
+}
+
+void
+SrtRbfModel::features(
+    const Eigen::VectorXd& weight,
+    const std::vector<int>& ids,
+    Eigen::VectorXd& feature) const
+{
+    // ids is empty when weight covers all examples
+    const int numWeights = ids.empty() ? numExs : static_cast<int>(ids.size());
+    feature.setZero(10);
+    for (int i = 0; i < numWeights; ++i)
+    {
+        const int eid = ids.empty() ? i : ids[i];
+        feature += weight[i] * secFeatures.row(eid).transpose();
+    }
+}
+
+// features of frame.poses by the per-frame path of SrtRbfNode: the blend of
+// the k nearest examples if k > 0, solved from the examples for every solver,
+// the single-precision blend, or the blend of all examples over the per-input
+// squared distances, of which only the rows of the dirty inputs are measured
+// again while they are valid
+void
+SrtRbfModel::frameFeatures(
+    int k,
+    bool single,
+    SrtRbfFrame& frame,
+    SrtRbfWorkspace& workspace,
+    Eigen::VectorXd& feature)
+{
+    frame.weightIds.clear();
+    if (k > 0 && k < numExs
+        && localWeight(frame.poses, k, workspace, frame.weightIds, frame.weight))
+    {
+        frame.distValid = false;
+        features(frame.weight, frame.weightIds, feature);
+        return;
+    }
+    frame.weightIds.clear();
+
+    // the single-precision path measures all the distances in float
+    if (single)
+    {
+        if (!hasSingle())
+        {
+            buildSingle();
+        }
+        frame.distValid = false;
+        singleFeatures(frame.poses, workspace, feature);
+        return;
+    }
+
+    // the squared distance is the sum of per-input terms
+    const int numCenters = this->numCenters();
+    if (!frame.distValid || frame.partialDistSq.rows() != numInputs || frame.partialDistSq.cols() != numCenters)
+    {
+        frame.partialDistSq.resize(numInputs, numCenters);
+        frame.dirty.assign(numInputs, 1);
+    }
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        if (frame.dirty[iid])
+        {
+            partialDistance(iid, frame.poses[iid], frame.partialDistSq.row(iid).data());
+        }
+    }
+    frame.distValid = true;
+    frame.distSq.resize(numCenters);
+    frame.distSq.noalias() = frame.partialDistSq.colwise().sum().transpose();
+
+    // the low-rank and iterative solvers blend the coefficients of their centers instead
+    if (solver == 0)
+    {
+        weightFromDistance(frame.distSq, workspace, frame.weight);
+        features(frame.weight, frame.weightIds, feature);
+    }
+    else
+    {
+        featuresFromDistance(frame.distSq, feature);
+    }
+}
+
+void
+SrtRbfModel::lowRankFeatures(
+    const std::vector<PoseVariable>& poses,
+    Eigen::VectorXd& feature) const
+{
+    const int numLandmarks = static_cast<int>(landmarks.size());
+    if (affinity)
+    {
+        feature = coef.row(numLandmarks).transpose();
+    }
+    else
+    {
+        feature.setZero(10);
+    }
+    for (int j = 0; j < numLandmarks; ++j)
+    {
+        feature += kernel(distance(primary[landmarks[j]], poses)) * coef.row(j).transpose();
+    }
+}
+
+// secondary transformation of blended features
+PoseVariable
+SrtRbfModel::outputPose(
+    const Eigen::VectorXd& feature) const
+{
+    PoseVariable pose = PoseVariable::getPoseFrom(feature.data(), 0);
+    if (affinity)
+    {
+        pose.rotate = secondary[0].rotate * pose.rotate.exp();
+    }
+    else
+    {
+        pose.rotate = pose.rotate.exp();
+    }
+    pose.rotate.normalizeIt();
+    return pose;
+}
+
+MMatrix
+SrtRbfModel::compose(
+    const Eigen::VectorXd& feature) const
+{
+    if (numExs == 0)
+    {
+        return MMatrix::identity;
+    }
+    const PoseVariable pose = outputPose(feature);
+    // scale, rotation and translation composed in place of MTransformationMatrix
+    MMatrix m = pose.rotate.asMatrix();
+    for (int c = 0; c < 3; ++c)
+    {
+        m(0, c) *= pose.scale.x;
+        m(1, c) *= pose.scale.y;
+        m(2, c) *= pose.scale.z;
+        m(3, c) = pose.translate[c];
+    }
+    return m;
+}
+
+void
+SrtRbfModel::evaluate(
+    const std::vector<PoseVariable>& poses,
+    Eigen::VectorXd& feature) const
+{
+    SrtRbfWorkspace workspace;
+    evaluate(poses, workspace, feature);
+}
+
+// blend of all examples in the buffers of the workspace, e.g. for measuring
+// the error of an approximation in the per-frame path
+void
+SrtRbfModel::evaluate(
+    const std::vector<PoseVariable>& poses,
+    SrtRbfWorkspace& workspace,
+    Eigen::VectorXd& feature) const
+{
+    if (solver != 0)
+    {
+        lowRankFeatures(poses, feature);
+    }
+    else
+    {
+        fullWeight(poses, workspace, workspace.weight);
+        features(workspace.weight, std::vector<int>(), feature);
+    }
+}
+
+void
+SrtRbfModel::exampleFeatures(
+    int eid,
+    Eigen::VectorXd& feature) const
+{
+    feature = secFeatures.row(eid).transpose();
+}
+
+void
+SrtRbfWorkspace::reserve(
+    const SrtRbfModel& model)
+{
+    const int size = model.numExs + 1;
+    kernelVec.resize(size);
+    weight.resize(size);
+    feature.resize(10);
+    exactFeature.resize(10);
+    found.reserve(size);
+    pending.reserve(2 * size);
+    kernelVecF.resize(size);
+    queryF.resize(model.numInputs * model.singleDims());
+    featureF.resize(10);
+}
+
+// sizes the buffers for the model; the distances are measured again
+void
+SrtRbfFrame::reserve(
+    const SrtRbfModel& model)
+{
+    poses.resize(model.numInputs);
+    dirty.assign(model.numInputs, 1);
+    partialDistSq.resize(model.numInputs, model.numCenters());
+    distSq.resize(model.numCenters());
+    distValid = false;
+    weight.resize(model.affinity ? model.numExs + 1 : model.numExs);
+    weightIds.reserve(model.numExs);
+}
+
+// features of many input sets at once; poses holds #poses x numInputs relativized poses
+void
+SrtRbfModel::evaluateBatch(
+    const std::vector<PoseVariable>& poses,
+    RowMatrixXd& features) const
+{
+    std::vector<int> centers;
+    RowMatrixXd coefficients;
+    dualCoefficients(centers, coefficients);
+    evaluateBatch(poses, coefficients, features);
+}
+
+// the same with the coefficients of dualCoefficients computed in advance
+void
+SrtRbfModel::evaluateBatch(
+    const std::vector<PoseVariable>& poses,
+    const RowMatrixXd& coefficients,
+    RowMatrixXd& features) const
+{
+    const int numPoses = numInputs == 0 ? 0 : static_cast<int>(poses.size()) / numInputs;
+    const int numCenters = this->numCenters();
+
+    // kernel matrix of all the poses (the last column is 1 under affinity),
+    // followed by a single product with the coefficients
+    RowMatrixXd kerMat = RowMatrixXd::Ones(numPoses, coefficients.rows());
+    ParallelFor(0, numPoses, [&](int pid)
+    {
+        std::vector<double> distSq(numCenters, 0.0);
+        std::vector<double> partial(numCenters);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            partialDistance(iid, poses[pid * numInputs + iid], partial.data());
+            for (int j = 0; j < numCenters; ++j)
+            {
+                distSq[j] += partial[j];
+            }
+        }
+        for (int j = 0; j < numCenters; ++j)
+        {
+            kerMat(pid, j) = kernel(std::sqrt(distSq[j]));
+        }
+    });
+    features.noalias() = kerMat * coefficients;
+}
+
+// kernel columns and their coefficients;
+// feature = sum_j kernel(d_j) * coefficients.row(j) (+ coefficients.row(#centers) under affinity)
+void
+SrtRbfModel::dualCoefficients(
+    std::vector<int>& centers,
+    RowMatrixXd& coefficients) const
+{
+    if (solver != 0)
+    {
+        centers = landmarks;
+        coefficients = coef;
+        return;
+    }
+    centers.resize(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        centers[eid] = eid;
+    }
+    coefficients = invKerMat.topRows(numExs).transpose() * secFeatures;
+}
+
+MMatrix
+SrtRbfModel::blend(
+    const Eigen::VectorXd& weight,
+    const std::vector<int>& ids) const
+{
+    Eigen::VectorXd feature;
+    features(weight, ids, feature);
+    return compose(feature);
+}
+
+///
+
+int
+SrtRbfModel::singleDims() const
+{
+    return distType == 3 ? 12 : 10;
+}
+
+// coordinates whose weighted squared differences make up the distance:
+// the upper 4x3 block of the matrix under the Frobenius norm, otherwise
+// s(3), q(4), t(3) with the log quaternion in place of q for distType 1
+void
+SrtRbfModel::embedSingle(
+    const PoseVariable& pose,
+    float* embedded) const
+{
+    if (distType == 3)
+    {
+        const MMatrix m = PoseVariable::toMatrix(pose);
+        for (int c = 0; c < 12; ++c)
+        {
+            embedded[c] = static_cast<float>(m(c / 3, c % 3));
+        }
+        return;
+    }
+    PoseVariable p = pose;
+    if (distType == 1)
+    {
+        p.rotate = p.rotate.log();
+    }
+    double values[10];
+    PoseVariable::setPoseTo(values, 0, p);
+    for (int c = 0; c < 10; ++c)
+    {
+        embedded[c] = static_cast<float>(values[c]);
+    }
+}
+
+void
+SrtRbfModel::buildSingle()
+{
+    std::vector<int> centers;
+    RowMatrixXd coefficients;
+    dualCoefficients(centers, coefficients);
+    const int dims = singleDims();
+    const int n = static_cast<int>(centers.size());
+    singleCenters.resize(numInputs * dims, n);
+    std::vector<float> embedded(dims);
+    for (int j = 0; j < n; ++j)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            embedSingle(primary[centers[j]][iid], embedded.data());
+            for (int c = 0; c < dims; ++c)
+            {
+                singleCenters(iid * dims + c, j) = embedded[c];
+            }
+        }
+    }
+    singleCoef = coefficients.cast<float>();
+    singleBuilt = true;
+}
+
+bool
+SrtRbfModel::hasSingle() const
+{
+    return singleBuilt;
+}
+
+static inline void
+AccumulateSquared(
+    const float* row,
+    float value,
+    float w,
+    int n,
+    float* distSq)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        const float d = row[j] - value;
+        distSq[j] += w * d * d;
+    }
+}
+
+void
+SrtRbfModel::singleFeatures(
+    const std::vector<PoseVariable>& poses,
+    SrtRbfWorkspace& workspace,
+    Eigen::VectorXd& feature) const
+{
+    const int dims = singleDims();
+    const int n = static_cast<int>(singleCenters.cols());
+    const int numCoefs = static_cast<int>(singleCoef.rows());
+    Eigen::VectorXf& query = workspace.queryF;
+    Eigen::VectorXf& kernelVec = workspace.kernelVecF;
+    if (query.size() < numInputs * dims)
+    {
+        query.resize(numInputs * dims);
+    }
+    if (kernelVec.size() < numCoefs)
+    {
+        kernelVec.resize(numCoefs);
+    }
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        embedSingle(poses[iid], query.data() + iid * dims);
+    }
+
+    // squared distances accumulated over the contiguous rows of the centers
+    const float ws = static_cast<float>(scaleWeight);
+    const float wr = static_cast<float>(rotateWeight);
+    const float wt = static_cast<float>(translateWeight);
+    float* distSq = kernelVec.data();
+    std::fill(distSq, distSq + n, 0.0f);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        const float* q = query.data() + iid * dims;
+        const float* rows = singleCenters.data() + static_cast<size_t>(iid) * dims * n;
+        if (distType == 3)
+        {
+            for (int c = 0; c < 12; ++c)
+            {
+                AccumulateSquared(rows + c * n, q[c], 1.0f, n, distSq);
+            }
+            continue;
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            AccumulateSquared(rows + c * n, q[c], ws, n, distSq);
+            AccumulateSquared(rows + (7 + c) * n, q[7 + c], wt, n, distSq);
+        }
+        if (distType == 1)
+        {
+            for (int c = 3; c < 7; ++c)
+            {
+                AccumulateSquared(rows + c * n, q[c], wr, n, distSq);
+            }
+            continue;
+        }
+        const float* qx = rows + 3 * n;
+        const float* qy = rows + 4 * n;
+        const float* qz = rows + 5 * n;
+        const float* qw = rows + 6 * n;
+        // the angle from the chord length, which keeps its precision near zero
+        // where acos of the dot product does not: 2 acos(a.b) = 4 asin(|a - b| / 2)
+        for (int j = 0; j < n; ++j)
+        {
+            const float cq[4] = { qx[j], qy[j], qz[j], qw[j] };
+            float minusSq = 0.0f;
+            float plusSq = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                minusSq += (cq[c] - q[3 + c]) * (cq[c] - q[3 + c]);
+                plusSq += (cq[c] + q[3 + c]) * (cq[c] + q[3 + c]);
+            }
+            if (distType == 2)
+            {
+                minusSq = std::min(minusSq, plusSq);
+            }
+            const float angle = 4.0f * std::asin(std::min(0.5f * std::sqrt(minusSq), 1.0f));
+            distSq[j] += wr * angle * angle;
+        }
+    }
+
+    // kernel values in place of the distances
+    switch (rbfType)
+    {
+    case 0:
+        for (int j = 0; j < n; ++j)
+        {
+            distSq[j] = std::sqrt(distSq[j]);
+        }
+        break;
+    case 1:
+        for (int j = 0; j < n; ++j)
+        {
+            const float d = std::sqrt(distSq[j]);
+            distSq[j] = d < 1.0e-6f ? 0.0f : distSq[j] * std::log(d);
+        }
+        break;
+    case 2:
+    default:
+        for (int j = 0; j < n; ++j)
+        {
+            distSq[j] = std::exp(-distSq[j] / static_cast<float>(width));
+        }
+        break;
+    }
+    if (numCoefs > n)
+    {
+        kernelVec[n] = 1.0f;
+    }
+    workspace.featureF.noalias() = singleCoef.transpose() * kernelVec.head(numCoefs);
+    feature = workspace.featureF.cast<double>();
+}
+
+// standard deviation of the scale and translation of the examples per input
+void
+SrtRbfModel::exampleSpread(
+    std::vector<double>& scaleSpread,
+    std::vector<double>& translateSpread) const
+{
+    scaleSpread.assign(numInputs, 0.0);
+    translateSpread.assign(numInputs, 0.0);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        MVector meanS, meanT;
+        for (int eid = 0; eid < numExs; ++eid)
+        {
+            meanS += primary[eid][iid].scale * (1.0 / numExs);
+            meanT += primary[eid][iid].translate * (1.0 / numExs);
+        }
+        for (int eid = 0; eid < numExs; ++eid)
+        {
+            const MVector ds = primary[eid][iid].scale - meanS;
+            const MVector dt = primary[eid][iid].translate - meanT;
+            scaleSpread[iid] += PoseVariable::vdot(ds, ds) / numExs;
+            translateSpread[iid] += PoseVariable::vdot(dt, dt) / numExs;
+        }
+        scaleSpread[iid] = std::sqrt(scaleSpread[iid]);
+        translateSpread[iid] = std::sqrt(translateSpread[iid]);
+    }
+}
+
+// max deviation of the single-precision outputs from the double ones at the
+// examples and at poses sampled around them; the rotation is in degrees
+void
+SrtRbfModel::validateSingle(
+    int numSamples,
+    double& maxTranslate,
+    double& maxRotate,
+    double& maxScale) const
+{
+    maxTranslate = 0.0;
+    maxRotate = 0.0;
+    maxScale = 0.0;
+    if (numExs == 0 || numInputs == 0)
+    {
+        return;
+    }
+    SrtRbfModel single(*this);
+    single.singlePrecision = true;
+    single.buildSingle();
+
+    // spread of the examples per input to scale the perturbations
+    std::vector<double> scaleSpread, translateSpread;
+    exampleSpread(scaleSpread, translateSpread);
+
+    // the examples followed by random perturbations of them
+    std::vector<PoseVariable> poses;
+    poses.reserve((numExs + numSamples) * numInputs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        poses.insert(poses.end(), primary[eid].begin(), primary[eid].end());
+    }
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> pick(0, numExs - 1);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    for (int sid = 0; sid < numSamples; ++sid)
+    {
+        const int eid = pick(rng);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            PoseVariable pose = primary[eid][iid];
+            MVector axis(normal(rng), normal(rng), normal(rng));
+            const double halfAngle = 0.125 * normal(rng);
+            const double length = axis.length();
+            axis = length > 0.0 ? axis * (std::sin(halfAngle) / length) : MVector();
+            pose.rotate = pose.rotate * MQuaternion(axis.x, axis.y, axis.z, std::cos(halfAngle));
+            pose.rotate.normalizeIt();
+            pose.ontoHemisphere();
+            const double sd = 0.25 * scaleSpread[iid];
+            const double td = 0.25 * translateSpread[iid];
+            pose.scale += MVector(normal(rng), normal(rng), normal(rng)) * sd;
+            pose.translate += MVector(normal(rng), normal(rng), normal(rng)) * td;
+            poses.push_back(pose);
+        }
+    }
+
+    const int numPoses = static_cast<int>(poses.size()) / numInputs;
+    std::vector<double> deviations(numPoses * 3, 0.0);
+    ParallelFor(0, numPoses, [&](int pid)
+    {
+        const std::vector<PoseVariable> input(
+            poses.begin() + pid * numInputs, poses.begin() + (pid + 1) * numInputs);
+        Eigen::VectorXd exact, approx;
+        evaluate(input, exact);
+        SrtRbfWorkspace workspace;
+        single.singleFeatures(input, workspace, approx);
+        const PoseVariable a = outputPose(exact);
+        const PoseVariable b = outputPose(approx);
+        // angle of the relative rotation, stable near zero unlike acos
+        const MQuaternion dq = a.rotate.conjugate() * b.rotate;
+        const double sinHalf = std::sqrt(dq.x * dq.x + dq.y * dq.y + dq.z * dq.z);
+        const MVector ds = a.scale - b.scale;
+        deviations[pid * 3 + 0] = (a.translate - b.translate).length();
+        deviations[pid * 3 + 1] = 2.0 * std::atan2(sinHalf, std::abs(dq.w)) * (180.0 / 3.14159265358979323846);
+        deviations[pid * 3 + 2] = std::max(std::abs(ds.x), std::max(std::abs(ds.y), std::abs(ds.z)));
+    });
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        maxTranslate = std::max(maxTranslate, deviations[pid * 3 + 0]);
+        maxRotate = std::max(maxRotate, deviations[pid * 3 + 1]);
+        maxScale = std::max(maxScale, deviations[pid * 3 + 2]);
+    }
+}
+
+///
+
+// coefficients of the reference evaluation, a dense solve of all examples
+// with a pivoted LU instead of the stored inverse or the iterative solve;
+// the low-rank solver is an approximation of it
+bool
+SrtRbfModel::referenceCoefficients(
+    std::vector<int>& centers,
+    Eigen::MatrixXd& coefficients) const
+{
+    const int size = affinity ? numExs + 1 : numExs;
+    Eigen::MatrixXd kerMat = Eigen::MatrixXd::Ones(size, size);
+    if (affinity)
+    {
+        kerMat(numExs, numExs) = 0.0;
+    }
+    for (int r = 0; r < numExs; ++r)
+    {
+        for (int c = 0; c < numExs; ++c)
+        {
+            const double d = PoseVariable::dissimilarity(primary[r], primary[c],
+                distType, scaleWeight, rotateWeight, translateWeight);
+            kerMat(r, c) = PoseVariable::rbf(d, rbfType, width);
+        }
+    }
+    Eigen::FullPivLU<Eigen::MatrixXd> kerMatLU(kerMat);
+    if (kerMatLU.rank() < size)
+    {
+        return false;
+    }
+    // feature = secFeatures^T K^-1 k = (K^-T [secFeatures; 0])^T k
+    Eigen::MatrixXd rhs = Eigen::MatrixXd::Zero(size, 10);
+    rhs.topRows(numExs) = secFeatures;
+    coefficients = kerMat.transpose().fullPivLu().solve(rhs);
+    centers.resize(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        centers[eid] = eid;
+    }
+    return true;
+}
+
+// reference feature of relativized poses, measured pose by pose with
+// PoseVariable::dissimilarity and PoseVariable::rbf
+void
+SrtRbfModel::referenceFeatures(
+    const std::vector<PoseVariable>& poses,
+    const std::vector<int>& centers,
+    const Eigen::MatrixXd& coefficients,
+    Eigen::VectorXd& feature) const
+{
+    const int n = static_cast<int>(centers.size());
+    feature.setZero(10);
+    for (int j = 0; j < n; ++j)
+    {
+        const double d = PoseVariable::dissimilarity(primary[centers[j]], poses,
+            distType, scaleWeight, rotateWeight, translateWeight);
+        feature += PoseVariable::rbf(d, rbfType, width) * coefficients.row(j).transpose();
+    }
+    if (affinity)
+    {
+        feature += coefficients.row(n).transpose();
+    }
+}
+
+// absolute input matrices, numInputs per set, for comparing evaluation paths:
+// the examples, then in turn perturbations of them, rotations of about pi from
+// the reference (where the hemisphere of the quaternion is ambiguous), half
+// turns about the axes (components of -1), components below the epsilon of
+// truncateEpsilon, and uniformly random rotations
+void
+SrtRbfModel::testInputs(
+    int numSamples,
+    std::vector<MMatrix>& inputs) const
+{
+    inputs.clear();
+    if (numExs == 0 || numInputs == 0)
+    {
+        return;
+    }
+    std::vector<double> scaleSpread, translateSpread;
+    exampleSpread(scaleSpread, translateSpread);
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> pick(0, numExs - 1);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    auto randomAxis = [&]()
+    {
+        MVector axis(normal(rng), normal(rng), normal(rng));
+        const double length = axis.length();
+        return length > 0.0 ? axis * (1.0 / length) : MVector(1, 0, 0);
+    };
+    for (int sid = -numExs; sid < numSamples; ++sid)
+    {
+        const int eid = sid < 0 ? sid + numExs : pick(rng);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            PoseVariable pose = primary[eid][iid];
+            if (sid >= 0)
+            {
+                MQuaternion& q = pose.rotate;
+                switch (sid % 5)
+                {
+                case 0:
+                {
+                    const double halfAngle = 0.125 * normal(rng);
+                    const MVector axis = randomAxis() * std::sin(halfAngle);
+                    q = q * MQuaternion(axis.x, axis.y, axis.z, std::cos(halfAngle));
+                    break;
+                }
+                case 1:
+                {
+                    const MVector axis = randomAxis();
+                    q = MQuaternion(axis.x, axis.y, axis.z, 1.0e-7 * normal(rng));
+                    break;
+                }
+                case 2:
+                {
+                    const int axis = std::uniform_int_distribution<int>(0, 2)(rng);
+                    q = MQuaternion(axis == 0 ? -1 : 0, axis == 1 ? -1 : 0, axis == 2 ? -1 : 0, 0);
+                    break;
+                }
+                case 3:
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        q[i] += 1.0e-10 * normal(rng);
+                    }
+                    break;
+                default:
+                {
+                    q = MQuaternion(normal(rng), normal(rng), normal(rng), normal(rng));
+                    break;
+                }
+                }
+                q.normalizeIt();
+                const double sd = 0.25 * scaleSpread[iid];
+                const double td = 0.25 * translateSpread[iid];
+                pose.scale += MVector(normal(rng), normal(rng), normal(rng)) * sd;
+                pose.translate += MVector(normal(rng), normal(rng), normal(rng)) * td;
+            }
+            pose.rotate = primRef[iid].rotate * pose.rotate;
+            inputs.push_back(PoseVariable::toMatrix(pose));
+        }
+    }
+}
+
+///
+
+typedef Eigen::Matrix<double, 4, 3> Matrix43d;
+typedef Eigen::Matrix<double, 3, 4> Matrix34d;
+
+static Eigen::Vector4d
+QuaternionVector(
+    const MQuaternion& q)
+{
+    return Eigen::Vector4d(q.x, q.y, q.z, q.w);
+}
+
+// derivative of exp of the pure quaternion v by v, as (x, y, z, w)
+static Matrix43d
+ExpDerivative(
+    const Eigen::Vector3d& v)
+{
+    Matrix43d d;
+    const double a = v.norm();
+    if (a < 1.0e-8)
+    {
+        d.topRows<3>().setIdentity();
+        d.row(3) = -v.transpose();
+        return d;
+    }
+    const double sa = std::sin(a);
+    const double ca = std::cos(a);
+    d.topRows<3>() = (sa / a) * Eigen::Matrix3d::Identity()
+        + ((a * ca - sa) / (a * a * a)) * v * v.transpose();
+    d.row(3) = -(sa / a) * v.transpose();
+    return d;
+}
+
+// derivative of the log of q = (u, w), atan2(|u|, w) u / |u|, by (x, y, z, w)
+static Matrix34d
+LogDerivative(
+    const MQuaternion& q)
+{
+    Matrix34d d;
+    const Eigen::Vector3d u(q.x, q.y, q.z);
+    const double s = u.norm();
+    if (s < 1.0e-8)
+    {
+        d.leftCols<3>() = Eigen::Matrix3d::Identity() / q.w;
+        d.col(3).setZero();
+        return d;
+    }
+    const Eigen::Vector3d n = u / s;
+    const double r2 = s * s + q.w * q.w;
+    const double theta = std::atan2(s, q.w);
+    d.leftCols<3>() = (theta / s) * (Eigen::Matrix3d::Identity() - n * n.transpose())
+        + (q.w / r2) * n * n.transpose();
+    d.col(3) = -(s / r2) * n;
+    return d;
+}
+
+// matrix of b -> a * b
+static Eigen::Matrix4d
+ProductMatrix(
+    const MQuaternion& a)
+{
+    Eigen::Matrix4d m;
+    for (int k = 0; k < 4; ++k)
+    {
+        const MQuaternion e(k == 0, k == 1, k == 2, k == 3);
+        m.col(k) = QuaternionVector(a * e);
+    }
+    return m;
+}
+
+// rotation rows of a unit quaternion (row-vector convention) and their
+// derivatives by (x, y, z, w), written homogeneous so that they hold on the
+// tangent of the unit sphere
+static void
+RotationRows(
+    const MQuaternion& q,
+    double rot[3][3],
+    double dRot[4][3][3])
+{
+    const double x = q.x, y = q.y, z = q.z, w = q.w;
+    rot[0][0] = w * w + x * x - y * y - z * z;
+    rot[0][1] = 2.0 * (x * y + z * w);
+    rot[0][2] = 2.0 * (x * z - y * w);
+    rot[1][0] = 2.0 * (x * y - z * w);
+    rot[1][1] = w * w - x * x + y * y - z * z;
+    rot[1][2] = 2.0 * (y * z + x * w);
+    rot[2][0] = 2.0 * (x * z + y * w);
+    rot[2][1] = 2.0 * (y * z - x * w);
+    rot[2][2] = w * w - x * x - y * y + z * z;
+    const double g[4][3][3] = {
+        { {  x,  y,  z }, {  y, -x,  w }, {  z, -w, -x } },
+        { { -y,  x, -w }, {  x,  y,  z }, {  w,  z, -y } },
+        { { -z,  w,  x }, { -w, -z,  y }, {  x,  y,  z } },
+        { {  w,  z, -y }, { -z,  w,  x }, {  y, -x,  w } },
+    };
+    for (int k = 0; k < 4; ++k)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                dRot[k][r][c] = 2.0 * g[k][r][c];
+            }
+        }
+    }
+}
+
+// output parameters of absolute input poses: s, log q and t of the output
+void
+SrtRbfModel::outputParameters(
+    const std::vector<PoseVariable>& poses,
+    Eigen::VectorXd& params) const
+{
+    params.setZero(9);
+    if (numExs == 0)
+    {
+        params.head<3>().setOnes();
+        return;
+    }
+    std::vector<PoseVariable> rel(numInputs);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        rel[iid] = relativize(iid, poses[iid]);
+    }
+    Eigen::VectorXd feature;
+    evaluate(rel, feature);
+    const PoseVariable pose = outputPose(feature);
+    const MQuaternion lq = pose.rotate.log();
+    params << pose.scale.x, pose.scale.y, pose.scale.z,
+        lq.x, lq.y, lq.z,
+        pose.translate.x, pose.translate.y, pose.translate.z;
+}
+
+// analytic Jacobian at absolute input poses, chained as
+//  input log q -> exp -> relativized q -> squared distance to each center
+//  -> kernel -> dual coefficients -> blended feature -> exp (and secRotate) -> log
+// The kernel has no derivative where an input meets a center under the linear
+// kernel; it is taken as 0 there like the limit of the thin plate.
+// The quaternion distance has a cone at the antipode of a center, where the
+// Jacobian is undefined; it is then filled with NaN and false is returned.
+bool
+SrtRbfModel::jacobian(
+    const std::vector<PoseVariable>& poses,
+    Eigen::MatrixXd& jac) const
+{
+    const int numParams = 9 * numInputs;
+    jac.setZero(9, numParams);
+    if (numExs == 0)
+    {
+        return true;
+    }
+    std::vector<int> centers;
+    RowMatrixXd coefficients;
+    dualCoefficients(centers, coefficients);
+    const int n = static_cast<int>(centers.size());
+
+    // relativized inputs and the derivatives of their quaternions by the log quaternions
+    std::vector<PoseVariable> rel(numInputs);
+    std::vector<Matrix43d> dq(numInputs);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        const MQuaternion bq = primRef[iid].rotate.conjugate();
+        rel[iid] = relativize(iid, poses[iid]);
+        const double sign = PoseVariable::qdot(bq * poses[iid].rotate, rel[iid].rotate) < 0 ? -1.0 : 1.0;
+        const MQuaternion lq = poses[iid].rotate.log();
+        dq[iid] = sign * ProductMatrix(bq) * ExpDerivative(Eigen::Vector3d(lq.x, lq.y, lq.z));
+    }
+
+    // squared distances to the centers and their derivatives by the input parameters
+    Eigen::VectorXd distSq = Eigen::VectorXd::Zero(n);
+    RowMatrixXd distGrad = RowMatrixXd::Zero(n, numParams);
+    for (int j = 0; j < n; ++j)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            const PoseVariable& c = primary[centers[j]][iid];
+            const PoseVariable& p = rel[iid];
+            double* g = distGrad.row(j).data() + 9 * iid;
+            Eigen::RowVector4d dr;
+            distSq[j] += PoseVariable::dissimilaritySq(c, p,
+                distType, scaleWeight, rotateWeight, translateWeight);
+            if (distType == 3)
+            {
+                double rot[3][3], dRot[4][3][3];
+                RotationRows(p.rotate, rot, dRot);
+                const MMatrix dm = PoseVariable::toMatrix(p) - PoseVariable::toMatrix(c);
+                dr.setZero();
+                for (int r = 0; r < 3; ++r)
+                {
+                    g[r] = 0.0;
+                    for (int col = 0; col < 3; ++col)
+                    {
+                        g[r] += 2.0 * dm(r, col) * rot[r][col];
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            dr[k] += 2.0 * dm(r, col) * p.scale[r] * dRot[k][r][col];
+                        }
+                    }
+                    g[6 + r] = 2.0 * dm(3, r);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    g[k] = 2.0 * scaleWeight * (p.scale[k] - c.scale[k]);
+                    g[6 + k] = 2.0 * translateWeight * (p.translate[k] - c.translate[k]);
+                }
+                if (distType == 1)
+                {
+                    const MQuaternion ld = p.rotate.log() - c.rotate.log();
+                    dr = 2.0 * rotateWeight * Eigen::RowVector3d(ld.x, ld.y, ld.z) * LogDerivative(p.rotate);
+                }
+                else
+                {
+                    // d (2 acos(cos))^2 / d cos = -8 acos(cos) / sqrt(1 - cos^2)
+                    double cosine = PoseVariable::qdot(p.rotate, c.rotate);
+                    double sign = 1.0;
+                    if (distType == 2 && cosine < 0)
+                    {
+                        cosine = -cosine;
+                        sign = -1.0;
+                    }
+                    cosine = std::min(std::max(cosine, -1.0), 1.0);
+                    const double sine = std::sqrt(std::max(0.0, 1.0 - cosine * cosine));
+                    if (sine < 1.0e-8 && cosine < 0)
+                    {
+                        // acos / sin -> infinity at the antipode
+                        jac.setConstant(9, numParams, std::numeric_limits<double>::quiet_NaN());
+                        return false;
+                    }
+                    // acos / sin -> 1 at the center
+                    const double ratio = sine < 1.0e-8 ? 1.0 : std::acos(cosine) / sine;
+                    dr = -8.0 * rotateWeight * ratio * sign * QuaternionVector(c.rotate).transpose();
+                }
+            }
+            Eigen::Map<Eigen::RowVector3d>(g + 3) = dr * dq[iid];
+        }
+    }
+
+    // derivatives of the kernel values by the squared distances
+    Eigen::VectorXd kernelGrad(n);
+    for (int j = 0; j < n; ++j)
+    {
+        const double d = std::sqrt(distSq[j]);
+        switch (rbfType)
+        {
+        case 1: // d^2 log d
+            kernelGrad[j] = d < 1.0e-6 ? 0.0 : std::log(d) + 0.5;
+            break;
+        case 2:
+            kernelGrad[j] = -std::exp(-distSq[j] / width) / width;
+            break;
+        case 0:
+        default:
+            kernelGrad[j] = d < 1.0e-12 ? 0.0 : 0.5 / d;
+            break;
+        }
+    }
+    const Eigen::MatrixXd featureJac =
+        coefficients.topRows(n).transpose() * (kernelGrad.asDiagonal() * distGrad);
+
+    // blended feature to the output parameters
+    Eigen::VectorXd feature;
+    evaluate(rel, feature);
+    const Eigen::Vector3d lf(feature[3], feature[4], feature[5]);
+    MQuaternion q = MQuaternion(lf[0], lf[1], lf[2], 0.0).exp();
+    Eigen::Matrix4d compose = Eigen::Matrix4d::Identity();
+    if (affinity)
+    {
+        compose = ProductMatrix(secondary[0].rotate);
+        q = secondary[0].rotate * q;
+    }
+    jac.topRows<3>() = featureJac.topRows<3>();
+    jac.middleRows<3>(3) = LogDerivative(q) * compose * ExpDerivative(lf) * featureJac.middleRows<3>(3);
+    jac.bottomRows<3>() = featureJac.bottomRows<3>();
+    return true;
+}
+
+// largest difference of the analytic Jacobian from central differences
+double
+SrtRbfModel::jacobianError(
+    const std::vector<PoseVariable>& poses,
+    double step) const
+{
+    Eigen::MatrixXd jac;
+    if (!jacobian(poses, jac))
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    double maxError = 0.0;
+    std::vector<PoseVariable> moved(poses);
+    Eigen::VectorXd plus, minus;
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        const MQuaternion lq = poses[iid].rotate.log();
+        for (int k = 0; k < 9; ++k)
+        {
+            for (int side = 0; side < 2; ++side)
+            {
+                const double h = side == 0 ? step : -step;
+                moved[iid] = poses[iid];
+                if (k < 3)
+                {
+                    moved[iid].scale[k] += h;
+                }
+                else if (k < 6)
+                {
+                    MQuaternion l = lq;
+                    l[k - 3] += h;
+                    moved[iid].rotate = l.exp();
+                }
+                else
+                {
+                    moved[iid].translate[k - 6] += h;
+                }
+                outputParameters(moved, side == 0 ? plus : minus);
+            }
+            moved[iid] = poses[iid];
+            const Eigen::VectorXd diff = (plus - minus) / (2.0 * step) - jac.col(9 * iid + k);
+            maxError = std::max(maxError, diff.cwiseAbs().maxCoeff());
+        }
+    }
+    return maxError;
+}
+
+// the trained data in the layout of runtime/SrtRbfFormat.h
+bool
+SrtRbfModel::runtimeImage(
+    std::vector<double>& buffer) const
+{
+    if (numExs == 0 || numInputs == 0)
+    {
+        return false;
+    }
+    std::vector<int> centers;
+    RowMatrixXd coefficients;
+    dualCoefficients(centers, coefficients);
+    const int numCenters = static_cast<int>(centers.size());
+
+    // header and aligned sections
+    SrtRbfFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SRTRBF_MAGIC, sizeof(header.magic));
+    header.version    = SRTRBF_FORMAT_VERSION;
+    header.endianTag  = SRTRBF_ENDIAN_TAG;
+    header.headerSize = sizeof(SrtRbfFileHeader);
+    header.numInputs  = numInputs;
+    header.numCenters = numCenters;
+    header.numCoefs   = static_cast<int32_t>(coefficients.rows());
+    header.rbfType    = rbfType;
+    header.distType   = distType;
+    header.affinity   = affinity ? 1 : 0;
+    header.width           = width;
+    header.scaleWeight     = scaleWeight;
+    header.rotateWeight    = rotateWeight;
+    header.translateWeight = translateWeight;
+    if (affinity)
+    {
+        const MQuaternion& sref = secondary[0].rotate;
+        header.secRotate[0] = sref.x;
+        header.secRotate[1] = sref.y;
+        header.secRotate[2] = sref.z;
+        header.secRotate[3] = sref.w;
+    }
+    auto align = [](uint64_t offset) { return (offset + SRTRBF_ALIGNMENT - 1) / SRTRBF_ALIGNMENT * SRTRBF_ALIGNMENT; };
+    header.primRefOffset = align(sizeof(SrtRbfFileHeader));
+    header.centersOffset = align(header.primRefOffset + numInputs * 10 * sizeof(double));
+    header.coefOffset    = align(header.centersOffset + numCenters * numInputs * 10 * sizeof(double));
+    header.fileSize      = align(header.coefOffset + coefficients.size() * sizeof(double));
+
+    buffer.assign(header.fileSize / sizeof(double), 0.0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    double* refData = buffer.data() + header.primRefOffset / sizeof(double);
+    double* centerData = buffer.data() + header.centersOffset / sizeof(double);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        PoseVariable::setPoseTo(refData, iid, primRef[iid]);
+    }
+    for (int j = 0; j < numCenters; ++j)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            PoseVariable::setPoseTo(centerData, j * numInputs + iid, primary[centers[j]][iid]);
+        }
+    }
+    std::memcpy(buffer.data() + header.coefOffset / sizeof(double), coefficients.data(), coefficients.size() * sizeof(double));
+    return true;
+}
+
+
+///
+
+// cell size of the hash in the units of the distance; a query probes the
+// neighbouring cell only along the axes where its tolerance crosses a border
+static const double kHashCell = 0.1;
+static const int kMaxHashProbes = 10;
+
+static size_t
+HashCells(
+    const std::vector<long long>& cells)
+{
+    size_t key = 14695981039346656037ull;
+    for (long long c : cells)
+    {
+        key = (key ^ static_cast<size_t>(c)) * 1099511628211ull;
+    }
+    return key;
+}
+
+// coordinates whose Euclidean distance never exceeds the distance of the poses,
+// so that the examples within a tolerance are in the cells within the tolerance:
+//  distType 0: 2 |a - b| <= 2 acos(a.b)
+//  distType 1: the log quaternions as they are
+//  distType 2: |aa^T - bb^T| / sqrt(2) <= 2 acos(|a.b|), free of the sign of q
+//  distType 3: the upper 4x3 block of the matrix as it is
+void
+SrtRbfModel::hashCoordinates(
+    const std::vector<PoseVariable>& poses,
+    std::vector<double>& coords) const
+{
+    coords.clear();
+    const double ss = std::sqrt(scaleWeight);
+    const double sr = std::sqrt(rotateWeight);
+    const double st = std::sqrt(translateWeight);
+    for (const PoseVariable& pose : poses)
+    {
+        if (distType == 3)
+        {
+            const MMatrix m = PoseVariable::toMatrix(pose);
+            for (int c = 0; c < 12; ++c)
+            {
+                coords.push_back(m(c / 3, c % 3));
+            }
+            continue;
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            coords.push_back(ss * pose.scale[c]);
+            coords.push_back(st * pose.translate[c]);
+        }
+        const MQuaternion& q = pose.rotate;
+        if (distType == 2)
+        {
+            const double v[4] = { q.x, q.y, q.z, q.w };
+            for (int r = 0; r < 4; ++r)
+            {
+                coords.push_back(std::sqrt(2.0) * sr * v[r] * v[r]);
+                for (int c = r + 1; c < 4; ++c)
+                {
+                    coords.push_back(2.0 * sr * v[r] * v[c]);
+                }
+            }
+            continue;
+        }
+        const MQuaternion lq = distType == 1 ? q.log() : q;
+        const double w = distType == 1 ? sr : 2.0 * sr;
+        coords.push_back(w * lq.x);
+        coords.push_back(w * lq.y);
+        coords.push_back(w * lq.z);
+        coords.push_back(w * lq.w);
+    }
+}
+
+void
+SrtRbfModel::buildHash()
+{
+    exampleHash.clear();
+    std::vector<double> coords;
+    std::vector<long long> cells;
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        hashCoordinates(primary[eid], coords);
+        cells.resize(coords.size());
+        for (size_t d = 0; d < coords.size(); ++d)
+        {
+            cells[d] = static_cast<long long>(std::floor(coords[d] / kHashCell));
+        }
+        exampleHash[HashCells(cells)].push_back(eid);
+    }
+    hashedExs = numExs;
+}
+
+// an example closer than the tolerance, or -1
+int
+SrtRbfModel::findDuplicate(
+    const std::vector<PoseVariable>& poses,
+    double tolerance) const
+{
+    std::vector<double> coords;
+    hashCoordinates(poses, coords);
+    std::vector<long long> cells(coords.size());
+    std::vector<std::pair<int, int>> borders; // axis and offset of the neighbouring cell
+    const double r = tolerance / kHashCell;
+    for (size_t d = 0; d < coords.size(); ++d)
+    {
+        const double x = coords[d] / kHashCell;
+        cells[d] = static_cast<long long>(std::floor(x));
+        const double f = x - static_cast<double>(cells[d]);
+        if (f < r)
+        {
+            borders.push_back(std::make_pair(static_cast<int>(d), -1));
+        }
+        else if (f > 1.0 - r)
+        {
+            borders.push_back(std::make_pair(static_cast<int>(d), 1));
+        }
+    }
+
+    // scan all the examples if the hash is stale or the probes would outnumber them
+    if (hashedExs != numExs || 2.0 * r > 1.0 || static_cast<int>(borders.size()) > kMaxHashProbes)
+    {
+        for (int eid = 0; eid < numExs; ++eid)
+        {
+            if (distance(primary[eid], poses) < tolerance)
+            {
+                return eid;
+            }
+        }
+        return -1;
+    }
+    const int numProbes = 1 << borders.size();
+    std::vector<long long> probe;
+    for (int mask = 0; mask < numProbes; ++mask)
+    {
+        probe = cells;
+        for (size_t b = 0; b < borders.size(); ++b)
+        {
+            if (mask & (1 << b))
+            {
+                probe[borders[b].first] += borders[b].second;
+            }
+        }
+        auto it = exampleHash.find(HashCells(probe));
+        if (it == exampleHash.end())
+        {
+            continue;
+        }
+        for (int eid : it->second)
+        {
+            if (distance(primary[eid], poses) < tolerance)
+            {
+                return eid;
+            }
+        }
+    }
+    return -1;
+}
+
+///
+
+void
+SrtRbfModel::buildIndex()
+{
+    vpTree.clear();
+    localIds.clear();
+    std::vector<int> eids(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
+    {
+        eids[eid] = eid;
+    }
+    vpTree.reserve(numExs);
+    buildIndex(eids, 0, numExs);
+}
+
+int
+SrtRbfModel::buildIndex(
+    std::vector<int>& eids,
+    int begin,
+    int end)
+{
+    if (begin >= end)
+    {
+        return -1;
+    }
+    const int nid = static_cast<int>(vpTree.size());
+    VpNode node = { eids[begin], 0.0, -1, -1 };
+    vpTree.push_back(node);
+    if (end - begin == 1)
+    {
+        return nid;
+    }
+
+    // split the rest at the median distance from the vantage point
+    const std::vector<PoseVariable>& vp = primary[eids[begin]];
+    std::vector<std::pair<double, int>> dists;
+    dists.reserve(end - begin - 1);
+    for (int i = begin + 1; i < end; ++i)
+    {
+        dists.push_back(std::make_pair(distance(vp, primary[eids[i]]), eids[i]));
+    }
+    const int median = static_cast<int>(dists.size()) / 2;
+    std::nth_element(dists.begin(), dists.begin() + median, dists.end());
+    for (int i = 0; i < static_cast<int>(dists.size()); ++i)
+    {
+        eids[begin + 1 + i] = dists[i].second;
+    }
+    vpTree[nid].radius = dists[median].first;
+    const int inside = buildIndex(eids, begin + 1, begin + 1 + median);
+    const int outside = buildIndex(eids, begin + 1 + median, end);
+    vpTree[nid].inside = inside;
+    vpTree[nid].outside = outside;
+    return nid;
+}
+
+void
+SrtRbfModel::nearest(
+    const std::vector<PoseVariable>& poses,
+    int k,
+    SrtRbfWorkspace& workspace,
+    std::vector<int>& ids) const
+{
+    // max-heap of the k nearest examples found so far
+    std::vector<std::pair<double, int>>& found = workspace.found;
+    found.clear();
+    // pending subtrees with the lower bound of their distances
+    std::vector<std::pair<int, double>>& pending = workspace.pending;
+    pending.clear();
+    if (!vpTree.empty())
+    {
+        pending.push_back(std::make_pair(0, 0.0));
+    }
+    while (!pending.empty())
+    {
+        const int nid = pending.back().first;
+        const double bound = pending.back().second;
+        pending.pop_back();
+        if (nid < 0 || (static_cast<int>(found.size()) == k && bound > found.front().first))
+        {
+            continue;
+        }
+        const VpNode& node = vpTree[nid];
+        const double d = distance(primary[node.eid], poses);
+        if (static_cast<int>(found.size()) < k)
+        {
+            found.push_back(std::make_pair(d, node.eid));
+            std::push_heap(found.begin(), found.end());
+        }
+        else if (d < found.front().first)
+        {
+            std::pop_heap(found.begin(), found.end());
+            found.back() = std::make_pair(d, node.eid);
+            std::push_heap(found.begin(), found.end());
+        }
+        // the nearer side is pushed last so that it is visited first
+        const double insideBound = std::max(0.0, d - node.radius);
+        const double outsideBound = std::max(0.0, node.radius - d);
+        if (d < node.radius)
+        {
+            pending.push_back(std::make_pair(node.outside, outsideBound));
+            pending.push_back(std::make_pair(node.inside, insideBound));
+        }
+        else
+        {
+            pending.push_back(std::make_pair(node.inside, insideBound));
+            pending.push_back(std::make_pair(node.outside, outsideBound));
+        }
+    }
+    std::sort_heap(found.begin(), found.end());
+    ids.resize(found.size());
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        ids[i] = found[i].second;
+    }
+}
+
+///
+
+// bytes allocated for the examples, for the solved system, and for the data
+// derived from them: blended features, single-precision copies and indices
+void
+SrtRbfModel::memoryUsage(
+    size_t& exampleBytes,
+    size_t& solveBytes,
+    size_t& cacheBytes) const
+{
+    exampleBytes = (primRef.capacity() + secondary.capacity()) * sizeof(PoseVariable)
+        + primary.capacity() * sizeof(std::vector<PoseVariable>);
+    for (const std::vector<PoseVariable>& poses : primary)
+    {
+        exampleBytes += poses.capacity() * sizeof(PoseVariable);
+    }
+    solveBytes = (invKerMat.size() + coef.size()) * sizeof(double) + landmarks.capacity() * sizeof(int);
+    cacheBytes = (secFeatures.size() + localInvKerMat.size()) * sizeof(double)
+        + (singleCenters.size() + singleCoef.size()) * sizeof(float)
+        + vpTree.capacity() * sizeof(VpNode) + localIds.capacity() * sizeof(int)
+        + exampleHash.bucket_count() * sizeof(void*);
+    for (const auto& bucket : exampleHash)
+    {
+        cacheBytes += sizeof(bucket) + bucket.second.capacity() * sizeof(int);
+    }
+}
+
+// estimated floating-point operations of one evaluation of all the centers in
+// double precision, counting a square root or a transcendental function as one
+double
+SrtRbfModel::evaluationFlops() const
+{
+    // squared distance of a pair of poses: scale and translation terms,
+    // then the rotation term of the distance type; the Frobenius norm builds
+    // both matrices
+    const double rotateFlops[] = { 12.0, 40.0, 16.0 };
+    const double pairFlops = distType == 3 ? 140.0 : 20.0 + rotateFlops[std::min(std::max(distType, 0), 2)];
+    const double kernelFlops = 6.0;
+    const double n = numCenters();
+    const double border = affinity ? 1.0 : 0.0;
+    double flops = n * numInputs * pairFlops + n * kernelFlops;
+    if (solver == 0)
+    {
+        // weights from the inverse kernel matrix, then the blend of the examples
+        flops += 2.0 * (n + border) * (n + border) + 2.0 * n * 10.0;
+    }
+    else
+    {
+        flops += 2.0 * (n + border) * 10.0;
+    }
+    // output matrix from the blended features
+    return flops + 100.0;
+}
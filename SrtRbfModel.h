@@ -0,0 +1,395 @@
+#ifndef SRTRBF_MODEL_H
+#define SRTRBF_MODEL_H
+#pragma once
+
+#include <maya/MMatrix.h>
+#include <maya/MTransformationMatrix.h>
+#include <Eigen/Dense>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "PoseVariable.h"
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXd;
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXf;
+
+class SrtRbfModel;
+class ThreadPool;
+
+//
+// buffers of the per-frame evaluation, reserved when the model changes
+// so that evaluating a trained model does not allocate
+struct SrtRbfWorkspace
+{
+    Eigen::VectorXd kernelVec;                   // kernel values (+1 under affinity)
+    Eigen::VectorXd feature;                     // blended secondary features
+    Eigen::VectorXd weight;                      // error measurement: weights of all the examples
+    Eigen::VectorXd exactFeature;                // error measurement: features of the blend of all examples
+    Eigen::MatrixXd localKernel;                 // k-nearest search: kernel matrix of the neighborhood
+    std::vector<std::pair<double, int>> found;   // k-nearest search: max-heap of the nearest examples
+    std::vector<std::pair<int, double>> pending; // k-nearest search: subtrees with lower bounds
+    Eigen::VectorXf kernelVecF;                  // single precision: distances, then kernel values
+    Eigen::VectorXf queryF;                      // single precision: embedded input poses
+    Eigen::VectorXf featureF;                    // single precision: blended secondary features
+    void
+    reserve(
+        const SrtRbfModel& model);
+};
+
+//
+// per-frame state of SrtRbfNode kept between evaluations; the squared distance
+// of each input to the centers is measured again only when the input changed
+struct SrtRbfFrame
+{
+    std::vector<PoseVariable> poses;         // relativized inputs
+    std::vector<char>         dirty;         // inputs changed since the last frame
+    RowMatrixXd               partialDistSq; // squared distances of each input to the centers
+    Eigen::VectorXd           distSq;
+    bool                      distValid;
+    Eigen::VectorXd           weight;        // weights of the examples
+    std::vector<int>          weightIds;     // empty unless truncated to the nearest examples
+    SrtRbfFrame()
+        : distValid(false)
+    {
+    }
+    void
+    reserve(
+        const SrtRbfModel& model);
+};
+
+//
+// in-memory copy of the trained data of a SrtRbfNode
+class SrtRbfModel
+{
+//
+// trained data
+public:
+    int  numInputs;
+    int  numExs;
+    int  rbfType;
+    int  distType;
+    int  solver;   // 0: dense inverse, 1: low-rank, 2: iterative
+    bool affinity;
+    double scaleWeight;
+    double rotateWeight;
+    double translateWeight;
+    double width;  // gaussian width
+    bool singlePrecision; // evaluate in float with down-converted coefficients
+    std::vector<PoseVariable> primRef;              // reference primary transformations
+    std::vector<std::vector<PoseVariable>> primary; // relativized primary transformations
+    std::vector<PoseVariable> secondary;            // secondary transformations
+    Eigen::MatrixXd invKerMat;                      // dense solver
+    std::vector<int> landmarks;                     // low-rank solver; all the examples for the iterative solver
+    RowMatrixXd coef;                               // low-rank and iterative solvers
+//
+// constructor
+public:
+    SrtRbfModel()
+        : numInputs(0),
+        numExs(0),
+        rbfType(0),
+        distType(1),
+        solver(0),
+        affinity(true),
+        scaleWeight(1.0),
+        rotateWeight(10.0),
+        translateWeight(1.0),
+        width(10.0),
+        singlePrecision(false),
+        singleBuilt(false),
+        hashedExs(0)
+    {
+    }
+//
+// training
+public:
+    bool
+    fitDense();
+    bool
+    fitLowRank(
+        int numLandmarks,
+        double& residual);
+    bool
+    fitIterative(
+        double tolerance,
+        int maxIterations,
+        const std::function<bool(int, double)>& progress,
+        const std::vector<int>& prevLandmarks,
+        const RowMatrixXd& prevCoef,
+        int& numIterations,
+        double& residual);
+    void
+    update();
+    bool
+    sameTraining(
+        const SrtRbfModel& other) const;
+    std::vector<int>
+    prune(
+        double tolerance) const;
+    double
+    tune(
+        int numPasses,
+        double& initialError);
+private:
+    void
+    distanceTerms(
+        const std::vector<int>& ids,
+        std::vector<Eigen::MatrixXd>& terms) const;
+    double
+    looError(
+        const std::vector<Eigen::MatrixXd>& terms,
+        const RowMatrixXd& secMat,
+        const double* params) const;
+    void
+    selectLandmarks(
+        int numLandmarks);
+    void
+    multiplyKernel(
+        const RowMatrixXd& kerMat,
+        ThreadPool& pool,
+        const RowMatrixXd& x,
+        RowMatrixXd& y) const;
+//
+// evaluation
+public:
+    double
+    distance(
+        const std::vector<PoseVariable>& a,
+        const std::vector<PoseVariable>& b) const;
+    double
+    kernel(
+        double d) const;
+    PoseVariable
+    relativize(
+        int iid,
+        const MTransformationMatrix& tm) const;
+    PoseVariable
+    relativize(
+        int iid,
+        const PoseVariable& pose) const;
+    int
+    numCenters() const;
+    void
+    partialDistance(
+        int iid,
+        const PoseVariable& pose,
+        double* distSq) const;
+    void
+    weightFromDistance(
+        const Eigen::VectorXd& distSq,
+        SrtRbfWorkspace& workspace,
+        Eigen::VectorXd& weight) const;
+    void
+    featuresFromDistance(
+        const Eigen::VectorXd& distSq,
+        Eigen::VectorXd& feature) const;
+    void
+    fullWeight(
+        const std::vector<PoseVariable>& poses,
+        SrtRbfWorkspace& workspace,
+        Eigen::VectorXd& weight) const;
+    bool
+    localWeight(
+        const std::vector<PoseVariable>& poses,
+        int k,
+        SrtRbfWorkspace& workspace,
+        std::vector<int>& ids,
+        Eigen::VectorXd& weight);
+    double
+    nearestError(
+        int k,
+        int numSamples);
+    void
+    features(
+        const Eigen::VectorXd& weight,
+        const std::vector<int>& ids,
+        Eigen::VectorXd& feature) const;
+    void
+    frameFeatures(
+        int k,
+        bool single,
+        SrtRbfFrame& frame,
+        SrtRbfWorkspace& workspace,
+        Eigen::VectorXd& feature);
+    void
+    lowRankFeatures(
+        const std::vector<PoseVariable>& poses,
+        Eigen::VectorXd& feature) const;
+    PoseVariable
+    outputPose(
+        const Eigen::VectorXd& feature) const;
+    MMatrix
+    compose(
+        const Eigen::VectorXd& feature) const;
+    MMatrix
+    blend(
+        const Eigen::VectorXd& weight,
+        const std::vector<int>& ids) const;
+    void
+    evaluate(
+        const std::vector<PoseVariable>& poses,
+        Eigen::VectorXd& feature) const;
+    void
+    evaluate(
+        const std::vector<PoseVariable>& poses,
+        SrtRbfWorkspace& workspace,
+        Eigen::VectorXd& feature) const;
+    void
+    exampleFeatures(
+        int eid,
+        Eigen::VectorXd& feature) const;
+    void
+    evaluateBatch(
+        const std::vector<PoseVariable>& poses,
+        RowMatrixXd& features) const;
+    void
+    evaluateBatch(
+        const std::vector<PoseVariable>& poses,
+        const RowMatrixXd& coefficients,
+        RowMatrixXd& features) const;
+    void
+    dualCoefficients(
+        std::vector<int>& centers,
+        RowMatrixXd& coefficients) const;
+private:
+    // secondary transformations blended by the weights
+    RowMatrixXd secFeatures;
+//
+// single-precision evaluation
+//
+// The centers are embedded in float so that their distances to the inputs
+// are accumulated over contiguous rows, and the dual coefficients are
+// down-converted from the double solve.
+public:
+    int
+    singleDims() const;
+    void
+    buildSingle();
+    bool
+    hasSingle() const;
+    void
+    singleFeatures(
+        const std::vector<PoseVariable>& poses,
+        SrtRbfWorkspace& workspace,
+        Eigen::VectorXd& feature) const;
+    void
+    validateSingle(
+        int numSamples,
+        double& maxTranslate,
+        double& maxRotate,
+        double& maxScale) const;
+private:
+    void
+    exampleSpread(
+        std::vector<double>& scaleSpread,
+        std::vector<double>& translateSpread) const;
+    void
+    embedSingle(
+        const PoseVariable& pose,
+        float* embedded) const;
+    RowMatrixXf singleCenters; // (numInputs x singleDims) x #centers
+    RowMatrixXf singleCoef;    // #coefs x 10
+    bool singleBuilt;
+//
+// reference evaluation for comparing the evaluation paths
+public:
+    bool
+    referenceCoefficients(
+        std::vector<int>& centers,
+        Eigen::MatrixXd& coefficients) const;
+    void
+    referenceFeatures(
+        const std::vector<PoseVariable>& poses,
+        const std::vector<int>& centers,
+        const Eigen::MatrixXd& coefficients,
+        Eigen::VectorXd& feature) const;
+    void
+    testInputs(
+        int numSamples,
+        std::vector<MMatrix>& inputs) const;
+//
+// derivatives of the output by the inputs
+//
+// The parameters of a pose are s(3), the log quaternion of its rotation (3)
+// and t(3); the Jacobian is 9 x (numInputs x 9) in this order, taken from the
+// dense or low-rank solve through the dual coefficients. It is undefined (false,
+// NaN) at the antipode of a center under the quaternion distance.
+public:
+    void
+    outputParameters(
+        const std::vector<PoseVariable>& poses,
+        Eigen::VectorXd& params) const;
+    bool
+    jacobian(
+        const std::vector<PoseVariable>& poses,
+        Eigen::MatrixXd& jac) const;
+    double
+    jacobianError(
+        const std::vector<PoseVariable>& poses,
+        double step) const;
+//
+// the dual coefficients in the layout of runtime/SrtRbfFormat.h, as exported
+public:
+    bool
+    runtimeImage(
+        std::vector<double>& buffer) const;
+//
+// memory and cost accounting (SrtRbfStats)
+public:
+    void
+    memoryUsage(
+        size_t& exampleBytes,
+        size_t& solveBytes,
+        size_t& cacheBytes) const;
+    double
+    evaluationFlops() const;
+//
+// k-nearest example search (vantage-point tree)
+public:
+    void
+    buildIndex();
+    void
+    nearest(
+        const std::vector<PoseVariable>& poses,
+        int k,
+        SrtRbfWorkspace& workspace,
+        std::vector<int>& ids) const;
+private:
+    struct VpNode
+    {
+        int    eid;
+        double radius;
+        int    inside;
+        int    outside;
+    };
+    std::vector<VpNode> vpTree;
+    int
+    buildIndex(
+        std::vector<int>& eids,
+        int begin,
+        int end);
+//
+// quantized spatial hash of the examples for duplicate checks
+public:
+    void
+    buildHash();
+    int
+    findDuplicate(
+        const std::vector<PoseVariable>& poses,
+        double tolerance) const;
+private:
+    void
+    hashCoordinates(
+        const std::vector<PoseVariable>& poses,
+        std::vector<double>& coords) const;
+    std::unordered_map<size_t, std::vector<int>> exampleHash;
+    int hashedExs;
+//
+// cached local system of the last k-nearest evaluation
+private:
+    std::vector<int> localIds;
+    Eigen::MatrixXd  localInvKerMat;
+    Eigen::FullPivLU<Eigen::MatrixXd> localLU;
+};
+
+#endif //SRTRBF_MODEL_H
@@ -0,0 +1,29 @@
+#include "SrtRbfModelData.h"
+
+const MString SrtRbfModelData::typeName = "SrtRbfModelData";
+const MTypeId SrtRbfModelData::SrtRbfModelDataID = 0x00012; // TO BE CHANGED
+
+void*
+SrtRbfModelData::creator()
+{
+    return new SrtRbfModelData();
+}
+
+void
+SrtRbfModelData::copy(
+    const MPxData& src)
+{
+    model = static_cast<const SrtRbfModelData&>(src).model;
+}
+
+MTypeId
+SrtRbfModelData::typeId() const
+{
+    return SrtRbfModelDataID;
+}
+
+MString
+SrtRbfModelData::name() const
+{
+    return typeName;
+}
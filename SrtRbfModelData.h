@@ -0,0 +1,40 @@
+#ifndef SRTRBF_MODEL_DATA_H
+#define SRTRBF_MODEL_DATA_H
+#pragma once
+
+#include <maya/MPxData.h>
+#include <maya/MString.h>
+#include <maya/MTypeId.h>
+#include <memory>
+#include "SrtRbfModel.h"
+
+//
+// trained data of a SrtRbfNode passed to SrtRbfBatchNode through a connection
+//
+// The data hold an immutable snapshot of the model, made once per revision of
+// the trained data and shared by the copies of the data, so that the batch
+// node never reads the live model of another node.
+class SrtRbfModelData : public MPxData
+{
+public:
+    std::shared_ptr<const SrtRbfModel> model;
+//
+// overrides; the data are not stored with the scene
+public:
+    void
+    copy(
+        const MPxData& src) override;
+    MTypeId
+    typeId() const override;
+    MString
+    name() const override;
+//
+// data generation
+public:
+    static const MString typeName;
+    static const MTypeId SrtRbfModelDataID;
+    static void*
+    creator();
+};
+
+#endif //SRTRBF_MODEL_DATA_H
@@ -1,16 +1,24 @@
 #include "SrtRbfNode.h"
 #include "PoseVariable.h"
+#include "SrtRbfModelData.h"
+#include "ParallelFor.h"
 #include <vector>
 #include <Eigen/Dense>
 #include <Eigen/LU>
 #include <maya/MFnCompoundAttribute.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnMessageAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnDoubleArrayData.h>
+#include <maya/MFnIntArrayData.h>
+#include <maya/MFnPluginData.h>
+#include <maya/MItDependencyNodes.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnTransform.h>
 #include <maya/MMatrix.h>
 #include <maya/MFnMatrixAttribute.h>
 #include <maya/MFnMatrixData.h>
+#include <maya/MArrayDataHandle.h>
 #include <maya/MTransformationMatrix.h>
 #include <maya/MVector.h>
 #include <maya/MQuaternion.h>
@@ -20,6 +28,28 @@
 #include <maya/MItSelectionList.h>
 #include <maya/MDagModifier.h>
 #include <maya/MArgList.h>
+#include <maya/MIntArray.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGContextGuard.h>
+#include <maya/MAnimControl.h>
+#include <maya/MFnAnimCurve.h>
+#include <maya/MRenderUtil.h>
+#include <maya/MComputation.h>
+#include <maya/MTime.h>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <string>
+#include <cstdio>
+#include <limits>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include "runtime/SrtRbfFormat.h"
+#include "runtime/SrtRbfRuntime.h"
 
 const MString SrtRbfNode::className = "SrtRbfNode";
 const MTypeId SrtRbfNode::SrtRbfNodeID = 0x00010; // TO BE CHANGED
@@ -35,12 +65,80 @@ const MString SrtRbfNode::invKerMatAttrName[3] = { "invker",    "invker",   "Inv
 const MString SrtRbfNode::affinityAttrName[3]  = { "affinity",  "affinity", "Affinity Constraint" };
 const MString SrtRbfNode::rbfAttrName[3]       = { "rbf",       "rbf",      "RBF Type" };
 const MString SrtRbfNode::distAttrName[3]      = { "dist",      "dist",     "Distance Type" };
-MObject SrtRbfNode::outputAttr   = MObject::kNullObj;
-MObject SrtRbfNode::versionAttr  = MObject::kNullObj;
-MObject SrtRbfNode::numExsAttr   = MObject::kNullObj;
-MObject SrtRbfNode::affinityAttr = MObject::kNullObj;
-MObject SrtRbfNode::rbfAttr      = MObject::kNullObj;
-MObject SrtRbfNode::targetAttr   = MObject::kNullObj;
+const MString SrtRbfNode::nearestAttrName[3]   = { "nearest",   "nk",       "Nearest Examples" };
+const MString SrtRbfNode::measureErrorAttrName[3] = { "measureError", "merr", "Measure Error" };
+const MString SrtRbfNode::nearestToleranceAttrName[3] = { "nearestTolerance", "ntol", "Nearest Tolerance" };
+const MString SrtRbfNode::approxErrorAttrName[3]  = { "approxError",  "aerr", "Approximation Error" };
+const MString SrtRbfNode::solverAttrName[3]       = { "solver",       "slv",  "Solver Type" };
+const MString SrtRbfNode::numLandmarksAttrName[3] = { "landmarks",    "lmks", "Landmarks" };
+const MString SrtRbfNode::solverToleranceAttrName[3]  = { "solverTolerance",  "stol", "Solver Tolerance" };
+const MString SrtRbfNode::solverIterationsAttrName[3] = { "solverIterations", "sit",  "Solver Iterations" };
+const MString SrtRbfNode::landmarkAttrName[3]     = { "landmarkId",   "lmkid", "Landmark Example" };
+const MString SrtRbfNode::coefAttrName[3]         = { "coefficient",  "coef", "Coefficients" };
+const MString SrtRbfNode::residualAttrName[3]     = { "residual",     "res",  "Training Residual" };
+const MString SrtRbfNode::scaleWeightAttrName[3]     = { "scaleWeight",     "sw", "Scale Weight" };
+const MString SrtRbfNode::rotateWeightAttrName[3]    = { "rotateWeight",    "rw", "Rotate Weight" };
+const MString SrtRbfNode::translateWeightAttrName[3] = { "translateWeight", "tw", "Translate Weight" };
+const MString SrtRbfNode::widthAttrName[3]           = { "width",           "wd", "Gaussian Width" };
+const MString SrtRbfNode::cacheToleranceAttrName[3]  = { "cacheTolerance",  "ctol", "Cache Tolerance" };
+const MString SrtRbfNode::cacheHitsAttrName[3]       = { "cacheHits",       "chit", "Cache Hits" };
+const MString SrtRbfNode::cacheMissesAttrName[3]     = { "cacheMisses",     "cmis", "Cache Misses" };
+const MString SrtRbfNode::singlePrecisionAttrName[3] = { "singlePrecision", "sp",   "Single Precision" };
+const MString SrtRbfNode::trainedModelAttrName[3]    = { "trainedModel",    "tmdl", "Trained Model" };
+const MString SrtRbfNode::qualityAttrName[3]            = { "quality",            "qlt",  "Quality" };
+const MString SrtRbfNode::interactiveQualityAttrName[3] = { "interactiveQuality", "iqlt", "Interactive Quality" };
+const MString SrtRbfNode::renderQualityAttrName[3]      = { "renderQuality",      "rqlt", "Render Quality" };
+const MString SrtRbfNode::cachedQualityAttrName[3]      = { "cachedQuality",      "cqlt", "Cached Quality" };
+const MString SrtRbfNode::speculativeFramesAttrName[3]  = { "speculativeFrames",  "spf",  "Speculative Frames" };
+const MString SrtRbfNode::primRefDataAttrName[3]     = { "primrefData",     "prd",   "Primary Reference Data" };
+const MString SrtRbfNode::primaryDataAttrName[3]     = { "primaryData",     "prmd",  "Primary Relative Data" };
+const MString SrtRbfNode::secondaryDataAttrName[3]   = { "secondaryData",   "secd",  "Secondary Data" };
+const MString SrtRbfNode::invKerDataAttrName[3]      = { "invkerData",      "ikd",   "Inverse Kernel Data" };
+const MString SrtRbfNode::landmarkDataAttrName[3]    = { "landmarkData",    "lmkd",  "Landmark Example Data" };
+const MString SrtRbfNode::coefDataAttrName[3]        = { "coefficientData", "coefd", "Coefficient Data" };
+MObject SrtRbfNode::inputAttr     = MObject::kNullObj;
+MObject SrtRbfNode::outputAttr    = MObject::kNullObj;
+MObject SrtRbfNode::versionAttr   = MObject::kNullObj;
+MObject SrtRbfNode::numExsAttr    = MObject::kNullObj;
+MObject SrtRbfNode::affinityAttr  = MObject::kNullObj;
+MObject SrtRbfNode::rbfAttr       = MObject::kNullObj;
+MObject SrtRbfNode::distAttr      = MObject::kNullObj;
+MObject SrtRbfNode::targetAttr    = MObject::kNullObj;
+MObject SrtRbfNode::primRefAttr   = MObject::kNullObj;
+MObject SrtRbfNode::primaryAttr   = MObject::kNullObj;
+MObject SrtRbfNode::secondaryAttr = MObject::kNullObj;
+MObject SrtRbfNode::invKerMatAttr = MObject::kNullObj;
+MObject SrtRbfNode::nearestAttr   = MObject::kNullObj;
+MObject SrtRbfNode::measureErrorAttr = MObject::kNullObj;
+MObject SrtRbfNode::nearestToleranceAttr = MObject::kNullObj;
+MObject SrtRbfNode::approxErrorAttr  = MObject::kNullObj;
+MObject SrtRbfNode::solverAttr       = MObject::kNullObj;
+MObject SrtRbfNode::numLandmarksAttr = MObject::kNullObj;
+MObject SrtRbfNode::solverToleranceAttr  = MObject::kNullObj;
+MObject SrtRbfNode::solverIterationsAttr = MObject::kNullObj;
+MObject SrtRbfNode::landmarkAttr     = MObject::kNullObj;
+MObject SrtRbfNode::coefAttr         = MObject::kNullObj;
+MObject SrtRbfNode::residualAttr     = MObject::kNullObj;
+MObject SrtRbfNode::scaleWeightAttr     = MObject::kNullObj;
+MObject SrtRbfNode::rotateWeightAttr    = MObject::kNullObj;
+MObject SrtRbfNode::translateWeightAttr = MObject::kNullObj;
+MObject SrtRbfNode::widthAttr           = MObject::kNullObj;
+MObject SrtRbfNode::cacheToleranceAttr  = MObject::kNullObj;
+MObject SrtRbfNode::cacheHitsAttr       = MObject::kNullObj;
+MObject SrtRbfNode::cacheMissesAttr     = MObject::kNullObj;
+MObject SrtRbfNode::singlePrecisionAttr = MObject::kNullObj;
+MObject SrtRbfNode::trainedModelAttr    = MObject::kNullObj;
+MObject SrtRbfNode::qualityAttr            = MObject::kNullObj;
+MObject SrtRbfNode::interactiveQualityAttr = MObject::kNullObj;
+MObject SrtRbfNode::renderQualityAttr      = MObject::kNullObj;
+MObject SrtRbfNode::cachedQualityAttr      = MObject::kNullObj;
+MObject SrtRbfNode::speculativeFramesAttr  = MObject::kNullObj;
+MObject SrtRbfNode::primRefDataAttr     = MObject::kNullObj;
+MObject SrtRbfNode::primaryDataAttr     = MObject::kNullObj;
+MObject SrtRbfNode::secondaryDataAttr   = MObject::kNullObj;
+MObject SrtRbfNode::invKerDataAttr      = MObject::kNullObj;
+MObject SrtRbfNode::landmarkDataAttr    = MObject::kNullObj;
+MObject SrtRbfNode::coefDataAttr        = MObject::kNullObj;
 
 
 /// utility ///
@@ -79,6 +177,142 @@ GetMatrix(
     return bm.matrix();
 }
 
+void
+TruncateArray(
+    MPlug plug,
+    unsigned int length)
+{
+    MIntArray indices;
+    plug.getExistingArrayAttributeIndices(indices);
+    MDGModifier dgModifier;
+    for (unsigned int i = 0; i < indices.length(); ++i)
+    {
+        if (indices[i] >= static_cast<int>(length))
+        {
+            dgModifier.removeMultiInstance(plug.elementByLogicalIndex(indices[i]), true);
+        }
+    }
+    dgModifier.doIt();
+}
+
+std::vector<double>
+GetDoubleArray(
+    MPlug plug)
+{
+    MObject dao;
+    plug.getValue(dao);
+    if (dao.isNull())
+    {
+        return std::vector<double>();
+    }
+    MFnDoubleArrayData da(dao);
+    MDoubleArray array = da.array();
+    std::vector<double> retval(array.length());
+    for (unsigned int i = 0; i < array.length(); ++i)
+    {
+        retval[i] = array[i];
+    }
+    return retval;
+}
+
+MObject
+DoubleArrayData(
+    const double* data,
+    unsigned int length)
+{
+    MFnDoubleArrayData da;
+    return da.create(MDoubleArray(data, length));
+}
+
+void
+SetDoubleArray(
+    MPlug plug,
+    const double* data,
+    unsigned int length)
+{
+    MObject dao = DoubleArrayData(data, length);
+    plug.setValue(dao);
+}
+
+std::vector<int>
+GetIntArray(
+    MPlug plug)
+{
+    MObject iao;
+    plug.getValue(iao);
+    if (iao.isNull())
+    {
+        return std::vector<int>();
+    }
+    MFnIntArrayData ia(iao);
+    MIntArray array = ia.array();
+    std::vector<int> retval(array.length());
+    for (unsigned int i = 0; i < array.length(); ++i)
+    {
+        retval[i] = array[i];
+    }
+    return retval;
+}
+
+MObject
+IntArrayData(
+    const std::vector<int>& data)
+{
+    MIntArray array(static_cast<unsigned int>(data.size()));
+    for (unsigned int i = 0; i < array.length(); ++i)
+    {
+        array[i] = data[i];
+    }
+    MFnIntArrayData ia;
+    return ia.create(array);
+}
+
+void
+SetIntArray(
+    MPlug plug,
+    const std::vector<int>& data)
+{
+    MObject iao = IntArrayData(data);
+    plug.setValue(iao);
+}
+
+// typed array data, or the multi attribute of older versions if it is empty
+std::vector<double>
+ReadDoubleArray(
+    MPlug dataPlug,
+    MPlug legacyPlug,
+    bool legacy)
+{
+    std::vector<double> retval = GetDoubleArray(dataPlug);
+    if (retval.empty() && legacy)
+    {
+        retval.resize(legacyPlug.numElements());
+        for (unsigned int i = 0; i < retval.size(); ++i)
+        {
+            retval[i] = legacyPlug.elementByLogicalIndex(i).asDouble();
+        }
+    }
+    return retval;
+}
+
+std::vector<int>
+ReadIntArray(
+    MPlug dataPlug,
+    MPlug legacyPlug,
+    bool legacy)
+{
+    std::vector<int> retval = GetIntArray(dataPlug);
+    if (retval.empty() && legacy)
+    {
+        retval.resize(legacyPlug.numElements());
+        for (unsigned int i = 0; i < retval.size(); ++i)
+        {
+            retval[i] = legacyPlug.elementByLogicalIndex(i).asInt();
+        }
+    }
+    return retval;
+}
+
 MObject
 FindNode(
     const MString& name)
@@ -109,7 +343,7 @@ SrtRbfNode::initSrtRbfNode()
 
     // input matrices
     MFnMatrixAttribute mAttr;
-    MObject inputAttr = mAttr.create(
+    inputAttr = mAttr.create(
         inputAttrName[0],
         inputAttrName[1],
         MFnMatrixAttribute::kDouble);
@@ -164,7 +398,7 @@ SrtRbfNode::initSrtRbfNode()
     //  1: Euclidean distance in the Lie algebra (default)
     //  2: Shortest angle on 3-sphere
     //  3: Frobenious norm of diff matrix
-    MObject distAttr = nAttr.create(
+    distAttr = nAttr.create(
         distAttrName[0],
         distAttrName[1],
         MFnNumericData::kInt,
@@ -180,8 +414,9 @@ SrtRbfNode::initSrtRbfNode()
     msgAttr.setNiceNameOverride(targetAttrName[2]);
     addAttribute(targetAttr);
 
+    // trained data of older versions (read once and migrated to the typed arrays below)
     // reference primary transformation
-    MObject primRefAttr = nAttr.create(
+    primRefAttr = nAttr.create(
         primRefAttrName[0],
         primRefAttrName[1],
         MFnNumericData::kDouble,
@@ -190,10 +425,12 @@ SrtRbfNode::initSrtRbfNode()
     nAttr.setArray(true);
     nAttr.setKeyable(false);
     nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
     addAttribute(primRefAttr);
 
     // primary transformations
-    MObject primaryAttr = nAttr.create(
+    primaryAttr = nAttr.create(
         primaryAttrName[0],
         primaryAttrName[1],
         MFnNumericData::kDouble,
@@ -202,10 +439,12 @@ SrtRbfNode::initSrtRbfNode()
     nAttr.setArray(true);
     nAttr.setKeyable(false);
     nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
     addAttribute(primaryAttr);
 
     // secondary transformations
-    MObject secondaryAttr = nAttr.create(
+    secondaryAttr = nAttr.create(
         secondaryAttrName[0],
         secondaryAttrName[1],
         MFnNumericData::kDouble,
@@ -214,10 +453,12 @@ SrtRbfNode::initSrtRbfNode()
     nAttr.setArray(true);
     nAttr.setKeyable(false);
     nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
     addAttribute(secondaryAttr);
 
     // inverse kernel matrix
-    MObject invKerMatAttr = nAttr.create(
+    invKerMatAttr = nAttr.create(
         invKerMatAttrName[0],
         invKerMatAttrName[1],
         MFnNumericData::kDouble,
@@ -226,8 +467,325 @@ SrtRbfNode::initSrtRbfNode()
     nAttr.setArray(true);
     nAttr.setKeyable(false);
     nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
     addAttribute(invKerMatAttr);
 
+    // # of nearest examples to be blended (0: all examples)
+    nearestAttr = nAttr.create(
+        nearestAttrName[0],
+        nearestAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(nearestAttrName[2]);
+    nAttr.setMin(0);
+    addAttribute(nearestAttr);
+
+    // compare the truncated evaluation with the full solve
+    measureErrorAttr = nAttr.create(
+        measureErrorAttrName[0],
+        measureErrorAttrName[1],
+        MFnNumericData::kBoolean,
+        false);
+    nAttr.setNiceNameOverride(measureErrorAttrName[2]);
+    addAttribute(measureErrorAttr);
+
+    // max measured error of the nearest examples; beyond it all examples are blended
+    nearestToleranceAttr = nAttr.create(
+        nearestToleranceAttrName[0],
+        nearestToleranceAttrName[1],
+        MFnNumericData::kDouble,
+        0.01);
+    nAttr.setNiceNameOverride(nearestToleranceAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(nearestToleranceAttr);
+
+    // max abs difference of the output matrix from the full solve
+    approxErrorAttr = nAttr.create(
+        approxErrorAttrName[0],
+        approxErrorAttrName[1],
+        MFnNumericData::kDouble,
+        0.0);
+    nAttr.setNiceNameOverride(approxErrorAttrName[2]);
+    nAttr.setWritable(false);
+    nAttr.setStorable(false);
+    addAttribute(approxErrorAttr);
+
+    // solver type
+    //  0: dense inverse kernel matrix (default)
+    //  1: least squares on landmark examples
+    //  2: matrix-free iterative solve (MINRES) for large numbers of examples
+    solverAttr = nAttr.create(
+        solverAttrName[0],
+        solverAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(solverAttrName[2]);
+    addAttribute(solverAttr);
+
+    // max # of landmark examples of the low-rank solver
+    numLandmarksAttr = nAttr.create(
+        numLandmarksAttrName[0],
+        numLandmarksAttrName[1],
+        MFnNumericData::kInt,
+        100);
+    nAttr.setNiceNameOverride(numLandmarksAttrName[2]);
+    nAttr.setMin(1);
+    addAttribute(numLandmarksAttr);
+
+    // relative residual at which the iterative solver stops
+    solverToleranceAttr = nAttr.create(
+        solverToleranceAttrName[0],
+        solverToleranceAttrName[1],
+        MFnNumericData::kDouble,
+        1.0e-8);
+    nAttr.setNiceNameOverride(solverToleranceAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(solverToleranceAttr);
+
+    // max # of iterations of the iterative solver
+    solverIterationsAttr = nAttr.create(
+        solverIterationsAttrName[0],
+        solverIterationsAttrName[1],
+        MFnNumericData::kInt,
+        1000);
+    nAttr.setNiceNameOverride(solverIterationsAttrName[2]);
+    nAttr.setMin(1);
+    addAttribute(solverIterationsAttr);
+
+    // landmark examples
+    landmarkAttr = nAttr.create(
+        landmarkAttrName[0],
+        landmarkAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(landmarkAttrName[2]);
+    nAttr.setArray(true);
+    nAttr.setKeyable(false);
+    nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
+    addAttribute(landmarkAttr);
+
+    // coefficients of the low-rank solver
+    coefAttr = nAttr.create(
+        coefAttrName[0],
+        coefAttrName[1],
+        MFnNumericData::kDouble,
+        0.0);
+    nAttr.setNiceNameOverride(coefAttrName[2]);
+    nAttr.setArray(true);
+    nAttr.setKeyable(false);
+    nAttr.setConnectable(false);
+    nAttr.setStorable(false);
+    nAttr.setHidden(true);
+    addAttribute(coefAttr);
+
+    // training residual of the low-rank and iterative solvers
+    residualAttr = nAttr.create(
+        residualAttrName[0],
+        residualAttrName[1],
+        MFnNumericData::kDouble,
+        0.0);
+    nAttr.setNiceNameOverride(residualAttrName[2]);
+    nAttr.setKeyable(false);
+    nAttr.setConnectable(false);
+    addAttribute(residualAttr);
+
+    // weights of scale, rotation and translation in the dissimilarity measure
+    scaleWeightAttr = nAttr.create(
+        scaleWeightAttrName[0],
+        scaleWeightAttrName[1],
+        MFnNumericData::kDouble,
+        1.0);
+    nAttr.setNiceNameOverride(scaleWeightAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(scaleWeightAttr);
+    rotateWeightAttr = nAttr.create(
+        rotateWeightAttrName[0],
+        rotateWeightAttrName[1],
+        MFnNumericData::kDouble,
+        10.0);
+    nAttr.setNiceNameOverride(rotateWeightAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(rotateWeightAttr);
+    translateWeightAttr = nAttr.create(
+        translateWeightAttrName[0],
+        translateWeightAttrName[1],
+        MFnNumericData::kDouble,
+        1.0);
+    nAttr.setNiceNameOverride(translateWeightAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(translateWeightAttr);
+
+    // width of the gaussian kernel
+    widthAttr = nAttr.create(
+        widthAttrName[0],
+        widthAttrName[1],
+        MFnNumericData::kDouble,
+        10.0);
+    nAttr.setNiceNameOverride(widthAttrName[2]);
+    nAttr.setMin(1.0e-6);
+    addAttribute(widthAttr);
+
+    // max abs difference of the input matrices to reuse the last output
+    cacheToleranceAttr = nAttr.create(
+        cacheToleranceAttrName[0],
+        cacheToleranceAttrName[1],
+        MFnNumericData::kDouble,
+        0.0);
+    nAttr.setNiceNameOverride(cacheToleranceAttrName[2]);
+    nAttr.setMin(0.0);
+    addAttribute(cacheToleranceAttr);
+
+    // # of evaluations that reused / did not reuse the last output
+    cacheHitsAttr = nAttr.create(
+        cacheHitsAttrName[0],
+        cacheHitsAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(cacheHitsAttrName[2]);
+    nAttr.setWritable(false);
+    nAttr.setStorable(false);
+    addAttribute(cacheHitsAttr);
+    cacheMissesAttr = nAttr.create(
+        cacheMissesAttrName[0],
+        cacheMissesAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(cacheMissesAttrName[2]);
+    nAttr.setWritable(false);
+    nAttr.setStorable(false);
+    addAttribute(cacheMissesAttr);
+
+    // evaluate in float with the coefficients down-converted from the double solve
+    singlePrecisionAttr = nAttr.create(
+        singlePrecisionAttrName[0],
+        singlePrecisionAttrName[1],
+        MFnNumericData::kBoolean,
+        false);
+    nAttr.setNiceNameOverride(singlePrecisionAttrName[2]);
+    addAttribute(singlePrecisionAttr);
+
+    // evaluation quality
+    //  0: nearest and singlePrecision as they are set (default)
+    //  1: full solve
+    //  2: nearest examples (8 unless nearest is set)
+    //  3: single precision
+    //  4: frozen last output
+    //  5: auto; the quality below by the state of Maya
+    qualityAttr = nAttr.create(
+        qualityAttrName[0],
+        qualityAttrName[1],
+        MFnNumericData::kInt,
+        kQualityCustom);
+    nAttr.setNiceNameOverride(qualityAttrName[2]);
+    nAttr.setMin(kQualityCustom);
+    nAttr.setMax(kQualityAuto);
+    addAttribute(qualityAttr);
+    // in the interactive session, including playback and manipulation
+    interactiveQualityAttr = nAttr.create(
+        interactiveQualityAttrName[0],
+        interactiveQualityAttrName[1],
+        MFnNumericData::kInt,
+        kQualityFull);
+    nAttr.setNiceNameOverride(interactiveQualityAttrName[2]);
+    nAttr.setMin(kQualityCustom);
+    nAttr.setMax(kQualityFrozen);
+    addAttribute(interactiveQualityAttr);
+    // in batch mode or while rendering
+    renderQualityAttr = nAttr.create(
+        renderQualityAttrName[0],
+        renderQualityAttrName[1],
+        MFnNumericData::kInt,
+        kQualityFull);
+    nAttr.setNiceNameOverride(renderQualityAttrName[2]);
+    nAttr.setMin(kQualityCustom);
+    nAttr.setMax(kQualityFrozen);
+    addAttribute(renderQualityAttr);
+    // in evaluations at other times, such as filling the cached playback
+    cachedQualityAttr = nAttr.create(
+        cachedQualityAttrName[0],
+        cachedQualityAttrName[1],
+        MFnNumericData::kInt,
+        kQualityFull);
+    nAttr.setNiceNameOverride(cachedQualityAttrName[2]);
+    nAttr.setMin(kQualityCustom);
+    nAttr.setMax(kQualityFrozen);
+    addAttribute(cachedQualityAttr);
+
+    // # of next frames evaluated in the background during playback (0: off)
+    speculativeFramesAttr = nAttr.create(
+        speculativeFramesAttrName[0],
+        speculativeFramesAttrName[1],
+        MFnNumericData::kInt,
+        0);
+    nAttr.setNiceNameOverride(speculativeFramesAttrName[2]);
+    nAttr.setMin(0);
+    nAttr.setMax(16);
+    addAttribute(speculativeFramesAttr);
+
+    // trained data stored as single typed arrays
+    MFnTypedAttribute tAttr;
+    primRefDataAttr = tAttr.create(
+        primRefDataAttrName[0],
+        primRefDataAttrName[1],
+        MFnData::kDoubleArray);
+    tAttr.setNiceNameOverride(primRefDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(primRefDataAttr);
+
+    primaryDataAttr = tAttr.create(
+        primaryDataAttrName[0],
+        primaryDataAttrName[1],
+        MFnData::kDoubleArray);
+    tAttr.setNiceNameOverride(primaryDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(primaryDataAttr);
+
+    secondaryDataAttr = tAttr.create(
+        secondaryDataAttrName[0],
+        secondaryDataAttrName[1],
+        MFnData::kDoubleArray);
+    tAttr.setNiceNameOverride(secondaryDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(secondaryDataAttr);
+
+    invKerDataAttr = tAttr.create(
+        invKerDataAttrName[0],
+        invKerDataAttrName[1],
+        MFnData::kDoubleArray);
+    tAttr.setNiceNameOverride(invKerDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(invKerDataAttr);
+
+    landmarkDataAttr = tAttr.create(
+        landmarkDataAttrName[0],
+        landmarkDataAttrName[1],
+        MFnData::kIntArray);
+    tAttr.setNiceNameOverride(landmarkDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(landmarkDataAttr);
+
+    coefDataAttr = tAttr.create(
+        coefDataAttrName[0],
+        coefDataAttrName[1],
+        MFnData::kDoubleArray);
+    tAttr.setNiceNameOverride(coefDataAttrName[2]);
+    tAttr.setConnectable(false);
+    addAttribute(coefDataAttr);
+
+    // snapshot of the trained data, connected to SrtRbfBatchNode
+    trainedModelAttr = tAttr.create(
+        trainedModelAttrName[0],
+        trainedModelAttrName[1],
+        SrtRbfModelData::SrtRbfModelDataID);
+    tAttr.setNiceNameOverride(trainedModelAttrName[2]);
+    tAttr.setWritable(false);
+    tAttr.setStorable(false);
+    tAttr.setHidden(true);
+    addAttribute(trainedModelAttr);
+
     return MS::kSuccess;
 }
 
@@ -267,78 +825,72 @@ SrtRbfNode::addExampleSupport(
     const std::vector<PoseVariable>& primPoses,
     const PoseVariable& opose)
 {
+    if (modelDirty)
+    {
+        loadModel();
+    }
     MFnDependencyNode fnThisNode(thisMObject());
-    MPlug iplug      = fnThisNode.findPlug(inputAttrName[0], true);
-    MPlug rbfPlug    = fnThisNode.findPlug(rbfAttrName[0], true);
-    MPlug distPlug   = fnThisNode.findPlug(distAttrName[0], true);
-    MPlug secPlug    = fnThisNode.findPlug(secondaryAttrName[0], true);
-    MPlug priPlug    = fnThisNode.findPlug(primaryAttrName[0], true);
-    MPlug numExsPlug = fnThisNode.findPlug(numExsAttr, true);
-    const int numInputs = iplug.numElements();
-    const int rbfType   = rbfPlug.asInt();
-    const int distType  = distPlug.asInt();
-    const int numExs    = numExsPlug.asInt();
+    const int numExs = model.numExs;
 
     // check duplication
-    for (int eid = 0; eid < numExs; ++eid)
+    if (model.findDuplicate(primPoses, 1.0e-3) >= 0)
     {
-        auto rst = PoseVariable::getPosesFrom(priPlug, eid, numInputs);
-        if (PoseVariable::dissimilarity(rst, primPoses, distType) < 1.0e-3)
-        {
-            MGlobal::displayInfo("Duplicated example");
-            return MS::kInvalidParameter;
-        }
+        MGlobal::displayInfo("Duplicated example");
+        return MS::kInvalidParameter;
     }
 
-    // kernel matrix        
-    MPlug affPlug = fnThisNode.findPlug(affinityAttrName[0], true);
-    const bool affinityConstraint = affPlug.asBool();
-    Eigen::MatrixXd kerMat;
-    if (affinityConstraint)
+    // refit
+    model.primary.push_back(primPoses);
+    model.secondary.push_back(opose);
+    model.numExs = numExs + 1;
+    double residual = 0.0;
+    const bool solved = fitModel(residual, true);
+    if (!solved)
     {
-        kerMat.resize(numExs + 2, numExs + 2);
-        kerMat.setOnes();
-        kerMat(kerMat.rows() - 1, kerMat.cols() - 1) = 0.0;
-    }
-    else
-    {
-        kerMat.resize(numExs + 1, numExs + 1);
-        kerMat.setOnes();
+        modelDirty = true;
+        MGlobal::displayError("Cannot add this example");
+        return MStatus::kFailure;
     }
-    for (int r = 0; r < numExs; ++r)
+    if (model.solver != 0)
     {
-        std::vector<PoseVariable> rpose = PoseVariable::getPosesFrom(priPlug, r, numInputs);
-        for (int c = r; c < numExs; ++c)
-        {
-            std::vector<PoseVariable> cpose = PoseVariable::getPosesFrom(priPlug, c, numInputs);
-            kerMat(r, c) = PoseVariable::kernel(rpose, cpose, rbfType, distType);
-            kerMat(c, r) = kerMat(r, c);
-        }
-        kerMat(r, numExs) = PoseVariable::kernel(rpose, primPoses, rbfType, distType);
-        kerMat(numExs, r) = kerMat(r, numExs);
+        MString msg = "Training residual: ";
+        msg += residual;
+        MGlobal::displayInfo(msg);
+        fnThisNode.findPlug(residualAttr, true).setValue(residual);
     }
-    kerMat(numExs, numExs) = PoseVariable::kernel(primPoses, primPoses, rbfType, distType);
+    storeModel();
+    storeExamples();
+    model.update();
+    modelDirty = false;
+    return MStatus::kSuccess;
+}
 
-    // inverse kernel matrix
-    Eigen::FullPivLU<Eigen::MatrixXd> kerMatLU(kerMat);
-    if (kerMatLU.rank() < kerMat.rows())
+void
+SrtRbfNode::storeExamples()
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug numExsPlug = fnThisNode.findPlug(numExsAttr, true);
+    const int numInputs = model.numInputs;
+    const int numExs    = model.numExs;
+    std::vector<double> refData(numInputs * 10);
+    std::vector<double> priData(numExs * numInputs * 10);
+    std::vector<double> secData(numExs * 10);
+    for (int iid = 0; iid < numInputs; ++iid)
     {
-        MGlobal::displayError("Cannot add this example");
-        return MStatus::kFailure;
+        PoseVariable::setPoseTo(refData.data(), iid, model.primRef[iid]);
     }
-    Eigen::MatrixXd invKerMat = kerMatLU.inverse();
-    MPlug icmPlug = fnThisNode.findPlug(invKerMatAttrName[0], true);
-    for (int r = 0; r < invKerMat.rows(); ++r)
+    for (int eid = 0; eid < numExs; ++eid)
     {
-        for (int c = 0; c < invKerMat.cols(); ++c)
+        for (int iid = 0; iid < numInputs; ++iid)
         {
-            icmPlug.elementByLogicalIndex(r * invKerMat.cols() + c).setValue(invKerMat(r, c));
+            PoseVariable::setPoseTo(priData.data(), eid * numInputs + iid, model.primary[eid][iid]);
         }
+        PoseVariable::setPoseTo(secData.data(), eid, model.secondary[eid]);
     }
-    PoseVariable::setPosesTo(priPlug, numExs, numInputs, primPoses);
-    PoseVariable::setPoseTo(secPlug, numExs, opose);
-    numExsPlug.setValue(numExs + 1);
-    return MStatus::kSuccess;
+    SetDoubleArray(fnThisNode.findPlug(primRefDataAttr, true), refData.data(), static_cast<unsigned int>(refData.size()));
+    SetDoubleArray(fnThisNode.findPlug(primaryDataAttr, true), priData.data(), static_cast<unsigned int>(priData.size()));
+    SetDoubleArray(fnThisNode.findPlug(secondaryDataAttr, true), secData.data(), static_cast<unsigned int>(secData.size()));
+    numExsPlug.setValue(numExs);
 }
 
 MStatus
@@ -347,20 +899,53 @@ SrtRbfNode::setDependentsDirty(
     MPlugArray& affectedPlugs)
 {
     MFnDependencyNode fnThisNode(thisMObject());
-    MString partialName = plugBeingDirtied.partialName();
-    if (inputAttrName[1] == partialName
-        || inputAttrName[1] != partialName.substring(0, inputAttrName[1].length() - 1))
+    MObject attr = plugBeingDirtied.attribute();
+    if (attr == inputAttr)
+    {
+        if (!plugBeingDirtied.isElement())
+        {
+            return MS::kUnknownParameter;
+        }
+    }
+    else if (attr == cacheToleranceAttr)
+    {
+        return MS::kUnknownParameter;
+    }
+    else if (attr == numExsAttr || attr == primRefAttr || attr == primaryAttr
+        || attr == secondaryAttr || attr == invKerMatAttr
+        || attr == primRefDataAttr || attr == primaryDataAttr || attr == secondaryDataAttr
+        || attr == invKerDataAttr || attr == landmarkDataAttr || attr == coefDataAttr
+        || attr == affinityAttr || attr == rbfAttr || attr == distAttr
+        || attr == solverAttr || attr == landmarkAttr || attr == coefAttr
+        || attr == scaleWeightAttr || attr == rotateWeightAttr
+        || attr == translateWeightAttr || attr == widthAttr
+        || attr == singlePrecisionAttr)
+    {
+        modelDirty = true;
+        ++modelRevision;
+        affectedPlugs.append(fnThisNode.findPlug(trainedModelAttr, true));
+    }
+    else if (attr != nearestAttr && attr != measureErrorAttr && attr != nearestToleranceAttr
+        && attr != qualityAttr && attr != interactiveQualityAttr
+        && attr != renderQualityAttr && attr != cachedQualityAttr)
     {
         return MS::kUnknownParameter;
     }
-    affectedPlugs.append(fnThisNode.findPlug(outputAttrName[0], true));
+    if (attr != inputAttr)
+    {
+        lastValid = false;
+        poseInputs.clear();
+        frameState.distValid = false;
+    }
+    affectedPlugs.append(fnThisNode.findPlug(outputAttr, true));
+    affectedPlugs.append(fnThisNode.findPlug(approxErrorAttr, true));
+    affectedPlugs.append(fnThisNode.findPlug(cacheHitsAttr, true));
+    affectedPlugs.append(fnThisNode.findPlug(cacheMissesAttr, true));
     return MS::kSuccess;
 }
 
 void
-SrtRbfNode::updateWeight(
-    const MPlug& plug,
-    MDataBlock& dataBlock)
+SrtRbfNode::loadModel()
 {
     MFnDependencyNode fnThisNode(thisMObject());
     MPlug nePlug   = fnThisNode.findPlug(numExsAttrName[0], true);
@@ -368,336 +953,2905 @@ SrtRbfNode::updateWeight(
     MPlug rbfPlug  = fnThisNode.findPlug(rbfAttrName[0], true);
     MPlug distPlug = fnThisNode.findPlug(distAttrName[0], true);
     MPlug iplug    = fnThisNode.findPlug(inputAttrName[0], true);
-    MPlug refPlug  = fnThisNode.findPlug(primRefAttrName[0], true);
     const int numExs    = nePlug.asInt();
-    const int rbfType   = rbfPlug.asInt();
-    const int distType  = distPlug.asBool();
     const int numInputs = iplug.numElements();
-    const bool affinityConstraint = affPlug.asBool();
-    std::vector<PoseVariable> primPoses(numInputs);
+    model.numInputs = numInputs;
+    model.numExs    = numExs;
+    model.rbfType   = rbfPlug.asInt();
+    model.distType  = distPlug.asInt();
+    model.solver    = fnThisNode.findPlug(solverAttr, true).asInt();
+    model.affinity  = affPlug.asBool();
+    model.scaleWeight     = fnThisNode.findPlug(scaleWeightAttr, true).asDouble();
+    model.rotateWeight    = fnThisNode.findPlug(rotateWeightAttr, true).asDouble();
+    model.translateWeight = fnThisNode.findPlug(translateWeightAttr, true).asDouble();
+    model.width           = fnThisNode.findPlug(widthAttr, true).asDouble();
+    model.singlePrecision = fnThisNode.findPlug(singlePrecisionAttr, true).asBool();
+
+    // the multi attributes of older versions are read until the node stores its
+    // examples in the typed arrays, which referenced nodes do only when edited;
+    // missing values read as zeros like their unset elements
+    MPlug refDataPlug = fnThisNode.findPlug(primRefDataAttr, true);
+    const bool legacy = GetDoubleArray(refDataPlug).empty();
+    std::vector<double> refData = ReadDoubleArray(
+        refDataPlug, fnThisNode.findPlug(primRefAttr, true), legacy);
+    std::vector<double> priData = ReadDoubleArray(
+        fnThisNode.findPlug(primaryDataAttr, true), fnThisNode.findPlug(primaryAttr, true), legacy);
+    std::vector<double> secData = ReadDoubleArray(
+        fnThisNode.findPlug(secondaryDataAttr, true), fnThisNode.findPlug(secondaryAttr, true), legacy);
+    refData.resize(numInputs * 10, 0.0);
+    priData.resize(numExs * numInputs * 10, 0.0);
+    secData.resize(numExs * 10, 0.0);
+    model.primRef.resize(numInputs);
     for (int iid = 0; iid < numInputs; ++iid)
     {
-        MDataHandle iHandle = dataBlock.inputValue(iplug.elementByLogicalIndex(iid));
-        MTransformationMatrix tm(iHandle.asMatrix());
-        MQuaternion bq = PoseVariable::getRotateFrom(refPlug, iid);
-        primPoses[iid] = PoseVariable::fromMatrix(tm).ontoHemisphere(bq);
-        primPoses[iid].rotate = bq.conjugate() * primPoses[iid].rotate;
+        model.primRef[iid] = PoseVariable::getPoseFrom(refData.data(), iid);
     }
-    // inverse kernel matrix
-    Eigen::MatrixXd invKerMat;
-    if (affinityConstraint)
+    model.primary.resize(numExs);
+    model.secondary.resize(numExs);
+    for (int eid = 0; eid < numExs; ++eid)
     {
-        invKerMat.resize(numExs + 1, numExs + 1);
+        model.primary[eid].resize(numInputs);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            model.primary[eid][iid] = PoseVariable::getPoseFrom(priData.data(), eid * numInputs + iid);
+        }
+        model.secondary[eid] = PoseVariable::getPoseFrom(secData.data(), eid);
     }
-    else
+
+    // solved system; refit in memory when it does not match the examples
+    const int size = model.affinity ? numExs + 1 : numExs;
+    if (model.solver != 0)
     {
-        invKerMat.resize(numExs, numExs);
+        std::vector<int> lmkData = ReadIntArray(
+            fnThisNode.findPlug(landmarkDataAttr, true), fnThisNode.findPlug(landmarkAttr, true), legacy);
+        // the iterative solver has a coefficient for every example
+        if (model.solver == 2)
+        {
+            lmkData.resize(numExs);
+            for (int eid = 0; eid < numExs; ++eid)
+            {
+                lmkData[eid] = eid;
+            }
+        }
+        const std::vector<double> coefData = ReadDoubleArray(
+            fnThisNode.findPlug(coefDataAttr, true), fnThisNode.findPlug(coefAttr, true), legacy);
+        const int numLandmarks = static_cast<int>(lmkData.size());
+        const int numCoefs = model.affinity ? numLandmarks + 1 : numLandmarks;
+        bool solved = numLandmarks > 0 && static_cast<int>(coefData.size()) == numCoefs * 10;
+        for (int j = 0; j < numLandmarks; ++j)
+        {
+            solved = solved && lmkData[j] >= 0 && lmkData[j] < numExs;
+        }
+        if (solved)
+        {
+            model.landmarks = lmkData;
+            model.coef = Eigen::Map<const RowMatrixXd>(coefData.data(), numCoefs, 10);
+        }
+        else
+        {
+            double residual = 0.0;
+            if (!fitModel(residual, false))
+            {
+                model.landmarks.clear();
+                model.coef.setZero(model.affinity ? 1 : 0, 10);
+            }
+        }
     }
-    MPlug icmPlug = fnThisNode.findPlug(invKerMatAttrName[0], true);
-    for (int r = 0; r < invKerMat.rows(); ++r)
+    else
     {
-        for (int c = 0; c < invKerMat.cols(); ++c)
+        const std::vector<double> icmData = ReadDoubleArray(
+            fnThisNode.findPlug(invKerDataAttr, true), fnThisNode.findPlug(invKerMatAttr, true), legacy);
+        if (static_cast<int>(icmData.size()) == size * size)
+        {
+            model.invKerMat = Eigen::Map<const RowMatrixXd>(icmData.data(), size, size);
+        }
+        else if (!model.fitDense())
         {
-            invKerMat(r, c) = icmPlug.elementByLogicalIndex(r * invKerMat.cols() + c).asDouble();
+            model.invKerMat.setZero(size, size);
         }
     }
-    Eigen::VectorXd distVec;
-    if (affinityConstraint)
+    model.update();
+    modelDirty = false;
+    poseInputs.clear();
+
+    // per-frame buffers sized for the new model
+    workspace.reserve(model);
+    frameState.reserve(model);
+}
+
+// fits the model with the solver of the node; the iterative solver shows its
+// progress if requested, and stops when interrupted with the escape key
+bool
+SrtRbfNode::fitModel(
+    double& residual,
+    bool showProgress)
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    if (model.solver == 1)
+    {
+        return model.fitLowRank(fnThisNode.findPlug(numLandmarksAttr, true).asInt(), residual);
+    }
+    if (model.solver != 2)
     {
-        distVec.resize(numExs + 1);
-        distVec[numExs] = 1.0;
+        return model.fitDense();
     }
-    else
+    const double tolerance = fnThisNode.findPlug(solverToleranceAttr, true).asDouble();
+    const int maxIterations = fnThisNode.findPlug(solverIterationsAttr, true).asInt();
+    // the solved system before an edit has moved into its version
+    const std::vector<int>& prevLandmarks = editVersion != nullptr ? editVersion->landmarks : model.landmarks;
+    const RowMatrixXd& prevCoef = editVersion != nullptr ? editVersion->coef : model.coef;
+    int numIterations = 0;
+    if (!showProgress)
     {
-        distVec.resize(numExs);
+        return model.fitIterative(tolerance, maxIterations, nullptr, prevLandmarks, prevCoef, numIterations, residual);
     }
-    MPlug priPlug = fnThisNode.findPlug(primaryAttrName[0], true);
-    for (int eid = 0; eid < numExs; ++eid)
+    MComputation computation;
+    computation.beginComputation(true, true);
+    computation.setProgressRange(0, maxIterations);
+    const bool solved = model.fitIterative(tolerance, maxIterations,
+        [&computation](int iteration, double)
+        {
+            computation.setProgress(iteration);
+            return !computation.isInterruptRequested();
+        },
+        prevLandmarks, prevCoef, numIterations, residual);
+    const bool interrupted = !solved && computation.isInterruptRequested();
+    computation.endComputation();
+    if (interrupted)
+    {
+        MGlobal::displayWarning("Training interrupted");
+    }
+    else if (solved && numIterations >= maxIterations)
     {
-        auto ppose = PoseVariable::getPosesFrom(priPlug, eid, numInputs);
-        distVec[eid] = PoseVariable::kernel(ppose, primPoses, rbfType, distType);
+        MString msg = "The iterative solver did not converge in ";
+        msg += numIterations;
+        msg += " iterations";
+        MGlobal::displayWarning(msg);
     }
-    weight = invKerMat * distVec;
+    return solved;
 }
 
-MStatus
-SrtRbfNode::compute(
-    const MPlug& plug,
-    MDataBlock& dataBlock)
+void
+SrtRbfNode::storeModel()
 {
     MFnDependencyNode fnThisNode(thisMObject());
-    if (plug.attribute() != outputAttr)
+    MPlug icmPlug  = fnThisNode.findPlug(invKerDataAttr, true);
+    MPlug lmkPlug  = fnThisNode.findPlug(landmarkDataAttr, true);
+    MPlug coefPlug = fnThisNode.findPlug(coefDataAttr, true);
+    if (model.solver != 0)
     {
-        return MS::kUnknownParameter;
+        // the centers of the iterative solver are all the examples
+        SetIntArray(lmkPlug, model.solver == 1 ? model.landmarks : std::vector<int>());
+        SetDoubleArray(coefPlug, model.coef.data(), static_cast<unsigned int>(model.coef.size()));
+        SetDoubleArray(icmPlug, nullptr, 0);
+    }
+    else
+    {
+        const RowMatrixXd invKerMat = model.invKerMat;
+        SetDoubleArray(icmPlug, invKerMat.data(), static_cast<unsigned int>(invKerMat.size()));
+        SetIntArray(lmkPlug, std::vector<int>());
+        SetDoubleArray(coefPlug, nullptr, 0);
     }
-    updateWeight(plug, dataBlock);
+}
 
-    MPlug nePlug  = fnThisNode.findPlug(numExsAttrName[0], true);
-    MPlug secPlug = fnThisNode.findPlug(secondaryAttrName[0], true);
-    MPlug affPlug = fnThisNode.findPlug(affinityAttrName[0], true);
-    const int numExs = nePlug.asInt();
-    const bool affinityConstraint = affPlug.asBool();
-    MVector ss(0, 0, 0);
-    MVector st(0, 0, 0);
-    for (int eid = 0; eid < numExs; ++eid)
+const SrtRbfModel&
+SrtRbfNode::trainedModel()
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    return model;
+}
+
+// immutable copy of the trained data for the readers on other threads and
+// nodes, made once per revision
+std::shared_ptr<const SrtRbfModel>
+SrtRbfNode::modelSnapshot()
+{
+    if (modelDirty)
     {
-        ss += weight[eid] * PoseVariable::getScaleFrom(secPlug, eid);
-        st += weight[eid] * PoseVariable::getTranslateFrom(secPlug, eid);
+        loadModel();
     }
-    MQuaternion slr(0, 0, 0, 0);
-    if (affinityConstraint)
+    if (!snapshot || snapshotRevision != modelRevision)
     {
-        for (int eid = 1; eid < numExs; ++eid)
-        {
-            slr = slr + weight[eid] * PoseVariable::getRotateFrom(secPlug, eid);
-        }
-        slr = PoseVariable::getRotateFrom(secPlug, 0) * slr.exp();
+        snapshot = std::make_shared<const SrtRbfModel>(model);
+        snapshotRevision = modelRevision;
     }
-    else
+    return snapshot;
+}
+
+///
+
+// memory held by a version in addition to the examples kept in the node
+size_t
+SrtRbfVersion::bytes() const
+{
+    size_t bytes = (invKerMat.size() + coef.size()) * sizeof(double) + landmarks.size() * sizeof(int)
+        + (primRef.size() + secondary.size()) * sizeof(PoseVariable);
+    for (const std::vector<PoseVariable>& poses : primary)
+    {
+        bytes += poses.size() * sizeof(PoseVariable);
+    }
+    for (const MObject& obj : data)
     {
-        for (int eid = 0; eid < numExs; ++eid)
+        if (obj.apiType() == MFn::kIntArrayData)
         {
-            slr = slr + weight[eid] * PoseVariable::getRotateFrom(secPlug, eid);
+            bytes += MFnIntArrayData(obj).length() * sizeof(int);
+        }
+        else if (obj.apiType() == MFn::kDoubleArrayData)
+        {
+            bytes += MFnDoubleArrayData(obj).length() * sizeof(double);
         }
-        slr = slr.exp();
     }
-    MTransformationMatrix tm;
-    double sv[] = { ss.x, ss.y, ss.z };
-    tm.setScale(sv, MSpace::kTransform);
-    tm.setRotationQuaternion(slr.x, slr.y, slr.z, slr.w);
-    tm.setTranslation(st, MSpace::kTransform);
-    MDataHandle outputHandle = dataBlock.outputValue(plug);
-    outputHandle.setMMatrix(tm.asMatrix());
-    outputHandle.setClean();
-    return MS::kSuccess;
+    return bytes;
 }
 
-MStatus
-SrtRbfNode::addExample(
-    double add, // additional rotation
-    int sign)    // sign of duplicated example
+// plugs of the typed attribute data in the order of SrtRbfVersion::data
+void
+SrtRbfNode::trainedDataPlugs(
+    MPlug plugs[6]) const
 {
-    MStatus status = MS::kSuccess;
-
     MFnDependencyNode fnThisNode(thisMObject());
-    MPlug iplug      = fnThisNode.findPlug(inputAttrName[0], true);
-    MPlug rbfPlug    = fnThisNode.findPlug(rbfAttrName[0], true);
-    MPlug distPlug   = fnThisNode.findPlug(distAttrName[0], true);
-    MPlug numExsPlug = fnThisNode.findPlug(numExsAttr, true);
-    const int numInputs = iplug.numElements();
-    const int rbfType   = rbfPlug.asInt();
-    const int distType  = distPlug.asInt();
+    plugs[0] = fnThisNode.findPlug(primRefDataAttr, true);
+    plugs[1] = fnThisNode.findPlug(primaryDataAttr, true);
+    plugs[2] = fnThisNode.findPlug(secondaryDataAttr, true);
+    plugs[3] = fnThisNode.findPlug(invKerDataAttr, true);
+    plugs[4] = fnThisNode.findPlug(landmarkDataAttr, true);
+    plugs[5] = fnThisNode.findPlug(coefDataAttr, true);
+}
 
-    std::vector<PoseVariable> primPoses;
-    for (int i = 0; i < numInputs; ++i)
+// keeps the trained data before an edit; the solved system moves into the
+// version since the edit replaces it, and the iterative solver warm-starts
+// from it there
+void
+SrtRbfNode::beginEdit(
+    SrtRbfVersion& version)
+{
+    if (modelDirty)
     {
-        MPlug mPlug = iplug.elementByLogicalIndex(i);
+        loadModel();
+    }
+    version.numExs = model.numExs;
+    version.appended = true;
+    version.revision = modelRevision;
+    version.primRef = model.primRef;
+    version.primary.clear();
+    version.secondary.clear();
+    version.invKerMat.swap(model.invKerMat);
+    version.landmarks.swap(model.landmarks);
+    version.coef.swap(model.coef);
+    version.params[0] = model.scaleWeight;
+    version.params[1] = model.rotateWeight;
+    version.params[2] = model.translateWeight;
+    version.params[3] = model.width;
+    version.residual = MFnDependencyNode(thisMObject()).findPlug(residualAttr, true).asDouble();
+    MPlug plugs[6];
+    trainedDataPlugs(plugs);
+    for (int i = 0; i < 6; ++i)
+    {
+        plugs[i].getValue(version.data[i]);
+    }
+    editVersion = &version;
+}
+
+// whether the edit stored new trained data; otherwise the solved system is
+// given back
+bool
+SrtRbfNode::endEdit(
+    SrtRbfVersion& version)
+{
+    editVersion = nullptr;
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    if (modelRevision != version.revision)
+    {
+        version.appended = model.numExs >= version.numExs;
+        return true;
+    }
+    if (model.invKerMat.size() == 0 && model.landmarks.empty() && model.coef.size() == 0)
+    {
+        model.invKerMat.swap(version.invKerMat);
+        model.landmarks.swap(version.landmarks);
+        model.coef.swap(version.coef);
+    }
+    return false;
+}
+
+// exchanges the trained data of the node with the version, which undoes or
+// redoes an edit without copying the examples in common or the solved systems.
+// When the examples do not line up with the version, e.g. after an edit of
+// the node outside the undo queue, the node is loaded from the swapped
+// attribute data instead.
+void
+SrtRbfNode::swapVersion(
+    SrtRbfVersion& version)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    const int numExs = model.numExs;
+    bool splice = version.appended
+        && (version.numExs <= numExs
+            || static_cast<int>(version.primary.size()) == version.numExs - numExs);
+
+    // the stored data objects are shared with the version, not copied
+    MPlug plugs[6];
+    trainedDataPlugs(plugs);
+    for (int i = 0; i < 6; ++i)
+    {
+        MObject data;
+        plugs[i].getValue(data);
+        if (!version.data[i].isNull())
+        {
+            plugs[i].setValue(version.data[i]);
+        }
+        else if (i == 4) // landmark ids
+        {
+            SetIntArray(plugs[i], std::vector<int>());
+        }
+        else
+        {
+            SetDoubleArray(plugs[i], nullptr, 0);
+        }
+        version.data[i] = data;
+    }
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug residualPlug = fnThisNode.findPlug(residualAttr, true);
+    const double residual = residualPlug.asDouble();
+    residualPlug.setValue(version.residual);
+    version.residual = residual;
+    fnThisNode.findPlug(numExsAttr, true).setValue(version.numExs);
+    const MObject paramAttrs[4] = { scaleWeightAttr, rotateWeightAttr, translateWeightAttr, widthAttr };
+    double* modelParams[4] = { &model.scaleWeight, &model.rotateWeight, &model.translateWeight, &model.width };
+    for (int i = 0; i < 4; ++i)
+    {
+        fnThisNode.findPlug(paramAttrs[i], true).setValue(version.params[i]);
+        std::swap(*modelParams[i], version.params[i]);
+    }
+
+    if (splice)
+    {
+        if (version.numExs < numExs)
+        {
+            version.primary.assign(
+                std::make_move_iterator(model.primary.begin() + version.numExs),
+                std::make_move_iterator(model.primary.end()));
+            version.secondary.assign(model.secondary.begin() + version.numExs, model.secondary.end());
+            model.primary.resize(version.numExs);
+            model.secondary.resize(version.numExs);
+        }
+        else
+        {
+            model.primary.insert(model.primary.end(),
+                std::make_move_iterator(version.primary.begin()),
+                std::make_move_iterator(version.primary.end()));
+            model.secondary.insert(model.secondary.end(), version.secondary.begin(), version.secondary.end());
+            version.primary.clear();
+            version.secondary.clear();
+        }
+        model.numExs = version.numExs;
+        model.primRef.swap(version.primRef);
+        model.invKerMat.swap(version.invKerMat);
+        model.landmarks.swap(version.landmarks);
+        model.coef.swap(version.coef);
+
+        // the spliced examples must match the attribute data swapped in
+        const unsigned int numValues = static_cast<unsigned int>(model.numExs) * 10;
+        splice = static_cast<int>(model.primary.size()) == model.numExs
+            && static_cast<int>(model.secondary.size()) == model.numExs
+            && MFnDoubleArrayData(plugs[1].asMObject()).length() == numValues * model.numInputs
+            && MFnDoubleArrayData(plugs[2].asMObject()).length() == numValues;
+    }
+    version.numExs = numExs;
+    if (!splice)
+    {
+        // the version keeps only the attribute data, which is exchanged again
+        // by the next undo or redo
+        version.appended = false;
+        version.primary.clear();
+        version.secondary.clear();
+        version.invKerMat.resize(0, 0);
+        version.landmarks.clear();
+        version.coef.resize(0, 0);
+        modelDirty = true;
+        loadModel();
+        return;
+    }
+
+    // the search indices and the per-frame buffers follow the examples
+    model.update();
+    modelDirty = false;
+    workspace.reserve(model);
+    frameState.reserve(model);
+}
+
+// copies the training data of the node for RetrainSrtRbf; the solved system
+// is left out, except the coefficients that warm-start the iterative solver
+bool
+SrtRbfNode::beginRetrain(
+    SrtRbfRetrain& job)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    MFnDependencyNode fnThisNode(thisMObject());
+    SrtRbfModel& copy = job.model;
+    copy.numInputs       = model.numInputs;
+    copy.numExs          = model.numExs;
+    copy.rbfType         = model.rbfType;
+    copy.distType        = model.distType;
+    copy.solver          = model.solver;
+    copy.affinity        = model.affinity;
+    copy.scaleWeight     = model.scaleWeight;
+    copy.rotateWeight    = model.rotateWeight;
+    copy.translateWeight = model.translateWeight;
+    copy.width           = model.width;
+    copy.primRef         = model.primRef;
+    copy.primary         = model.primary;
+    copy.secondary       = model.secondary;
+    if (model.solver == 2)
+    {
+        copy.landmarks = model.landmarks;
+        copy.coef      = model.coef;
+    }
+    job.numLandmarks  = fnThisNode.findPlug(numLandmarksAttr, true).asInt();
+    job.tolerance     = fnThisNode.findPlug(solverToleranceAttr, true).asDouble();
+    job.maxIterations = fnThisNode.findPlug(solverIterationsAttr, true).asInt();
+    job.solved   = false;
+    job.residual = 0.0;
+    return model.numExs > 0;
+}
+
+// solves the copied system; called on the worker threads
+void
+SrtRbfRetrain::solve()
+{
+    if (model.solver == 1)
+    {
+        solved = model.fitLowRank(numLandmarks, residual);
+    }
+    else if (model.solver == 2)
+    {
+        int numIterations = 0;
+        solved = model.fitIterative(tolerance, maxIterations, nullptr, model.landmarks, model.coef, numIterations, residual);
+    }
+    else
+    {
+        solved = model.fitDense();
+    }
+}
+
+// queues the stored data of the solved system like storeModel; the node
+// reloads the model when the modifier sets them
+void
+SrtRbfNode::commitRetrain(
+    const SrtRbfRetrain& job,
+    MDGModifier& modifier) const
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    const SrtRbfModel& solved = job.model;
+    const RowMatrixXd invKerMat = solved.invKerMat;
+    // the centers of the iterative solver are all the examples
+    modifier.newPlugValue(fnThisNode.findPlug(invKerDataAttr, true),
+        DoubleArrayData(invKerMat.data(), static_cast<unsigned int>(invKerMat.size())));
+    modifier.newPlugValue(fnThisNode.findPlug(landmarkDataAttr, true),
+        IntArrayData(solved.solver == 1 ? solved.landmarks : std::vector<int>()));
+    modifier.newPlugValue(fnThisNode.findPlug(coefDataAttr, true),
+        DoubleArrayData(solved.coef.data(), static_cast<unsigned int>(solved.coef.size())));
+    if (solved.solver != 0)
+    {
+        modifier.newPlugValueDouble(fnThisNode.findPlug(residualAttr, true), job.residual);
+    }
+}
+
+void
+SrtRbfNode::migrateLegacyData()
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug legacyPlugs[] = {
+        fnThisNode.findPlug(primRefAttr, true),
+        fnThisNode.findPlug(primaryAttr, true),
+        fnThisNode.findPlug(secondaryAttr, true),
+        fnThisNode.findPlug(invKerMatAttr, true),
+        fnThisNode.findPlug(landmarkAttr, true),
+        fnThisNode.findPlug(coefAttr, true) };
+    bool isLegacy = false;
+    for (MPlug& plug : legacyPlugs)
+    {
+        isLegacy = isLegacy || plug.numElements() > 0;
+    }
+    if (!isLegacy)
+    {
+        return;
+    }
+    loadModel();
+    storeExamples();
+    storeModel();
+    for (MPlug& plug : legacyPlugs)
+    {
+        TruncateArray(plug, 0);
+    }
+}
+
+void
+SrtRbfNode::migrateScene(
+    void* clientData)
+{
+    for (MItDependencyNodes it(MFn::kPluginDependNode); !it.isDone(); it.next())
+    {
+        MFnDependencyNode fnNode(it.thisNode());
+        // rewriting the nodes of referenced files would make reference edits,
+        // and their multi elements cannot be removed; loadModel reads them as they are
+        if (fnNode.typeId() == SrtRbfNodeID && !fnNode.isFromReferencedFile())
+        {
+            static_cast<SrtRbfNode*>(fnNode.userNode())->migrateLegacyData();
+        }
+    }
+}
+
+void
+SrtRbfNode::updateWeight(
+    const MPlug& plug,
+    MDataBlock& dataBlock,
+    int k,
+    bool single)
+{
+    const int numInputs = static_cast<int>(inputMatrices.size());
+    if (modelDirty || numInputs != model.numInputs)
+    {
+        loadModel();
+    }
+
+    // relativize only the inputs changed since the last evaluation
+    frameState.dirty.assign(numInputs, 1);
+    frameState.poses.resize(numInputs);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        if (iid < static_cast<int>(poseInputs.size()) && poseInputs[iid] == inputMatrices[iid])
+        {
+            frameState.dirty[iid] = 0;
+            continue;
+        }
+        MTransformationMatrix tm(inputMatrices[iid]);
+        frameState.poses[iid] = model.relativize(iid, tm);
+    }
+    poseInputs = inputMatrices;
+
+    // the nearest examples only where their measured error is within the tolerance
+    if (k > 0 && k < model.numExs
+        && !nearestAllowed(k, dataBlock.inputValue(nearestToleranceAttr).asDouble()))
+    {
+        k = 0;
+    }
+    model.frameFeatures(k, single, frameState, workspace, workspace.feature);
+}
+
+// quality tier of the current evaluation
+int
+SrtRbfNode::evaluationQuality(
+    MDataBlock& dataBlock) const
+{
+    const int quality = dataBlock.inputValue(qualityAttr).asInt();
+    if (quality != kQualityAuto)
+    {
+        return quality;
+    }
+    if (MGlobal::mayaState() != MGlobal::kInteractive
+        || MRenderUtil::mayaRenderState() != MRenderUtil::kNotRendering)
+    {
+        return dataBlock.inputValue(renderQualityAttr).asInt();
+    }
+    // evaluations in a context other than the current time fill the cached playback
+    if (!dataBlock.context().isNormal())
+    {
+        return dataBlock.inputValue(cachedQualityAttr).asInt();
+    }
+    return dataBlock.inputValue(interactiveQualityAttr).asInt();
+}
+
+// whether the blend of the k nearest examples stays within the tolerance of
+// the blend of all examples; measured once per trained model
+bool
+SrtRbfNode::nearestAllowed(
+    int k,
+    double tolerance)
+{
+    if (nearestRevision != modelRevision || nearestK != k)
+    {
+        nearestError = model.nearestError(k, 200);
+        nearestRevision = modelRevision;
+        nearestK = k;
+    }
+    return nearestError <= tolerance;
+}
+
+// background evaluation of the frames sampled by speculate on one thread that
+// lives while the plug-in is loaded, one batch at a time so that it never
+// competes with Maya for more than a core; finishSpeculation stops it when the
+// plug-in is uninitialized, and the destructor when it is released without that
+class SpeculativeWorker
+{
+public:
+    SpeculativeWorker()
+        : running(false),
+        quit(false)
+    {
+    }
+    ~SpeculativeWorker()
+    {
+        stop();
+    }
+    bool
+    busy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return running || task;
+    }
+    void
+    start(
+        std::function<void()> batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!thread.joinable())
+        {
+            quit = false;
+            thread = std::thread(&SpeculativeWorker::run, this);
+        }
+        task = std::move(batch);
+        wake.notify_one();
+    }
+    void
+    stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            wake.notify_one();
+        }
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+private:
+    void
+    run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this]() { return quit || task; });
+            if (quit)
+            {
+                return;
+            }
+            std::function<void()> batch = std::move(task);
+            task = nullptr;
+            running = true;
+            lock.unlock();
+            batch();
+            lock.lock();
+            running = false;
+        }
+    }
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::thread             thread;
+    std::function<void()>   task;
+    bool                    running;
+    bool                    quit;
+};
+static SpeculativeWorker speculativeWorker;
+
+// nodes with a non-empty speculative cache, the only ones speculate visits;
+// compute enrolls and withdraws them, possibly on evaluation threads
+static std::mutex speculativeNodesMutex;
+static std::vector<SrtRbfNode*> speculativeNodes;
+
+// sampled frames after which the sampling must have saved more evaluation
+// time than it cost, or the node stops speculating
+static const long kSpeculativeTrialFrames = 24;
+
+// samples the inputs of the next frames of the nodes with Speculative Frames
+// on the main thread when the time changes during forward playback, and
+// evaluates them on the background worker while Maya evaluates the current
+// frame. Sampling pulls the upstream of the inputs in the context of each
+// frame, which is not safe off the main thread, and Maya evaluates it again
+// when it reaches the frame; at most two frames are sampled per time change,
+// so the look-ahead grows by a frame per frame up to the depth and then costs
+// one upstream evaluation per frame. After kSpeculativeTrialFrames, a node
+// whose sampling took longer than the evaluations that compute took from the
+// cache stops speculating until its Speculative Frames changes. SrtRbfStats
+// reports both times.
+void
+SrtRbfNode::speculate(
+    MTime& time,
+    void* clientData)
+{
+    if (!MAnimControl::isPlaying() || MAnimControl::playbackBy() <= 0.0)
+    {
+        return;
+    }
+    // the main thread never waits for the last batch
+    if (speculativeWorker.busy())
+    {
+        return;
+    }
+    std::vector<SrtRbfNode*> candidates;
+    {
+        std::lock_guard<std::mutex> lock(speculativeNodesMutex);
+        candidates = speculativeNodes;
+    }
+    std::vector<SrtRbfNode*> controllers;
+    std::vector<int> depths;
+    int maxDepth = 0;
+    for (SrtRbfNode* controller : candidates)
+    {
+        int depth = 0;
+        {
+            SpeculativeCache& cache = *controller->speculativeCache;
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            if (!cache.off && cache.numSampled >= kSpeculativeTrialFrames && cache.numEvaluated > 0
+                && cache.numHits * (cache.evaluateSeconds / cache.numEvaluated) <= cache.sampleSeconds)
+            {
+                cache.off = true;
+            }
+            // one more slot than the depth keeps the current frame while the last one is added
+            depth = cache.off ? 0 : static_cast<int>(cache.frames.size()) - 1;
+        }
+        if (depth <= 0)
+        {
+            continue;
+        }
+        if (controller->modelDirty)
+        {
+            controller->loadModel();
+        }
+        if (controller->model.numExs == 0)
+        {
+            continue;
+        }
+        controllers.push_back(controller);
+        depths.push_back(depth);
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    // sample frame by frame so that the shared upstream is evaluated once per frame
+    struct Job
+    {
+        std::shared_ptr<SpeculativeCache>  cache;
+        std::shared_ptr<const SrtRbfModel> model;
+        int                                slot;
+        MTime                              time;
+        int                                revision;
+        std::vector<MMatrix>               inputs;
+    };
+    typedef std::chrono::steady_clock Clock;
+    const int maxSampledFrames = 2;
+    int numSampledFrames = 0;
+    std::vector<Job> jobs;
+    const MTime step(MAnimControl::playbackBy(), MTime::uiUnit());
+    MTime frameTime = time;
+    for (int fid = 1; fid <= maxDepth && numSampledFrames < maxSampledFrames; ++fid)
+    {
+        frameTime = frameTime + step;
+        if (MAnimControl::maxTime() < frameTime)
+        {
+            break;
+        }
+        std::vector<size_t> pending;
+        for (size_t nid = 0; nid < controllers.size(); ++nid)
+        {
+            SpeculativeCache& cache = *controllers[nid]->speculativeCache;
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            const bool present = std::any_of(cache.frames.begin(), cache.frames.end(),
+                [&](const SpeculativeFrame& frame)
+                {
+                    return frame.time == frameTime && frame.revision == controllers[nid]->modelRevision;
+                });
+            if (fid <= depths[nid] && !present)
+            {
+                pending.push_back(nid);
+            }
+        }
+        if (pending.empty())
+        {
+            continue;
+        }
+        ++numSampledFrames;
+        MDGContext context(frameTime);
+        MDGContextGuard guard(context);
+        for (size_t nid : pending)
+        {
+            SrtRbfNode* controller = controllers[nid];
+            Job job;
+            job.cache = controller->speculativeCache;
+            job.model = controller->modelSnapshot();
+            job.time = frameTime;
+            job.revision = controller->modelRevision;
+            const Clock::time_point start = Clock::now();
+            controller->sampleInputs(job.inputs);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(job.cache->mutex);
+                job.cache->sampleSeconds += seconds;
+                ++job.cache->numSampled;
+                std::vector<SpeculativeFrame>& frames = job.cache->frames;
+                if (frames.empty())
+                {
+                    continue; // turned off by compute meanwhile
+                }
+                job.slot = job.cache->next;
+                job.cache->next = (job.cache->next + 1) % static_cast<int>(frames.size());
+                frames[job.slot].time = job.time;
+                frames[job.slot].revision = job.revision;
+                frames[job.slot].inputs = job.inputs;
+                frames[job.slot].ready = false;
+            }
+            jobs.push_back(job);
+        }
+    }
+    if (jobs.empty())
+    {
+        return;
+    }
+    speculativeWorker.start([jobs]()
+    {
+        typedef std::chrono::steady_clock Clock;
+        for (const Job& job : jobs)
+        {
+            const SrtRbfModel& model = *job.model;
+            if (static_cast<int>(job.inputs.size()) != model.numInputs)
+            {
+                continue;
+            }
+            const Clock::time_point start = Clock::now();
+            std::vector<PoseVariable> poses(model.numInputs);
+            for (int iid = 0; iid < model.numInputs; ++iid)
+            {
+                poses[iid] = model.relativize(iid, MTransformationMatrix(job.inputs[iid]));
+            }
+            Eigen::VectorXd feature;
+            model.evaluate(poses, feature);
+            const MMatrix output = model.compose(feature);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(job.cache->mutex);
+            job.cache->evaluateSeconds += seconds;
+            ++job.cache->numEvaluated;
+            if (job.slot < static_cast<int>(job.cache->frames.size()))
+            {
+                SpeculativeFrame& frame = job.cache->frames[job.slot];
+                if (frame.time == job.time && frame.revision == job.revision)
+                {
+                    frame.output = output;
+                    frame.ready = true;
+                }
+            }
+        }
+    });
+}
+
+// stops the background worker before the plug-in is unloaded
+void
+SrtRbfNode::finishSpeculation()
+{
+    speculativeWorker.stop();
+}
+
+// sizes the speculative cache of the node to the depth, and enrolls the node
+// in speculate while it is not empty; a new depth restarts the measurement
+void
+SrtRbfNode::resizeSpeculation(
+    int depth)
+{
+    const size_t size = depth > 0 ? depth + 1 : 0;
+    {
+        std::lock_guard<std::mutex> lock(speculativeCache->mutex);
+        if (speculativeCache->frames.size() == size)
+        {
+            return;
+        }
+        speculativeCache->frames.assign(size, SpeculativeFrame());
+        speculativeCache->next = 0;
+        speculativeCache->numSampled = 0;
+        speculativeCache->sampleSeconds = 0.0;
+        speculativeCache->numEvaluated = 0;
+        speculativeCache->evaluateSeconds = 0.0;
+        speculativeCache->numHits = 0;
+        speculativeCache->off = false;
+    }
+    std::lock_guard<std::mutex> lock(speculativeNodesMutex);
+    auto it = std::find(speculativeNodes.begin(), speculativeNodes.end(), this);
+    if (size > 0 && it == speculativeNodes.end())
+    {
+        speculativeNodes.push_back(this);
+    }
+    else if (size == 0 && it != speculativeNodes.end())
+    {
+        speculativeNodes.erase(it);
+    }
+}
+
+SrtRbfNode::~SrtRbfNode()
+{
+    std::lock_guard<std::mutex> lock(speculativeNodesMutex);
+    speculativeNodes.erase(std::remove(speculativeNodes.begin(), speculativeNodes.end(), this),
+        speculativeNodes.end());
+}
+
+// output evaluated in the background for the time, the current trained data
+// and exactly the current inputs
+bool
+SrtRbfNode::speculativeOutput(
+    const MTime& time,
+    MMatrix& output)
+{
+    std::lock_guard<std::mutex> lock(speculativeCache->mutex);
+    for (const SpeculativeFrame& frame : speculativeCache->frames)
+    {
+        if (frame.ready && frame.time == time && frame.revision == modelRevision
+            && frame.inputs == inputMatrices)
+        {
+            output = frame.output;
+            ++speculativeCache->numHits;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+SrtRbfNode::isLastInputs(
+    double tolerance) const
+{
+    if (!lastValid || modelDirty || inputMatrices.size() != lastInputs.size())
+    {
+        return false;
+    }
+    for (size_t iid = 0; iid < inputMatrices.size(); ++iid)
+    {
+        for (int j = 0; j < 16; ++j)
+        {
+            if (std::abs(inputMatrices[iid](j / 4, j % 4) - lastInputs[iid](j / 4, j % 4)) > tolerance)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+MStatus
+SrtRbfNode::compute(
+    const MPlug& plug,
+    MDataBlock& dataBlock)
+{
+    MObject attr = plug.attribute();
+    if (attr == trainedModelAttr)
+    {
+        MFnPluginData fnData;
+        MObject data = fnData.create(SrtRbfModelData::SrtRbfModelDataID);
+        static_cast<SrtRbfModelData*>(fnData.data())->model = modelSnapshot();
+        MDataHandle modelHandle = dataBlock.outputValue(trainedModelAttr);
+        modelHandle.setMObject(data);
+        modelHandle.setClean();
+        return MS::kSuccess;
+    }
+    if (attr != outputAttr && attr != approxErrorAttr
+        && attr != cacheHitsAttr && attr != cacheMissesAttr)
+    {
+        return MS::kUnknownParameter;
+    }
+    MArrayDataHandle inputHandle = dataBlock.inputArrayValue(inputAttr);
+    const int numInputs = inputHandle.elementCount();
+    inputMatrices.resize(numInputs);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        inputMatrices[iid] = inputHandle.jumpToElement(iid) == MS::kSuccess
+            ? inputHandle.inputValue().asMatrix()
+            : MMatrix::identity;
+    }
+
+    // approximation of the quality tier
+    const int quality = evaluationQuality(dataBlock);
+    int k = dataBlock.inputValue(nearestAttr).asInt();
+    bool single = dataBlock.inputValue(singlePrecisionAttr).asBool();
+    switch (quality)
+    {
+    case kQualityFull:
+        k = 0;
+        single = false;
+        break;
+    case kQualityNearest:
+        k = k > 0 ? k : 8;
+        single = false;
+        break;
+    case kQualitySingle:
+        k = 0;
+        single = true;
+        break;
+    default:
+        break;
+    }
+    // the last output of another tier is not reused, except for freezing it
+    if (quality != kQualityFrozen && quality != lastQuality)
+    {
+        lastValid = false;
+        lastQuality = quality;
+    }
+
+    // reuse the last output while the inputs stay within the tolerance,
+    // or the output evaluated in the background for the same inputs
+    resizeSpeculation(dataBlock.inputValue(speculativeFramesAttr).asInt());
+    const double tolerance = dataBlock.inputValue(cacheToleranceAttr).asDouble();
+    if ((quality == kQualityFrozen && lastValid) || isLastInputs(tolerance))
+    {
+        ++cacheHits;
+    }
+    else if (quality != kQualityFrozen && k == 0 && !single
+        && speculativeOutput(dataBlock.context().getTime(), lastOutput))
+    {
+        ++cacheHits;
+        lastInputs = inputMatrices;
+        lastApproxError = 0.0;
+        lastValid = true;
+    }
+    else
+    {
+        ++cacheMisses;
+        updateWeight(plug, dataBlock, k, single);
+        MMatrix output = model.compose(workspace.feature);
+
+        double approxError = 0.0;
+        if ((!frameState.weightIds.empty() || single)
+            && dataBlock.inputValue(measureErrorAttr).asBool())
+        {
+            Eigen::VectorXd& exactFeature = workspace.exactFeature;
+            model.evaluate(frameState.poses, workspace, exactFeature);
+            const MMatrix exact = model.compose(exactFeature);
+            for (int j = 0; j < 16; ++j)
+            {
+                approxError = std::max(approxError, std::abs(output(j / 4, j % 4) - exact(j / 4, j % 4)));
+            }
+            // the nearest examples beyond the tolerance give way to all examples
+            if (!frameState.weightIds.empty() && approxError > dataBlock.inputValue(nearestToleranceAttr).asDouble())
+            {
+                output = exact;
+                approxError = 0.0;
+            }
+        }
+        lastInputs = inputMatrices;
+        lastOutput = output;
+        lastApproxError = approxError;
+        lastValid = true;
+    }
+
+    MDataHandle outputHandle = dataBlock.outputValue(outputAttr);
+    outputHandle.setMMatrix(lastOutput);
+    outputHandle.setClean();
+    MDataHandle errorHandle = dataBlock.outputValue(approxErrorAttr);
+    errorHandle.setDouble(lastApproxError);
+    errorHandle.setClean();
+    MDataHandle hitsHandle = dataBlock.outputValue(cacheHitsAttr);
+    hitsHandle.setInt(cacheHits);
+    hitsHandle.setClean();
+    MDataHandle missesHandle = dataBlock.outputValue(cacheMissesAttr);
+    missesHandle.setInt(cacheMisses);
+    missesHandle.setClean();
+    return MS::kSuccess;
+}
+
+MStatus
+SrtRbfNode::addExample(
+    double add, // additional rotation
+    int sign)    // sign of duplicated example
+{
+    MStatus status = MS::kSuccess;
+
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug iplug      = fnThisNode.findPlug(inputAttrName[0], true);
+    MPlug numExsPlug = fnThisNode.findPlug(numExsAttr, true);
+    const int numInputs = iplug.numElements();
+
+    std::vector<PoseVariable> primPoses;
+    for (int i = 0; i < numInputs; ++i)
+    {
+        MPlug mPlug = iplug.elementByLogicalIndex(i);
         MFnMatrixData matrixData(mPlug.asMObject());
         MTransformationMatrix tm(matrixData.matrix());
         primPoses.push_back(PoseVariable::fromMatrix(tm));
     }
 
-    MPlug tplug = fnThisNode.findPlug(targetAttrName[0], true);
-    MPlugArray dparray;
-    tplug.connectedTo(dparray, false, true);
-    if (dparray.length() == 0)
+    MPlug tplug = fnThisNode.findPlug(targetAttrName[0], true);
+    MPlugArray dparray;
+    tplug.connectedTo(dparray, false, true);
+    if (dparray.length() == 0)
+    {
+        return MS::kFailure;
+    }
+    MObject secNode = dparray[0].node();
+    MFnTransform target(secNode);
+    MTransformationMatrix targetTransform = target.transformation();
+
+    if (numExsPlug.asInt() == 0)
+    {
+        PoseVariable secPose = PoseVariable::fromMatrix(targetTransform.asMatrix());
+        model.numInputs = numInputs;
+        model.numExs = 1;
+        model.primRef = primPoses;
+        for (int i = 0; i < numInputs; ++i)
+        {
+            primPoses[i].rotate = MQuaternion::identity;
+        }
+        model.primary.assign(1, primPoses);
+        model.secondary.assign(1, secPose);
+        storeExamples();
+    }
+    else
+    {
+        if (modelDirty)
+        {
+            loadModel();
+        }
+        PoseVariable secPose = PoseVariable::fromMatrix(targetTransform.asMatrix());
+        // relativize
+        MQuaternion sref = model.secondary[0].rotate;
+        secPose.ontoHemisphere(sref);
+        secPose.rotate = PoseVariable::qlndiff(sref, secPose.rotate);
+        double ra = std::sqrt(PoseVariable::qdot(secPose.rotate, secPose.rotate));
+        if (add != 0 && std::fabs(ra) > 0)
+        {
+            secPose.rotate = (ra + 0.5 * add) / ra * secPose.rotate;
+        }
+        for (int i = 0; i < numInputs; ++i)
+        {
+            MQuaternion primrefr = model.primRef[i].rotate;
+            primPoses[i].ontoHemisphere(primrefr);
+            primPoses[i].rotate = primrefr.conjugate() * primPoses[i].rotate;
+        }
+        addExampleSupport(primPoses, secPose);
+
+        // duplicated example
+        if (sign != 0)
+        {
+            PoseVariable dupSecPose = secPose;
+            dupSecPose.rotate = sign * secPose.rotate;
+            std::vector<PoseVariable> dupPrimPose = primPoses;
+            bool isSingular = false;
+            for (int i = 0; i < numInputs; ++i)
+            {
+                if (std::abs(primPoses[i].rotate.w) < 1.0e-6)
+                {
+                    dupPrimPose[i].rotate = -dupPrimPose[i].rotate;
+                    isSingular = true;
+                }
+            }
+            if (isSingular)
+            {
+                if (modelDirty)
+                {
+                    loadModel();
+                }
+                if (model.findDuplicate(dupPrimPose, 1.0e-6) < 0)
+                {
+                    MGlobal::displayInfo("Duplicating example");
+                    addExampleSupport(dupPrimPose, dupSecPose);
+                }
+            }
+        }
+    }
+    return status;
+}
+
+MStatus
+SrtRbfNode::gotoExample(
+    int eid)
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    if (eid >= model.numExs)
+    {
+        return MS::kInvalidParameter;
+    }
+
+    MPlug iplug = fnThisNode.findPlug(inputAttrName[0], true);
+    const int numInputs = model.numInputs;
+    const std::vector<PoseVariable> primPoses = model.primary[eid];
+    for (int i = 0; i < numInputs; ++i)
+    {
+        MPlug ip = iplug.elementByLogicalIndex(i).source();
+        if (ip.isNull())
+        {
+            continue;
+        }
+        MFnTransform source(ip.node());
+        source.setTranslation(primPoses[i].translate, MSpace::kTransform);
+        double sv[3] = { primPoses[i].scale.x, primPoses[i].scale.y, primPoses[i].scale.z };
+        source.setScale(sv);
+        source.setRotation(primPoses[i].rotate);
+    }
+    MVector ss(1.0, 1.0, 1.0);
+    MVector st(0, 0, 0);
+    MQuaternion sq(0, 0, 0, 1.0);
+    st = model.secondary[eid].translate;
+    sq = model.secondary[eid].rotate;
+    ss = model.secondary[eid].scale;
+    if (eid > 0)
+    {
+        sq = model.secondary[0].rotate * sq.exp();
+    }
+    return MStatus::kSuccess;
+}
+
+MStatus
+SrtRbfNode::compress(
+    double tolerance,
+    int& numBefore,
+    int& numAfter,
+    double& maxError)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    numBefore = model.numExs;
+    numAfter  = model.numExs;
+    maxError  = 0.0;
+    const std::vector<int> kept = model.prune(tolerance);
+    if (static_cast<int>(kept.size()) == model.numExs)
+    {
+        return MS::kSuccess;
+    }
+
+    // refit once with the kept examples
+    const SrtRbfModel original = model;
+    model.numExs = static_cast<int>(kept.size());
+    model.primary.clear();
+    model.secondary.clear();
+    for (int eid : kept)
+    {
+        model.primary.push_back(original.primary[eid]);
+        model.secondary.push_back(original.secondary[eid]);
+    }
+    MFnDependencyNode fnThisNode(thisMObject());
+    double residual = 0.0;
+    const bool solved = fitModel(residual, true);
+    if (!solved)
+    {
+        model = original;
+        return MS::kFailure;
+    }
+    model.update();
+
+    // max error over all the original examples
+    for (int eid = 0; eid < original.numExs; ++eid)
+    {
+        Eigen::VectorXd fitted, expected;
+        model.evaluate(original.primary[eid], fitted);
+        original.exampleFeatures(eid, expected);
+        maxError = std::max(maxError, (fitted - expected).cwiseAbs().maxCoeff());
+    }
+    numAfter = model.numExs;
+
+    if (model.solver != 0)
+    {
+        fnThisNode.findPlug(residualAttr, true).setValue(residual);
+    }
+    storeModel();
+    storeExamples();
+    modelDirty = false;
+    return MS::kSuccess;
+}
+
+MStatus
+SrtRbfNode::tune(
+    int numPasses,
+    double& errorBefore,
+    double& errorAfter)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    errorAfter = model.tune(numPasses, errorBefore);
+
+    // refit with the tuned parameters
+    MFnDependencyNode fnThisNode(thisMObject());
+    double residual = 0.0;
+    const bool solved = fitModel(residual, true);
+    if (!solved)
+    {
+        modelDirty = true;
+        return MS::kFailure;
+    }
+    fnThisNode.findPlug(scaleWeightAttr, true).setValue(model.scaleWeight);
+    fnThisNode.findPlug(rotateWeightAttr, true).setValue(model.rotateWeight);
+    fnThisNode.findPlug(translateWeightAttr, true).setValue(model.translateWeight);
+    fnThisNode.findPlug(widthAttr, true).setValue(model.width);
+    if (model.solver != 0)
+    {
+        fnThisNode.findPlug(residualAttr, true).setValue(residual);
+    }
+    storeModel();
+    model.update();
+    modelDirty = false;
+    return MS::kSuccess;
+}
+
+MStatus
+SrtRbfNode::validatePrecision(
+    int numSamples,
+    double& maxTranslate,
+    double& maxRotate,
+    double& maxScale)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    if (model.numExs == 0)
+    {
+        return MS::kFailure;
+    }
+    model.validateSingle(numSamples, maxTranslate, maxRotate, maxScale);
+    return MS::kSuccess;
+}
+
+// deviation of the translation, rotation (degrees) and scale of two outputs
+static void
+OutputDeviation(
+    const MMatrix& a,
+    const MMatrix& b,
+    SrtRbfPathReport& report)
+{
+    const PoseVariable pa = PoseVariable::fromMatrix(a);
+    const PoseVariable pb = PoseVariable::fromMatrix(b);
+    // angle of the relative rotation, stable near zero unlike acos
+    const MQuaternion dq = pa.rotate.conjugate() * pb.rotate;
+    const double sinHalf = std::sqrt(dq.x * dq.x + dq.y * dq.y + dq.z * dq.z);
+    const MVector ds = pa.scale - pb.scale;
+    report.maxTranslate = std::max(report.maxTranslate, (pa.translate - pb.translate).length());
+    report.maxRotate = std::max(report.maxRotate,
+        2.0 * std::atan2(sinHalf, std::abs(dq.w)) * (180.0 / 3.14159265358979323846));
+    report.maxScale = std::max(report.maxScale,
+        std::max(std::abs(ds.x), std::max(std::abs(ds.y), std::abs(ds.z))));
+}
+
+// compares every evaluation path with the reference evaluation of the model
+// at the inputs of SrtRbfModel::testInputs; each path starts from the input
+// matrices like compute
+MStatus
+SrtRbfNode::validatePaths(
+    int numSamples,
+    std::vector<SrtRbfPathReport>& reports)
+{
+    typedef std::chrono::steady_clock Clock;
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    reports.clear();
+    if (model.numExs == 0 || model.numInputs == 0)
+    {
+        return MS::kFailure;
+    }
+    SrtRbfModel probe(model); // the caches of the node stay as they are
+    const int numInputs = probe.numInputs;
+    std::vector<MMatrix> inputs;
+    probe.testInputs(numSamples, inputs);
+    const int numPoses = static_cast<int>(inputs.size()) / numInputs;
+    std::vector<PoseVariable> poses(inputs.size());
+    std::vector<std::vector<PoseVariable>> poseSets(numPoses);
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            const int i = pid * numInputs + iid;
+            poses[i] = probe.relativize(iid, MTransformationMatrix(inputs[i]));
+        }
+        poseSets[pid].assign(poses.begin() + pid * numInputs, poses.begin() + (pid + 1) * numInputs);
+    }
+
+    std::vector<MMatrix> expected(numPoses), outputs(numPoses);
+    Clock::time_point start;
+    auto report = [&](const char* name, double translateTolerance, double rotateTolerance)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        SrtRbfPathReport r = { name, 0.0, 0.0, 0.0, translateTolerance, rotateTolerance, 1.0e6 * seconds / numPoses };
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            OutputDeviation(expected[pid], outputs[pid], r);
+        }
+        reports.push_back(r);
+    };
+    const double exact = 1.0e-6;
+    const double exactRotate = 1.0e-4;
+    // the low-rank solve on all examples goes through the normal equations
+    const double lowRankTolerance = 1.0e-5;
+    const double lowRankRotate = 1.0e-3;
+    Eigen::VectorXd feature;
+
+    // reference: a dense solve of all examples
+    std::vector<int> centers;
+    Eigen::MatrixXd reference;
+    if (!probe.referenceCoefficients(centers, reference))
+    {
+        return MS::kFailure;
+    }
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        probe.referenceFeatures(poseSets[pid], centers, reference, feature);
+        expected[pid] = probe.compose(feature);
+    }
+    outputs = expected;
+    report("reference", exact, exactRotate);
+
+    // blend of all examples; the low-rank solver approximates the reference
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        probe.evaluate(poseSets[pid], feature);
+        outputs[pid] = probe.compose(feature);
+    }
+    if (probe.solver == 1)
+    {
+        // an approximation with fewer landmarks than examples, only reported
+        const bool allLandmarks = static_cast<int>(probe.landmarks.size()) == probe.numExs;
+        report("low-rank", allLandmarks ? lowRankTolerance : 0.0, lowRankRotate);
+
+        // the other paths evaluate the landmarks, measured pose by pose
+        const Eigen::MatrixXd landmarkCoef = probe.coef;
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            probe.referenceFeatures(poseSets[pid], probe.landmarks, landmarkCoef, feature);
+            expected[pid] = probe.compose(feature);
+        }
+    }
+    else
+    {
+        report("full", exact, exactRotate);
+    }
+
+    // per-input distances summed as in compute
+    SrtRbfWorkspace workspace;
+    workspace.reserve(probe);
+    RowMatrixXd partial(numInputs, probe.numCenters());
+    Eigen::VectorXd distSq, weight;
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            probe.partialDistance(iid, poseSets[pid][iid], partial.row(iid).data());
+        }
+        distSq.noalias() = partial.colwise().sum().transpose();
+        if (probe.solver != 0)
+        {
+            probe.featuresFromDistance(distSq, feature);
+        }
+        else
+        {
+            probe.weightFromDistance(distSq, workspace, weight);
+            probe.features(weight, std::vector<int>(), feature);
+        }
+        outputs[pid] = probe.compose(feature);
+    }
+    report("incremental", exact, exactRotate);
+
+    // all poses at once as SrtRbfBatchNode
+    RowMatrixXd coefficients, features;
+    probe.dualCoefficients(centers, coefficients);
+    start = Clock::now();
+    probe.evaluateBatch(poses, coefficients, features);
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        outputs[pid] = probe.compose(features.row(pid).transpose());
+    }
+    report("batch", exact, exactRotate);
+
+    // single precision
+    probe.buildSingle();
+    workspace.reserve(probe);
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        probe.singleFeatures(poseSets[pid], workspace, workspace.feature);
+        outputs[pid] = probe.compose(workspace.feature);
+    }
+    report("single", 1.0e-3, 5.0e-2);
+
+    // nearest examples where nearestAllowed lets compute use them; the Nearest
+    // Tolerance bounds the matrix elements, and so the translation and scale by
+    // sqrt(3) times it and the rotation by about 115 degrees times it
+    const double nearestTolerance = MFnDependencyNode(thisMObject()).findPlug(nearestToleranceAttr, true).asDouble();
+    if (probe.numExs > 8 && nearestAllowed(8, nearestTolerance))
+    {
+        std::vector<int> ids;
+        start = Clock::now();
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            if (probe.localWeight(poseSets[pid], 8, workspace, ids, weight))
+            {
+                probe.features(weight, ids, feature);
+            }
+            else
+            {
+                probe.evaluate(poseSets[pid], feature);
+            }
+            outputs[pid] = probe.compose(feature);
+        }
+        report("nearest 8", 2.0 * nearestTolerance, 200.0 * nearestTolerance);
+    }
+
+    // exported runtime
+    std::vector<double> image;
+    SrtRbfRuntime* runtime = runtimeImage(image)
+        ? SrtRbfOpenMemory(image.data(), image.size() * sizeof(double)) : nullptr;
+    if (runtime != nullptr)
+    {
+        std::vector<double> flatInputs(inputs.size() * 16), flatOutputs(numPoses * 16);
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            inputs[i].get(reinterpret_cast<double(*)[4]>(flatInputs.data() + i * 16));
+        }
+        start = Clock::now();
+        SrtRbfEvaluate(runtime, numPoses, flatInputs.data(), flatOutputs.data());
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            outputs[pid] = MMatrix(reinterpret_cast<const double(*)[4]>(flatOutputs.data() + pid * 16));
+        }
+        report("runtime", exact, exactRotate);
+        SrtRbfClose(runtime);
+    }
+    return MS::kSuccess;
+}
+
+// Jacobian of the output at the current inputs, checked against central
+// differences of the given step unless it is 0; kNotImplemented where it is
+// undefined (see SrtRbfModel::jacobian)
+MStatus
+SrtRbfNode::jacobian(
+    double step,
+    Eigen::MatrixXd& jac,
+    double& maxError)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    std::vector<MMatrix> inputs;
+    sampleInputs(inputs);
+    if (model.numExs == 0 || static_cast<int>(inputs.size()) != model.numInputs)
+    {
+        return MS::kFailure;
+    }
+    std::vector<PoseVariable> poses(inputs.size());
+    for (size_t iid = 0; iid < inputs.size(); ++iid)
+    {
+        poses[iid] = PoseVariable::fromMatrix(inputs[iid]);
+    }
+    if (!model.jacobian(poses, jac))
+    {
+        return MS::kNotImplemented;
+    }
+    maxError = step > 0 ? model.jacobianError(poses, step) : 0.0;
+    return MS::kSuccess;
+}
+
+// bytes of the trained data and caches, and the estimated cost of an evaluation
+void
+SrtRbfNode::stats(
+    SrtRbfNodeStats& stats)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    stats.numExs = model.numExs;
+    stats.numInputs = model.numInputs;
+    stats.numCenters = model.numCenters();
+    stats.solver = model.solver;
+    model.memoryUsage(stats.exampleBytes, stats.solveBytes, stats.cacheBytes);
+    stats.flops = model.evaluationFlops();
+
+    // typed attribute data, and the multi attributes of older versions until migrated
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug plugs[6];
+    trainedDataPlugs(plugs);
+    stats.storedBytes = 0;
+    for (MPlug& plug : plugs)
+    {
+        MObject data;
+        plug.getValue(data);
+        if (data.apiType() == MFn::kIntArrayData)
+        {
+            stats.storedBytes += MFnIntArrayData(data).length() * sizeof(int);
+        }
+        else if (data.apiType() == MFn::kDoubleArrayData)
+        {
+            stats.storedBytes += MFnDoubleArrayData(data).length() * sizeof(double);
+        }
+    }
+    const MObject legacyAttrs[] = { primRefAttr, primaryAttr, secondaryAttr, invKerMatAttr, coefAttr };
+    for (const MObject& attr : legacyAttrs)
+    {
+        stats.storedBytes += fnThisNode.findPlug(attr, true).numElements() * sizeof(double);
+    }
+    stats.storedBytes += fnThisNode.findPlug(landmarkAttr, true).numElements() * sizeof(int);
+
+    // per-frame buffers of compute
+    stats.cacheBytes += (frameState.partialDistSq.size() + frameState.distSq.size() + frameState.weight.size()
+        + workspace.kernelVec.size() + workspace.feature.size()) * sizeof(double)
+        + (workspace.kernelVecF.size() + workspace.queryF.size() + workspace.featureF.size()) * sizeof(float)
+        + workspace.found.capacity() * sizeof(std::pair<double, int>)
+        + workspace.pending.capacity() * sizeof(std::pair<int, double>)
+        + (inputMatrices.capacity() + lastInputs.capacity() + poseInputs.capacity()) * sizeof(MMatrix)
+        + frameState.poses.capacity() * sizeof(PoseVariable)
+        + frameState.weightIds.capacity() * sizeof(int) + frameState.dirty.capacity();
+    std::lock_guard<std::mutex> lock(speculativeCache->mutex);
+    for (const SpeculativeFrame& frame : speculativeCache->frames)
+    {
+        stats.cacheBytes += sizeof(SpeculativeFrame) + frame.inputs.capacity() * sizeof(MMatrix);
+    }
+    stats.numSampled = speculativeCache->numSampled;
+    stats.sampleMicroseconds = speculativeCache->numSampled > 0
+        ? 1.0e6 * speculativeCache->sampleSeconds / speculativeCache->numSampled : 0.0;
+    stats.numHits = speculativeCache->numHits;
+    stats.evaluateMicroseconds = speculativeCache->numEvaluated > 0
+        ? 1.0e6 * speculativeCache->evaluateSeconds / speculativeCache->numEvaluated : 0.0;
+    stats.speculating = !speculativeCache->frames.empty() && !speculativeCache->off;
+}
+
+// the trained data in the layout of runtime/SrtRbfFormat.h
+bool
+SrtRbfNode::runtimeImage(
+    std::vector<double>& buffer)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    return model.runtimeImage(buffer);
+}
+
+MStatus
+SrtRbfNode::exportRuntime(
+    const MString& path,
+    double& maxError)
+{
+    maxError = 0.0;
+    std::vector<double> buffer;
+    if (!runtimeImage(buffer))
+    {
+        return MS::kFailure;
+    }
+    const int numInputs = model.numInputs;
+    {
+        std::ofstream file(path.asChar(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(double));
+        if (!file)
+        {
+            MGlobal::displayError("Cannot write " + path);
+            return MS::kFailure;
+        }
+    }
+
+    // evaluate the written file at the examples and the current inputs
+    SrtRbfRuntime* runtime = SrtRbfOpen(path.asChar());
+    if (runtime == nullptr)
+    {
+        MGlobal::displayError("Cannot read back " + path);
+        return MS::kFailure;
+    }
+    std::vector<std::vector<MMatrix>> samples;
+    for (int eid = 0; eid < model.numExs; ++eid)
+    {
+        std::vector<MMatrix> sample(numInputs);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            PoseVariable pose = model.primary[eid][iid];
+            pose.rotate = model.primRef[iid].rotate * pose.rotate;
+            sample[iid] = PoseVariable::toMatrix(pose);
+        }
+        samples.push_back(sample);
+    }
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug iplug = fnThisNode.findPlug(inputAttr, true);
+    std::vector<MMatrix> current(numInputs);
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        current[iid] = GetMatrix(iplug.elementByLogicalIndex(iid));
+    }
+    samples.push_back(current);
+    std::vector<double> inputs(numInputs * 16);
+    double output[16];
+    std::vector<PoseVariable> poses(numInputs);
+    for (const std::vector<MMatrix>& sample : samples)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            sample[iid].get(reinterpret_cast<double(*)[4]>(inputs.data() + iid * 16));
+            poses[iid] = model.relativize(iid, MTransformationMatrix(sample[iid]));
+        }
+        SrtRbfEvaluate(runtime, 1, inputs.data(), output);
+        Eigen::VectorXd feature;
+        model.evaluate(poses, feature);
+        const MMatrix expected = model.compose(feature);
+        for (int j = 0; j < 16; ++j)
+        {
+            maxError = std::max(maxError, std::abs(output[j] - expected(j / 4, j % 4)));
+        }
+    }
+    SrtRbfClose(runtime);
+    return MS::kSuccess;
+}
+
+// appends the input matrices in the current evaluation context
+void
+SrtRbfNode::sampleInputs(
+    std::vector<MMatrix>& samples) const
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug iplug = fnThisNode.findPlug(inputAttr, true);
+    const unsigned int numInputs = iplug.numElements();
+    for (unsigned int iid = 0; iid < numInputs; ++iid)
+    {
+        samples.push_back(GetMatrix(iplug.elementByLogicalIndex(iid)));
+    }
+}
+
+// keys the target through the modifier and the curve change of the command,
+// so that the replaced connections come back when the bake is undone
+MStatus
+SrtRbfNode::bake(
+    const MTimeArray& times,
+    const std::vector<MMatrix>& samples,
+    MDGModifier& dgModifier,
+    MAnimCurveChange& curveChange)
+{
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    const int numInputs = model.numInputs;
+    const int numFrames = static_cast<int>(times.length());
+    if (model.numExs == 0 || numFrames == 0 || static_cast<int>(samples.size()) != numFrames * numInputs)
+    {
+        return MS::kFailure;
+    }
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug tplug = fnThisNode.findPlug(targetAttr, true);
+    MPlugArray dparray;
+    tplug.connectedTo(dparray, false, true);
+    if (dparray.length() == 0)
+    {
+        return MS::kFailure;
+    }
+    MFnTransform target(dparray[0].node());
+
+    // all frames in one kernel matrix
+    std::vector<PoseVariable> poses(samples.size());
+    for (int fid = 0; fid < numFrames; ++fid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            const int sid = fid * numInputs + iid;
+            poses[sid] = model.relativize(iid, MTransformationMatrix(samples[sid]));
+        }
+    }
+    RowMatrixXd features;
+    model.evaluateBatch(poses, features);
+
+    // channel values; euler angles follow the rotate order of the target without flipping
+    const MEulerRotation::RotationOrder order = static_cast<MEulerRotation::RotationOrder>(
+        target.rotationOrder() - MTransformationMatrix::kXYZ);
+    MDoubleArray values[9];
+    for (int c = 0; c < 9; ++c)
+    {
+        values[c].setLength(numFrames);
+    }
+    MEulerRotation previous;
+    for (int fid = 0; fid < numFrames; ++fid)
+    {
+        const Eigen::VectorXd feature = features.row(fid).transpose();
+        MTransformationMatrix tm(model.compose(feature));
+        const MVector t = tm.getTranslation(MSpace::kTransform);
+        MEulerRotation r = tm.eulerRotation();
+        r.reorderIt(order);
+        if (fid > 0)
+        {
+            r.setToClosestSolution(previous);
+        }
+        previous = r;
+        double sv[3];
+        tm.getScale(sv, MSpace::kTransform);
+        for (int a = 0; a < 3; ++a)
+        {
+            values[a][fid]     = t[a];
+            values[3 + a][fid] = a == 0 ? r.x : a == 1 ? r.y : r.z;
+            values[6 + a][fid] = sv[a];
+        }
+    }
+
+    // anim curves replace the incoming connections, e.g. from decomposeMatrix
+    static const char* compounds[3] = { "translate", "rotate", "scale" };
+    static const char* channels[9] = {
+        "translateX", "translateY", "translateZ",
+        "rotateX", "rotateY", "rotateZ",
+        "scaleX", "scaleY", "scaleZ" };
+    for (int c = 0; c < 12; ++c)
+    {
+        MPlug plug = target.findPlug(c < 3 ? compounds[c] : channels[c - 3], true);
+        MPlugArray sources;
+        plug.connectedTo(sources, true, false);
+        for (unsigned int k = 0; k < sources.length(); ++k)
+        {
+            dgModifier.disconnect(sources[k], plug);
+        }
+    }
+    MStatus status = dgModifier.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MFnAnimCurve curves[9];
+    for (int c = 0; c < 9; ++c)
+    {
+        curves[c].create(target.findPlug(channels[c], true), &dgModifier, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+    status = dgModifier.doIt();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MTimeArray keyTimes = times;
+    for (int c = 0; c < 9; ++c)
+    {
+        status = curves[c].addKeys(&keyTimes, &values[c],
+            MFnAnimCurve::kTangentGlobal, MFnAnimCurve::kTangentGlobal, false, &curveChange);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+    return MS::kSuccess;
+}
+
+// local transformation of the target in the current evaluation context
+bool
+SrtRbfNode::sampleTarget(
+    MMatrix& matrix) const
+{
+    MFnDependencyNode fnThisNode(thisMObject());
+    MPlug tplug = fnThisNode.findPlug(targetAttr, true);
+    MPlugArray dparray;
+    tplug.connectedTo(dparray, false, true);
+    if (dparray.length() == 0)
+    {
+        return false;
+    }
+    MFnDependencyNode target(dparray[0].node());
+    matrix = GetMatrix(target.findPlug("matrix", true));
+    return true;
+}
+
+// adds a well-spread subset of the sampled frames as examples and refits once;
+// the frames are picked one by one farthest from the examples under the dist metric
+MStatus
+SrtRbfNode::learnSamples(
+    const std::vector<MMatrix>& inputs,
+    const std::vector<MMatrix>& targets,
+    int maxExamples,
+    int& numAdded)
+{
+    numAdded = 0;
+    if (modelDirty)
+    {
+        loadModel();
+    }
+    const int numFrames = static_cast<int>(targets.size());
+    const int numInputs = numFrames == 0 ? 0 : static_cast<int>(inputs.size()) / numFrames;
+    if (numFrames == 0 || numInputs == 0 || static_cast<int>(inputs.size()) != numFrames * numInputs
+        || (model.numExs > 0 && numInputs != model.numInputs))
+    {
+        return MS::kFailure;
+    }
+    const SrtRbfModel original = model;
+
+    // poses of all the frames relativized like addExample
+    std::vector<PoseVariable> primAbs(numFrames * numInputs);
+    std::vector<PoseVariable> secAbs(numFrames);
+    ParallelFor(0, numFrames, [&](int fid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            primAbs[fid * numInputs + iid] = PoseVariable::fromMatrix(inputs[fid * numInputs + iid]);
+        }
+        secAbs[fid] = PoseVariable::fromMatrix(targets[fid]);
+    });
+    const bool isEmpty = model.numExs == 0;
+    if (isEmpty)
+    {
+        // the first frame becomes the reference example
+        model.numInputs = numInputs;
+        model.primRef.assign(primAbs.begin(), primAbs.begin() + numInputs);
+    }
+    const MQuaternion sref = isEmpty ? secAbs[0].rotate : model.secondary[0].rotate;
+    std::vector<std::vector<PoseVariable>> primPoses(numFrames, std::vector<PoseVariable>(numInputs));
+    std::vector<PoseVariable> secPoses(numFrames);
+    ParallelFor(0, numFrames, [&](int fid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            PoseVariable pose = primAbs[fid * numInputs + iid];
+            const MQuaternion bq = model.primRef[iid].rotate;
+            pose.ontoHemisphere(bq);
+            pose.rotate = bq.conjugate() * pose.rotate;
+            primPoses[fid][iid] = pose;
+        }
+        PoseVariable secPose = secAbs[fid];
+        secPose.ontoHemisphere(sref);
+        secPose.rotate = PoseVariable::qlndiff(sref, secPose.rotate);
+        secPoses[fid] = secPose;
+    });
+
+    // distance of every frame to the nearest example
+    std::vector<double> minDist(numFrames, std::numeric_limits<double>::max());
+    auto addCenter = [&](const std::vector<PoseVariable>& center)
+    {
+        ParallelFor(0, numFrames, [&](int fid)
+        {
+            minDist[fid] = std::min(minDist[fid], model.distance(center, primPoses[fid]));
+        });
+    };
+    for (int eid = 0; eid < model.numExs; ++eid)
+    {
+        addCenter(model.primary[eid]);
+    }
+    if (isEmpty)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            primPoses[0][iid].rotate = MQuaternion::identity;
+        }
+        model.primary.push_back(primPoses[0]);
+        model.secondary.push_back(secAbs[0]);
+        addCenter(primPoses[0]);
+        ++numAdded;
+    }
+    while (numAdded < maxExamples)
+    {
+        const int fid = static_cast<int>(std::max_element(minDist.begin(), minDist.end()) - minDist.begin());
+        // the same threshold as the duplication check of addExample
+        if (minDist[fid] < 1.0e-3)
+        {
+            break;
+        }
+        model.primary.push_back(primPoses[fid]);
+        model.secondary.push_back(secPoses[fid]);
+        addCenter(primPoses[fid]);
+        ++numAdded;
+    }
+    model.numExs = static_cast<int>(model.primary.size());
+    if (numAdded == 0)
+    {
+        return MS::kSuccess;
+    }
+
+    // refit once with all the added examples
+    MFnDependencyNode fnThisNode(thisMObject());
+    double residual = 0.0;
+    const bool solved = fitModel(residual, true);
+    if (!solved)
+    {
+        model = original;
+        numAdded = 0;
+        return MS::kFailure;
+    }
+    if (model.solver != 0)
+    {
+        fnThisNode.findPlug(residualAttr, true).setValue(residual);
+    }
+    storeModel();
+    storeExamples();
+    model.update();
+    modelDirty = false;
+    return MS::kSuccess;
+}
+
+///
+
+std::vector<SrtRbfNode*>
+NodesFromActiveSelection()
+{
+    MSelectionList asl;
+    MGlobal::getActiveSelectionList(asl);
+    std::vector<SrtRbfNode*> SrtRbfNodes;
+    for (MItSelectionList slit(asl, MFn::kPluginDependNode); !slit.isDone(); slit.next())
+    {
+        MObject node;
+        slit.getDependNode(node);
+        MFnDependencyNode nodeFn(node);
+        SrtRbfNode* mNode = dynamic_cast<SrtRbfNode*>(nodeFn.userNode());
+        if (mNode != nullptr)
+        {
+            SrtRbfNodes.push_back(mNode);
+        }
+    }
+    return SrtRbfNodes;
+}
+
+// keeps the version of the last edit if it stored new trained data, adding
+// its memory to bytes
+void
+KeepEdit(
+    SrtRbfNode* controller,
+    std::vector<std::pair<MObject, SrtRbfVersion>>& edits,
+    size_t& bytes)
+{
+    if (controller->endEdit(edits.back().second))
+    {
+        bytes += edits.back().second.bytes();
+    }
+    else
+    {
+        edits.pop_back();
+    }
+}
+
+void
+DisplayUndoMemory(
+    const std::vector<std::pair<MObject, SrtRbfVersion>>& edits,
+    size_t bytes)
+{
+    if (!edits.empty())
+    {
+        MString msg = "Memory kept for undo: ";
+        msg += static_cast<double>(bytes) / 1024.0;
+        msg += " KB";
+        MGlobal::displayInfo(msg);
+    }
+}
+
+// exchanges the trained data of the edited nodes with their versions, the
+// last edit first for undo
+void
+SwapVersions(
+    std::vector<std::pair<MObject, SrtRbfVersion>>& edits,
+    bool undo)
+{
+    for (size_t i = 0; i < edits.size(); ++i)
+    {
+        std::pair<MObject, SrtRbfVersion>& edit = edits[undo ? edits.size() - 1 - i : i];
+        MFnDependencyNode fnNode(edit.first);
+        SrtRbfNode* controller = dynamic_cast<SrtRbfNode*>(fnNode.userNode());
+        if (controller != nullptr)
+        {
+            controller->swapVersion(edit.second);
+        }
+    }
+}
+
+MStatus
+CreateSrtRbfNode::doIt(
+    const MArgList& args)
+{
+    MDGModifier dgModifier;
+    MSelectionList asl;
+    MGlobal::getActiveSelectionList(asl);
+    for (MItSelectionList slit(asl, MFn::kTransform); !slit.isDone(); slit.next())
+    {
+        MObject node = MObject::kNullObj;
+        if (slit.getDependNode(node) != MS::kSuccess)
+        {
+            continue;
+        }
+        if (node.apiType() != MFn::kTransform && node.apiType() != MFn::kJoint)
+        {
+            continue;
+        }
+        MFnDependencyNode nodeFn(node);
+        if (nodeFn.hasAttribute(SrtRbfNode::className))
+        {
+            continue;
+        }
+        MFnDependencyNode srtRbfNode(dgModifier.createNode(SrtRbfNode::className));
+        MFnMessageAttribute srtRbfAttrFn;
+        MObject srtRbfAttr = srtRbfAttrFn.create(SrtRbfNode::className, SrtRbfNode::className);
+        dgModifier.addAttribute(node, srtRbfAttr);
+        MPlug srcPlug = srtRbfNode.findPlug(SrtRbfNode::targetAttrName[0], true);
+        MPlug dstPlug = nodeFn.findPlug(srtRbfAttr, true);
+        MStatus x = dgModifier.connect(srcPlug, dstPlug);
+        if (args.length() > 0)
+        {
+            dgModifier.renameNode(srtRbfNode.object(), args.asString(0));
+        }
+        dgModifier.doIt();
+        appendToResult(srtRbfNode.name());
+    }
+    return MS::kSuccess;
+}
+
+MStatus
+AddSrtRbfExample::doIt(
+    const MArgList& args)
+{
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    // reserved so that the versions are never copied
+    edits.clear();
+    edits.reserve(controllers.size());
+    size_t bytes = 0;
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        edits.push_back(std::make_pair((*it)->thisMObject(), SrtRbfVersion()));
+        (*it)->beginEdit(edits.back().second);
+        (*it)->addExample(args.length() == 0 ? 0 : args.asDouble(0), args.length() < 2 ? -1 : args.asInt(1));
+        KeepEdit(*it, edits, bytes);
+    }
+    DisplayUndoMemory(edits, bytes);
+    return MS::kSuccess;
+}
+
+MStatus
+AddSrtRbfExample::undoIt()
+{
+    SwapVersions(edits, true);
+    return MS::kSuccess;
+}
+
+MStatus
+AddSrtRbfExample::redoIt()
+{
+    SwapVersions(edits, false);
+    return MS::kSuccess;
+}
+
+bool
+AddSrtRbfExample::isUndoable() const
+{
+    return !edits.empty();
+}
+
+MStatus
+CompressSrtRbfNode::doIt(
+    const MArgList& args)
+{
+    const double tolerance = args.length() == 0 ? 1.0e-3 : args.asDouble(0);
+    MDoubleArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    // reserved so that the versions are never copied
+    edits.clear();
+    edits.reserve(controllers.size());
+    size_t bytes = 0;
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        int numBefore = 0, numAfter = 0;
+        double maxError = 0.0;
+        edits.push_back(std::make_pair((*it)->thisMObject(), SrtRbfVersion()));
+        (*it)->beginEdit(edits.back().second);
+        const MStatus status = (*it)->compress(tolerance, numBefore, numAfter, maxError);
+        KeepEdit(*it, edits, bytes);
+        if (status != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot compress " + MFnDependencyNode((*it)->thisMObject()).name());
+            continue;
+        }
+        MString msg = MFnDependencyNode((*it)->thisMObject()).name();
+        msg += ": ";
+        msg += numBefore;
+        msg += " -> ";
+        msg += numAfter;
+        msg += " examples, max error ";
+        msg += maxError;
+        MGlobal::displayInfo(msg);
+        result.append(numBefore);
+        result.append(numAfter);
+        result.append(maxError);
+    }
+    DisplayUndoMemory(edits, bytes);
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+CompressSrtRbfNode::undoIt()
+{
+    SwapVersions(edits, true);
+    return MS::kSuccess;
+}
+
+MStatus
+CompressSrtRbfNode::redoIt()
+{
+    SwapVersions(edits, false);
+    return MS::kSuccess;
+}
+
+bool
+CompressSrtRbfNode::isUndoable() const
+{
+    return !edits.empty();
+}
+
+MStatus
+TuneSrtRbfNode::doIt(
+    const MArgList& args)
+{
+    const int numPasses = args.length() == 0 ? 2 : args.asInt(0);
+    MDoubleArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    // reserved so that the versions are never copied
+    edits.clear();
+    edits.reserve(controllers.size());
+    size_t bytes = 0;
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        double errorBefore = 0.0, errorAfter = 0.0;
+        edits.push_back(std::make_pair((*it)->thisMObject(), SrtRbfVersion()));
+        (*it)->beginEdit(edits.back().second);
+        const MStatus status = (*it)->tune(numPasses, errorBefore, errorAfter);
+        KeepEdit(*it, edits, bytes);
+        if (status != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot tune " + MFnDependencyNode((*it)->thisMObject()).name());
+            continue;
+        }
+        MString msg = MFnDependencyNode((*it)->thisMObject()).name();
+        msg += ": leave-one-out error ";
+        msg += errorBefore;
+        msg += " -> ";
+        msg += errorAfter;
+        MGlobal::displayInfo(msg);
+        result.append(errorBefore);
+        result.append(errorAfter);
+    }
+    DisplayUndoMemory(edits, bytes);
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+TuneSrtRbfNode::undoIt()
+{
+    SwapVersions(edits, true);
+    return MS::kSuccess;
+}
+
+MStatus
+TuneSrtRbfNode::redoIt()
+{
+    SwapVersions(edits, false);
+    return MS::kSuccess;
+}
+
+bool
+TuneSrtRbfNode::isUndoable() const
+{
+    return !edits.empty();
+}
+
+MStatus
+ValidateSrtRbfPrecision::doIt(
+    const MArgList& args)
+{
+    const int numSamples = args.length() == 0 ? 1000 : args.asInt(0);
+    MDoubleArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        double maxTranslate = 0.0, maxRotate = 0.0, maxScale = 0.0;
+        if ((*it)->validatePrecision(numSamples, maxTranslate, maxRotate, maxScale) != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot validate " + MFnDependencyNode((*it)->thisMObject()).name());
+            continue;
+        }
+        MString msg = MFnDependencyNode((*it)->thisMObject()).name();
+        msg += ": max single-precision deviation translate ";
+        msg += maxTranslate;
+        msg += ", rotate ";
+        msg += maxRotate;
+        msg += " deg, scale ";
+        msg += maxScale;
+        MGlobal::displayInfo(msg);
+        result.append(maxTranslate);
+        result.append(maxRotate);
+        result.append(maxScale);
+    }
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+ValidateSrtRbfPaths::doIt(
+    const MArgList& args)
+{
+    const int numSamples = args.length() == 0 ? 1000 : args.asInt(0);
+    MIntArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        const MString name = MFnDependencyNode((*it)->thisMObject()).name();
+        std::vector<SrtRbfPathReport> reports;
+        if ((*it)->validatePaths(numSamples, reports) != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot validate " + name);
+            continue;
+        }
+        MGlobal::displayInfo(name + ": path, max translate, rotate (deg), scale deviation, us/eval");
+        int numFailures = 0;
+        for (const SrtRbfPathReport& r : reports)
+        {
+            char line[256];
+            const bool approximate = r.translateTolerance == 0.0;
+            const bool pass = approximate || (r.maxTranslate <= r.translateTolerance
+                && r.maxScale <= r.translateTolerance && r.maxRotate <= r.rotateTolerance);
+            std::snprintf(line, sizeof(line), "  %-12s %12.3e %12.3e %12.3e %10.3f  %s",
+                r.name.asChar(), r.maxTranslate, r.maxRotate, r.maxScale, r.microseconds,
+                approximate ? "approximate" : pass ? "ok" : "FAILED");
+            if (pass)
+            {
+                MGlobal::displayInfo(line);
+            }
+            else
+            {
+                MGlobal::displayWarning(line);
+                ++numFailures;
+            }
+        }
+        result.append(numFailures);
+    }
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+DifferentiateSrtRbf::doIt(
+    const MArgList& args)
+{
+    const double step = args.length() == 0 ? 1.0e-6 : args.asDouble(0);
+    MDoubleArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
     {
-        return MS::kFailure;
+        Eigen::MatrixXd jac;
+        double maxError = 0.0;
+        const MString name = MFnDependencyNode((*it)->thisMObject()).name();
+        const MStatus status = (*it)->jacobian(step, jac, maxError);
+        if (status == MS::kNotImplemented)
+        {
+            MGlobal::displayWarning(name + ": the Jacobian is undefined at the antipode of an example");
+            continue;
+        }
+        if (status != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot differentiate " + name);
+            continue;
+        }
+        MString msg = name;
+        msg += ": 9 x ";
+        msg += static_cast<int>(jac.cols());
+        msg += " Jacobian";
+        if (step > 0)
+        {
+            msg += ", max difference from central differences ";
+            msg += maxError;
+        }
+        if (maxError > 1.0e-4 * std::max(1.0, jac.cwiseAbs().maxCoeff()))
+        {
+            MGlobal::displayWarning(msg);
+        }
+        else
+        {
+            MGlobal::displayInfo(msg);
+        }
+        for (int r = 0; r < jac.rows(); ++r)
+        {
+            for (int c = 0; c < jac.cols(); ++c)
+            {
+                result.append(jac(r, c));
+            }
+        }
     }
-    MObject secNode = dparray[0].node();
-    MFnTransform target(secNode);
-    MTransformationMatrix targetTransform = target.transformation();
-    MPlug secPlug = fnThisNode.findPlug(secondaryAttrName[0], true);
-    MPlug refPlug = fnThisNode.findPlug(primRefAttrName[0], true);
-    MPlug priPlug = fnThisNode.findPlug(primaryAttrName[0], true);
+    setResult(result);
+    return MS::kSuccess;
+}
 
-    if (numExsPlug.asInt() == 0)
+MStatus
+ExportSrtRbf::doIt(
+    const MArgList& args)
+{
+    if (args.length() == 0)
     {
-        PoseVariable secPose = PoseVariable::fromMatrix(targetTransform.asMatrix());
-        PoseVariable::setPoseTo(secPlug, 0, secPose);
-        for (int i = 0; i < numInputs; ++i)
+        MGlobal::displayError("ExportSrtRbf: file path is required");
+        return MS::kInvalidParameter;
+    }
+    const MString path = args.asString(0);
+    MDoubleArray result;
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    {
+        // one file per node; the node name is inserted before the extension if several are selected
+        const MString name = MFnDependencyNode((*it)->thisMObject()).name();
+        MString nodePath = path;
+        if (controllers.size() > 1)
         {
-            PoseVariable::setPoseTo(refPlug, 0, i, numInputs, primPoses[i]);
-            primPoses[i].rotate = MQuaternion::identity;
-            PoseVariable::setPoseTo(priPlug, 0, i, numInputs, primPoses[i]);
+            const int dot = path.rindex('.');
+            const int slash = std::max(path.rindex('/'), path.rindex('\\'));
+            nodePath = dot > slash
+                ? path.substring(0, dot - 1) + "_" + name + path.substring(dot, path.length() - 1)
+                : path + "_" + name;
+        }
+        double maxError = 0.0;
+        if ((*it)->exportRuntime(nodePath, maxError) != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot export " + name);
+            continue;
         }
-        numExsPlug.setValue(1);
+        MString msg = name;
+        msg += " -> ";
+        msg += nodePath;
+        msg += ", max difference from the node ";
+        msg += maxError;
+        if (maxError > 1.0e-9)
+        {
+            MGlobal::displayWarning(msg);
+        }
+        else
+        {
+            MGlobal::displayInfo(msg);
+        }
+        result.append(maxError);
     }
-    else
+    setResult(result);
+    return MS::kSuccess;
+}
+
+MStatus
+RecordSrtRbf::doIt(
+    const MArgList& args)
+{
+    if (args.length() == 0)
     {
-        PoseVariable secPose = PoseVariable::fromMatrix(targetTransform.asMatrix());
-        // relativize
-        MQuaternion sref = PoseVariable::getRotateFrom(secPlug, 0);
-        secPose.ontoHemisphere(sref);
-        secPose.rotate = PoseVariable::qlndiff(sref, secPose.rotate);
-        double ra = std::sqrt(PoseVariable::qdot(secPose.rotate, secPose.rotate));
-        if (add != 0 && std::fabs(ra) > 0)
+        MGlobal::displayError("RecordSrtRbf: file path is required");
+        return MS::kInvalidParameter;
+    }
+    const MString path = args.asString(0);
+    const double start = args.length() > 1 ? args.asDouble(1) : MAnimControl::minTime().as(MTime::uiUnit());
+    const double end   = args.length() > 2 ? args.asDouble(2) : MAnimControl::maxTime().as(MTime::uiUnit());
+    const double step  = args.length() > 3 ? args.asDouble(3) : 1.0;
+    if (step <= 0.0 || end < start)
+    {
+        MGlobal::displayError("RecordSrtRbf: invalid frame range");
+        return MS::kInvalidParameter;
+    }
+    const int numFrames = static_cast<int>(std::floor((end - start) / step + 1.0e-6)) + 1;
+
+    // trained data of all SrtRbfNodes in the scene
+    std::vector<SrtRbfNode*> controllers;
+    std::vector<std::vector<double>> images;
+    std::vector<SrtRbfRecordNode> table;
+    int numMatrices = 0;
+    for (MItDependencyNodes it(MFn::kPluginDependNode); !it.isDone(); it.next())
+    {
+        MFnDependencyNode fnNode(it.thisNode());
+        if (fnNode.typeId() != SrtRbfNode::SrtRbfNodeID)
         {
-            secPose.rotate = (ra + 0.5 * add) / ra * secPose.rotate;
+            continue;
         }
-        for (int i = 0; i < numInputs; ++i)
+        SrtRbfNode* controller = static_cast<SrtRbfNode*>(fnNode.userNode());
+        std::vector<double> image;
+        if (!controller->runtimeImage(image))
         {
-            MQuaternion primrefr = PoseVariable::getRotateFrom(refPlug, i);
-            primPoses[i].ontoHemisphere(primrefr);
-            primPoses[i].rotate = primrefr.conjugate() * primPoses[i].rotate;
+            continue;
         }
-        addExampleSupport(primPoses, secPose);
+        SrtRbfRecordNode entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.size = image.size() * sizeof(double);
+        entry.numInputs = reinterpret_cast<const SrtRbfFileHeader*>(image.data())->numInputs;
+        entry.firstMatrix = numMatrices;
+        std::strncpy(entry.name, fnNode.name().asChar(), sizeof(entry.name) - 1);
+        numMatrices += entry.numInputs;
+        controllers.push_back(controller);
+        images.push_back(image);
+        table.push_back(entry);
+    }
+    if (controllers.empty())
+    {
+        MGlobal::displayError("RecordSrtRbf: no trained SrtRbfNode in the scene");
+        return MS::kFailure;
+    }
 
-        // duplicated example
-        if (sign != 0)
+    // sample all nodes frame by frame; missing inputs are recorded as identity
+    std::vector<double> inputs(static_cast<size_t>(numFrames) * numMatrices * 16, 0.0);
+    std::vector<MMatrix> sample;
+    for (int fid = 0; fid < numFrames; ++fid)
+    {
+        MDGContext context(MTime(start + fid * step, MTime::uiUnit()));
+        MDGContextGuard guard(context);
+        for (size_t nid = 0; nid < controllers.size(); ++nid)
         {
-            PoseVariable dupSecPose = secPose;
-            dupSecPose.rotate = sign * secPose.rotate;
-            std::vector<PoseVariable> dupPrimPose = primPoses;
-            bool isSingular = false;
-            for (int i = 0; i < numInputs; ++i)
-            {
-                if (std::abs(primPoses[i].rotate.w) < 1.0e-6)
-                {
-                    dupPrimPose[i].rotate = -dupPrimPose[i].rotate;
-                    isSingular = true;
-                }
-            }
-            if (isSingular)
+            sample.clear();
+            controllers[nid]->sampleInputs(sample);
+            for (int iid = 0; iid < table[nid].numInputs; ++iid)
             {
-                bool isOriginal = true;
-                for (int eid = 0; eid < numExsPlug.asInt(); ++eid)
-                {
-                    auto ppose = PoseVariable::getPosesFrom(priPlug, eid, numInputs);
-                    if (PoseVariable::dissimilarity(ppose, dupPrimPose, distType) < 1.0e-6)
-                    {
-                        isOriginal = false;
-                        break;
-                    }
-                }
-                if (isOriginal)
-                {
-                    MGlobal::displayInfo("Duplicating example");
-                    addExampleSupport(dupPrimPose, dupSecPose);
-                }
+                const MMatrix& m = iid < static_cast<int>(sample.size()) ? sample[iid] : MMatrix::identity;
+                m.get(reinterpret_cast<double(*)[4]>(inputs.data()
+                    + (static_cast<size_t>(fid) * numMatrices + table[nid].firstMatrix + iid) * 16));
             }
         }
     }
-    return status;
+
+    // header, node table, exports and inputs in aligned sections
+    auto align = [](uint64_t offset) { return (offset + SRTRBF_ALIGNMENT - 1) / SRTRBF_ALIGNMENT * SRTRBF_ALIGNMENT; };
+    SrtRbfRecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SRTRBF_RECORD_MAGIC, sizeof(header.magic));
+    header.version     = SRTRBF_RECORD_VERSION;
+    header.endianTag   = SRTRBF_ENDIAN_TAG;
+    header.headerSize  = sizeof(SrtRbfRecordHeader);
+    header.numNodes    = static_cast<int32_t>(table.size());
+    header.numFrames   = numFrames;
+    header.numMatrices = numMatrices;
+    header.frameStart  = start;
+    header.frameStep   = step;
+    header.nodesOffset = align(sizeof(SrtRbfRecordHeader));
+    uint64_t offset = align(header.nodesOffset + table.size() * sizeof(SrtRbfRecordNode));
+    for (SrtRbfRecordNode& entry : table)
+    {
+        entry.offset = offset;
+        offset = align(offset + entry.size);
+    }
+    header.inputsOffset = offset;
+    header.fileSize     = align(offset + inputs.size() * sizeof(double));
+
+    std::vector<char> buffer(header.fileSize, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    std::memcpy(buffer.data() + header.nodesOffset, table.data(), table.size() * sizeof(SrtRbfRecordNode));
+    for (size_t nid = 0; nid < table.size(); ++nid)
+    {
+        std::memcpy(buffer.data() + table[nid].offset, images[nid].data(), table[nid].size);
+    }
+    std::memcpy(buffer.data() + header.inputsOffset, inputs.data(), inputs.size() * sizeof(double));
+    std::ofstream file(path.asChar(), std::ios::binary | std::ios::trunc);
+    file.write(buffer.data(), buffer.size());
+    if (!file)
+    {
+        MGlobal::displayError("Cannot write " + path);
+        return MS::kFailure;
+    }
+    MString msg = "Recorded ";
+    msg += static_cast<int>(table.size());
+    msg += " nodes over ";
+    msg += numFrames;
+    msg += " frames to ";
+    msg += path;
+    MGlobal::displayInfo(msg);
+    setResult(static_cast<int>(table.size()));
+    return MS::kSuccess;
 }
 
 MStatus
-SrtRbfNode::gotoExample(
-    int eid)
+SampleSrtRbfExamples::doIt(
+    const MArgList& args)
 {
-    MFnDependencyNode fnThisNode(thisMObject());
-    MPlug nePlug = fnThisNode.findPlug(numExsAttrName[0], true);
-    const int numExs = nePlug.asInt();
-    if (eid >= numExs)
+    // frame range, step and max # of added examples; the playback range by default
+    const double start = args.length() > 0 ? args.asDouble(0) : MAnimControl::minTime().as(MTime::uiUnit());
+    const double end   = args.length() > 1 ? args.asDouble(1) : MAnimControl::maxTime().as(MTime::uiUnit());
+    const double step  = args.length() > 2 ? args.asDouble(2) : 1.0;
+    const int maxExamples = args.length() > 3 ? args.asInt(3) : 50;
+    if (step <= 0.0 || end < start)
     {
+        MGlobal::displayError("SampleSrtRbfExamples: invalid frame range");
         return MS::kInvalidParameter;
     }
+    const int numFrames = static_cast<int>(std::floor((end - start) / step + 1.0e-6)) + 1;
 
-    MPlug iplug = fnThisNode.findPlug(inputAttrName[0], true);
-    MPlug priPlug = fnThisNode.findPlug(primaryAttrName[0], true);
-    const int numInputs = iplug.numElements();
-    const std::vector<PoseVariable> primPoses =
-        PoseVariable::getPosesFrom(priPlug, eid, numInputs);
-    for (int i = 0; i < numInputs; ++i)
+    // read all nodes frame by frame without changing the current time
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    std::vector<std::vector<MMatrix>> inputs(controllers.size());
+    std::vector<std::vector<MMatrix>> targets(controllers.size());
+    std::vector<char> hasTarget(controllers.size(), 1);
+    for (int fid = 0; fid < numFrames; ++fid)
     {
-        MPlug ip = iplug.elementByLogicalIndex(i).source();
-        if (ip.isNull())
+        MDGContext context(MTime(start + fid * step, MTime::uiUnit()));
+        MDGContextGuard guard(context);
+        for (size_t nid = 0; nid < controllers.size(); ++nid)
         {
-            continue;
+            MMatrix target;
+            hasTarget[nid] = hasTarget[nid] && controllers[nid]->sampleTarget(target);
+            targets[nid].push_back(target);
+            controllers[nid]->sampleInputs(inputs[nid]);
         }
-        MFnTransform source(ip.node());
-        source.setTranslation(primPoses[i].translate, MSpace::kTransform);
-        double sv[3] = { primPoses[i].scale.x, primPoses[i].scale.y, primPoses[i].scale.z };
-        source.setScale(sv);
-        source.setRotation(primPoses[i].rotate);
     }
-    MVector ss(1.0, 1.0, 1.0);
-    MVector st(0, 0, 0);
-    MQuaternion sq(0, 0, 0, 1.0);
-    MPlug secPlug = fnThisNode.findPlug(secondaryAttrName[0], true);
-    if (!secPlug.isNull())
+
+    MIntArray result;
+    // reserved so that the versions are never copied
+    edits.clear();
+    edits.reserve(controllers.size());
+    size_t bytes = 0;
+    for (size_t nid = 0; nid < controllers.size(); ++nid)
     {
-        st = PoseVariable::getTranslateFrom(secPlug, eid);
-        sq = PoseVariable::getRotateFrom(secPlug, eid);
-        ss = PoseVariable::getScaleFrom(secPlug, eid);
-        if (eid > 0)
+        const MString name = MFnDependencyNode(controllers[nid]->thisMObject()).name();
+        int numAdded = 0;
+        MStatus status = MS::kFailure;
+        if (hasTarget[nid])
         {
-            sq = PoseVariable::getRotateFrom(secPlug, 0) * sq.exp();
+            edits.push_back(std::make_pair(controllers[nid]->thisMObject(), SrtRbfVersion()));
+            controllers[nid]->beginEdit(edits.back().second);
+            status = controllers[nid]->learnSamples(inputs[nid], targets[nid], maxExamples, numAdded);
+            KeepEdit(controllers[nid], edits, bytes);
         }
+        if (status != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot sample examples of " + name);
+            continue;
+        }
+        MString msg = name;
+        msg += ": added ";
+        msg += numAdded;
+        msg += " examples from ";
+        msg += numFrames;
+        msg += " frames";
+        MGlobal::displayInfo(msg);
+        result.append(numAdded);
     }
-    return MStatus::kSuccess;
+    DisplayUndoMemory(edits, bytes);
+    setResult(result);
+    return MS::kSuccess;
 }
 
-///
+MStatus
+SampleSrtRbfExamples::undoIt()
+{
+    SwapVersions(edits, true);
+    return MS::kSuccess;
+}
 
-std::vector<SrtRbfNode*>
-NodesFromActiveSelection()
+MStatus
+SampleSrtRbfExamples::redoIt()
 {
-    MSelectionList asl;
-    MGlobal::getActiveSelectionList(asl);
-    std::vector<SrtRbfNode*> SrtRbfNodes;
-    for (MItSelectionList slit(asl, MFn::kPluginDependNode); !slit.isDone(); slit.next())
+    SwapVersions(edits, false);
+    return MS::kSuccess;
+}
+
+bool
+SampleSrtRbfExamples::isUndoable() const
+{
+    return !edits.empty();
+}
+
+// memory and cost of the selected SrtRbfNodes, or of all of them in the scene
+// if none is selected, as JSON
+MStatus
+SrtRbfStats::doIt(
+    const MArgList& args)
+{
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    if (controllers.empty())
     {
-        MObject node;
-        slit.getDependNode(node);
-        MFnDependencyNode nodeFn(node);
-        SrtRbfNode* mNode = dynamic_cast<SrtRbfNode*>(nodeFn.userNode());
-        if (mNode != nullptr)
+        for (MItDependencyNodes it(MFn::kPluginDependNode); !it.isDone(); it.next())
         {
-            SrtRbfNodes.push_back(mNode);
+            MFnDependencyNode fnNode(it.thisNode());
+            if (fnNode.typeId() == SrtRbfNode::SrtRbfNodeID)
+            {
+                controllers.push_back(static_cast<SrtRbfNode*>(fnNode.userNode()));
+            }
         }
     }
-    return SrtRbfNodes;
+    auto bytesFields = [](const SrtRbfNodeStats& s)
+    {
+        char fields[256];
+        std::snprintf(fields, sizeof(fields),
+            "\"storedBytes\": %llu, \"exampleBytes\": %llu, \"solveBytes\": %llu, \"cacheBytes\": %llu, \"flopsPerFrame\": %.0f",
+            static_cast<unsigned long long>(s.storedBytes), static_cast<unsigned long long>(s.exampleBytes),
+            static_cast<unsigned long long>(s.solveBytes), static_cast<unsigned long long>(s.cacheBytes), s.flops);
+        return std::string(fields);
+    };
+    SrtRbfNodeStats total = {};
+    std::string json = "{\"nodes\": [";
+    for (size_t i = 0; i < controllers.size(); ++i)
+    {
+        SrtRbfNodeStats s;
+        controllers[i]->stats(s);
+        const MString nodeName = MFnDependencyNode(controllers[i]->thisMObject()).name();
+        std::string name;
+        for (const char* c = nodeName.asChar(); *c != '\0'; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                name += '\\';
+            }
+            name += *c;
+        }
+        char fields[256];
+        std::snprintf(fields, sizeof(fields), "\"examples\": %d, \"inputs\": %d, \"centers\": %d, \"solver\": %d, ",
+            s.numExs, s.numInputs, s.numCenters, s.solver);
+        char speculation[256];
+        std::snprintf(speculation, sizeof(speculation), ", \"speculating\": %s, \"speculativeFrames\": %ld, "
+            "\"sampleMicroseconds\": %.1f, \"speculativeHits\": %ld, \"evaluateMicroseconds\": %.1f",
+            s.speculating ? "true" : "false", s.numSampled, s.sampleMicroseconds, s.numHits, s.evaluateMicroseconds);
+        json += i == 0 ? "\n  {" : ",\n  {";
+        json += "\"name\": \"" + name + "\", " + fields + bytesFields(s) + speculation + "}";
+        total.numExs       += s.numExs;
+        total.storedBytes  += s.storedBytes;
+        total.exampleBytes += s.exampleBytes;
+        total.solveBytes   += s.solveBytes;
+        total.cacheBytes   += s.cacheBytes;
+        total.flops        += s.flops;
+    }
+    char fields[64];
+    std::snprintf(fields, sizeof(fields), "\"nodes\": %d, \"examples\": %d, ",
+        static_cast<int>(controllers.size()), total.numExs);
+    json += "],\n \"total\": {" + std::string(fields) + bytesFields(total) + "}}";
+    setResult(MString(json.c_str()));
+    return MS::kSuccess;
 }
 
+// refits the selected SrtRbfNodes, or all of them in the scene if none is
+// selected. The training data are copied on the main thread, the systems are
+// solved on all the cores, one per core with the loops inside each solve run
+// serially, and the results are set by one modifier so that the command is
+// undone at once.
 MStatus
-CreateSrtRbfNode::doIt(
+RetrainSrtRbf::doIt(
     const MArgList& args)
 {
-    MDGModifier dgModifier;
-    MSelectionList asl;
-    MGlobal::getActiveSelectionList(asl);
-    for (MItSelectionList slit(asl, MFn::kTransform); !slit.isDone(); slit.next())
+    std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
+    if (controllers.empty())
     {
-        MObject node = MObject::kNullObj;
-        if (slit.getDependNode(node) != MS::kSuccess)
+        for (MItDependencyNodes it(MFn::kPluginDependNode); !it.isDone(); it.next())
         {
-            continue;
+            MFnDependencyNode fnNode(it.thisNode());
+            if (fnNode.typeId() == SrtRbfNode::SrtRbfNodeID)
+            {
+                controllers.push_back(static_cast<SrtRbfNode*>(fnNode.userNode()));
+            }
         }
-        if (node.apiType() != MFn::kTransform && node.apiType() != MFn::kJoint)
+    }
+    const auto startTime = std::chrono::steady_clock::now();
+    std::vector<SrtRbfRetrain> jobs(controllers.size());
+    std::vector<int> order;
+    order.reserve(controllers.size());
+    for (size_t i = 0; i < controllers.size(); ++i)
+    {
+        if (controllers[i]->beginRetrain(jobs[i]))
         {
-            continue;
+            order.push_back(static_cast<int>(i));
         }
-        MFnDependencyNode nodeFn(node);
-        if (nodeFn.hasAttribute(SrtRbfNode::className))
+    }
+    // the largest systems first so that the workers finish together
+    std::stable_sort(order.begin(), order.end(),
+        [&jobs](int a, int b)
         {
-            continue;
+            return jobs[a].model.numExs > jobs[b].model.numExs;
+        });
+    ParallelFor(0, static_cast<int>(order.size()),
+        [&jobs, &order](int k)
+        {
+            jobs[order[k]].solve();
+        });
+
+    for (int i : order)
+    {
+        if (jobs[i].solved)
+        {
+            controllers[i]->commitRetrain(jobs[i], dgModifier);
+            retrained.push_back(controllers[i]->thisMObject());
         }
-        MFnDependencyNode srtRbfNode(dgModifier.createNode(SrtRbfNode::className));
-        MFnMessageAttribute srtRbfAttrFn;
-        MObject srtRbfAttr = srtRbfAttrFn.create(SrtRbfNode::className, SrtRbfNode::className);
-        dgModifier.addAttribute(node, srtRbfAttr);
-        MPlug srcPlug = srtRbfNode.findPlug(SrtRbfNode::targetAttrName[0], true);
-        MPlug dstPlug = nodeFn.findPlug(srtRbfAttr, true);
-        MStatus x = dgModifier.connect(srcPlug, dstPlug);
-        if (args.length() > 0)
+        else
         {
-            dgModifier.renameNode(srtRbfNode.object(), args.asString(0));
+            MString msg = "Cannot retrain ";
+            msg += MFnDependencyNode(controllers[i]->thisMObject()).name();
+            MGlobal::displayError(msg);
         }
-        dgModifier.doIt();
-        appendToResult(srtRbfNode.name());
     }
+    MStatus status = dgModifier.doIt();
+    if (!status)
+    {
+        return status;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    const int numRetrained = static_cast<int>(retrained.size());
+    MString msg = "Retrained ";
+    msg += numRetrained;
+    msg += " nodes in ";
+    msg += seconds;
+    msg += " s";
+    MGlobal::displayInfo(msg);
+    setResult(numRetrained);
     return MS::kSuccess;
 }
 
 MStatus
-AddSrtRbfExample::doIt(
+RetrainSrtRbf::undoIt()
+{
+    return dgModifier.undoIt();
+}
+
+MStatus
+RetrainSrtRbf::redoIt()
+{
+    return dgModifier.doIt();
+}
+
+bool
+RetrainSrtRbf::isUndoable() const
+{
+    return !retrained.empty();
+}
+
+MStatus
+BakeSrtRbf::doIt(
     const MArgList& args)
 {
+    // frame range and step; the playback range by default
+    const double start = args.length() > 0 ? args.asDouble(0) : MAnimControl::minTime().as(MTime::uiUnit());
+    const double end   = args.length() > 1 ? args.asDouble(1) : MAnimControl::maxTime().as(MTime::uiUnit());
+    const double step  = args.length() > 2 ? args.asDouble(2) : 1.0;
+    if (step <= 0.0 || end < start)
+    {
+        MGlobal::displayError("BakeSrtRbf: invalid frame range");
+        return MS::kInvalidParameter;
+    }
+    MTimeArray times;
+    const int numFrames = static_cast<int>(std::floor((end - start) / step + 1.0e-6)) + 1;
+    for (int fid = 0; fid < numFrames; ++fid)
+    {
+        times.append(MTime(start + fid * step, MTime::uiUnit()));
+    }
+
+    // sample all nodes frame by frame so that the shared upstream is evaluated once per frame
     std::vector<SrtRbfNode*> controllers = NodesFromActiveSelection();
-    for (auto it = controllers.begin(); it != controllers.end(); ++it)
+    std::vector<std::vector<MMatrix>> samples(controllers.size());
+    for (unsigned int fid = 0; fid < times.length(); ++fid)
     {
-        (*it)->addExample(args.length() == 0 ? 0 : args.asDouble(0), args.length() < 2 ? -1 : args.asInt(1));
+        MDGContext context(times[fid]);
+        MDGContextGuard guard(context);
+        for (size_t nid = 0; nid < controllers.size(); ++nid)
+        {
+            controllers[nid]->sampleInputs(samples[nid]);
+        }
+    }
+
+    int numBaked = 0;
+    for (size_t nid = 0; nid < controllers.size(); ++nid)
+    {
+        const MString name = MFnDependencyNode(controllers[nid]->thisMObject()).name();
+        if (controllers[nid]->bake(times, samples[nid], dgModifier, curveChange) != MS::kSuccess)
+        {
+            MGlobal::displayError("Cannot bake " + name);
+            continue;
+        }
+        ++numBaked;
     }
+    MString msg = "Baked ";
+    msg += numBaked;
+    msg += " nodes over ";
+    msg += numFrames;
+    msg += " frames";
+    MGlobal::displayInfo(msg);
+    setResult(numBaked);
     return MS::kSuccess;
 }
+
+MStatus
+BakeSrtRbf::undoIt()
+{
+    curveChange.undoIt();
+    return dgModifier.undoIt();
+}
+
+MStatus
+BakeSrtRbf::redoIt()
+{
+    MStatus status = dgModifier.doIt();
+    curveChange.redoIt();
+    return status;
+}
+
+bool
+BakeSrtRbf::isUndoable() const
+{
+    return true;
+}
@@ -8,9 +8,85 @@
 #include <maya/MPlug.h>
 #include <maya/MPlugArray.h>
 #include <maya/MObjectArray.h>
+#include <maya/MTimeArray.h>
+#include <maya/MDGModifier.h>
+#include <maya/MAnimCurveChange.h>
 #include <Eigen/Dense>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include "PoseVariable.h"
+#include "SrtRbfModel.h"
+
+// deviation of an evaluation path from the reference (ValidateSrtRbfPaths);
+// the rotation is in degrees and the tolerances are 0 for approximations
+struct SrtRbfPathReport
+{
+    MString name;
+    double  maxTranslate;
+    double  maxRotate;
+    double  maxScale;
+    double  translateTolerance;
+    double  rotateTolerance;
+    double  microseconds;  // per evaluation
+};
+
+// memory and cost of a node (SrtRbfStats)
+struct SrtRbfNodeStats
+{
+    int    numExs;
+    int    numInputs;
+    int    numCenters;
+    int    solver;
+    size_t storedBytes;   // attribute data saved with the scene
+    size_t exampleBytes;  // in-memory examples
+    size_t solveBytes;    // inverse kernel matrix or coefficients
+    size_t cacheBytes;    // derived data, per-frame buffers and speculative frames
+    double flops;         // estimated floating-point operations per evaluation
+    long   numSampled;           // frames sampled by the speculative evaluation
+    double sampleMicroseconds;   // main-thread time of reading the inputs of such a frame
+    long   numHits;              // sampled frames whose output compute took
+    double evaluateMicroseconds; // background time of evaluating such a frame
+    bool   speculating;          // false once the sampling measured slower than it saves
+};
+
+// trained data of a node before or after an edit of its examples or
+// parameters, exchanged with the node by undo and redo. When the edit kept or
+// appended examples, the examples in common stay in the node and only the
+// appended ones move here; otherwise, e.g. after CompressSrtRbfNode, the node
+// is loaded from the swapped attribute data. The solved system and the stored
+// attribute data are swapped, never copied.
+struct SrtRbfVersion
+{
+    int                                    numExs;
+    bool                                   appended;  // the examples in common are in the node
+    int                                    revision;  // model revision of the node before the edit
+    std::vector<PoseVariable>              primRef;
+    std::vector<std::vector<PoseVariable>> primary;   // examples beyond numExs of the other version
+    std::vector<PoseVariable>              secondary;
+    Eigen::MatrixXd                        invKerMat;
+    std::vector<int>                       landmarks;
+    RowMatrixXd                            coef;
+    double                                 params[4]; // scale, rotate and translate weights, and width
+    double                                 residual;
+    MObject                                data[6];   // typed attribute data of the trained data
+    size_t
+    bytes() const;
+};
+
+// training data of a node copied on the main thread by RetrainSrtRbf, so that
+// the system is solved on a worker thread without touching the node
+struct SrtRbfRetrain
+{
+    SrtRbfModel model;
+    int         numLandmarks;
+    double      tolerance;      // iterative solver
+    int         maxIterations;  // iterative solver
+    bool        solved;
+    double      residual;
+    void
+    solve();
+};
 
 class SrtRbfNode : public MPxNode
 {
@@ -30,28 +106,269 @@ public:
     static const MString rbfAttrName[3];
     static const MString distAttrName[3];
     static const MString targetAttrName[3];
+    static const MString nearestAttrName[3];
+    static const MString measureErrorAttrName[3];
+    static const MString nearestToleranceAttrName[3];
+    static const MString approxErrorAttrName[3];
+    static const MString solverAttrName[3];
+    static const MString numLandmarksAttrName[3];
+    static const MString solverToleranceAttrName[3];
+    static const MString solverIterationsAttrName[3];
+    static const MString landmarkAttrName[3];
+    static const MString coefAttrName[3];
+    static const MString residualAttrName[3];
+    static const MString scaleWeightAttrName[3];
+    static const MString rotateWeightAttrName[3];
+    static const MString translateWeightAttrName[3];
+    static const MString widthAttrName[3];
+    static const MString cacheToleranceAttrName[3];
+    static const MString cacheHitsAttrName[3];
+    static const MString cacheMissesAttrName[3];
+    static const MString singlePrecisionAttrName[3];
+    static const MString trainedModelAttrName[3];
+    static const MString qualityAttrName[3];
+    static const MString interactiveQualityAttrName[3];
+    static const MString renderQualityAttrName[3];
+    static const MString cachedQualityAttrName[3];
+    static const MString speculativeFramesAttrName[3];
+    static const MString primRefDataAttrName[3];
+    static const MString primaryDataAttrName[3];
+    static const MString secondaryDataAttrName[3];
+    static const MString invKerDataAttrName[3];
+    static const MString landmarkDataAttrName[3];
+    static const MString coefDataAttrName[3];
 //
 // attributes
 protected:
     static MObject versionAttr;
+    static MObject inputAttr;
     static MObject outputAttr;
     static MObject numExsAttr;
     static MObject affinityAttr;
     static MObject rbfAttr;
+    static MObject distAttr;
     static MObject targetAttr;
+    static MObject primRefAttr;
+    static MObject primaryAttr;
+    static MObject secondaryAttr;
+    static MObject invKerMatAttr;
+    static MObject nearestAttr;
+    static MObject measureErrorAttr;
+    static MObject nearestToleranceAttr;
+    static MObject approxErrorAttr;
+    static MObject solverAttr;
+    static MObject numLandmarksAttr;
+    static MObject solverToleranceAttr;
+    static MObject solverIterationsAttr;
+    static MObject landmarkAttr;
+    static MObject coefAttr;
+    static MObject residualAttr;
+    static MObject scaleWeightAttr;
+    static MObject rotateWeightAttr;
+    static MObject translateWeightAttr;
+    static MObject widthAttr;
+    static MObject cacheToleranceAttr;
+    static MObject cacheHitsAttr;
+    static MObject cacheMissesAttr;
+    static MObject singlePrecisionAttr;
+    static MObject trainedModelAttr;
+    static MObject qualityAttr;
+    static MObject interactiveQualityAttr;
+    static MObject renderQualityAttr;
+    static MObject cachedQualityAttr;
+    static MObject speculativeFramesAttr;
+    static MObject primRefDataAttr;
+    static MObject primaryDataAttr;
+    static MObject secondaryDataAttr;
+    static MObject invKerDataAttr;
+    static MObject landmarkDataAttr;
+    static MObject coefDataAttr;
 //
-// interpolation weight
+// trained data
 private:
-    Eigen::VectorXd weight;
+    SrtRbfModel model;
+    bool modelDirty;
+    int modelRevision; // incremented whenever the trained data are dirtied
+    void
+    loadModel();
+    bool
+    fitModel(
+        double& residual,
+        bool showProgress);
+    void
+    storeModel();
+    void
+    storeExamples();
+//
+// trained data shared with SrtRbfBatchNode and the background tasks
+public:
+    const SrtRbfModel&
+    trainedModel();
+    std::shared_ptr<const SrtRbfModel>
+    modelSnapshot();
+private:
+    std::shared_ptr<const SrtRbfModel> snapshot;
+    int snapshotRevision;
+//
+// undo and redo of example edits
+public:
+    void
+    beginEdit(
+        SrtRbfVersion& version);
+    bool
+    endEdit(
+        SrtRbfVersion& version);
+    void
+    swapVersion(
+        SrtRbfVersion& version);
+private:
+    const SrtRbfVersion* editVersion; // between beginEdit and endEdit
+    void
+    trainedDataPlugs(
+        MPlug plugs[6]) const;
+//
+// batch retraining (RetrainSrtRbf)
+public:
+    bool
+    beginRetrain(
+        SrtRbfRetrain& job);
+    void
+    commitRetrain(
+        const SrtRbfRetrain& job,
+        MDGModifier& modifier) const;
+//
+// migration of the trained data stored by older versions
+public:
+    void
+    migrateLegacyData();
+    static void
+    migrateScene(
+        void* clientData);
+//
+// last evaluation
+private:
+    std::vector<MMatrix> inputMatrices;
+    std::vector<MMatrix> lastInputs;
+    MMatrix lastOutput;
+    double lastApproxError;
+    bool lastValid;
+    int cacheHits;
+    int cacheMisses;
+    bool
+    isLastInputs(
+        double tolerance) const;
+//
+// per-input cache of relativized inputs and partial squared distances,
+// and the interpolation weight
+private:
+    std::vector<MMatrix> poseInputs;
+    SrtRbfFrame frameState;
+    SrtRbfWorkspace workspace;
     void
     updateWeight(
         const MPlug& plug,
-        MDataBlock& dataBlock);
+        MDataBlock& dataBlock,
+        int k,
+        bool single);
+//
+// evaluation quality tiers
+public:
+    enum Quality
+    {
+        kQualityCustom,  // nearest and singlePrecision as they are set
+        kQualityFull,    // blend of all examples in double
+        kQualityNearest, // blend of the nearest examples
+        kQualitySingle,  // blend of all examples in float
+        kQualityFrozen,  // last output
+        kQualityAuto     // one of the above by the state of Maya
+    };
+private:
+    int lastQuality;
+    double nearestError;  // measured error of the nearest examples
+    int nearestRevision;  // model revision and k of nearestError
+    int nearestK;
+    int
+    evaluationQuality(
+        MDataBlock& dataBlock) const;
+    bool
+    nearestAllowed(
+        int k,
+        double tolerance);
+//
+// speculative evaluation of the next frames during playback
+public:
+    static void
+    speculate(
+        MTime& time,
+        void* clientData);
+    static void
+    finishSpeculation();
+private:
+    struct SpeculativeFrame
+    {
+        MTime                time;
+        int                  revision;
+        std::vector<MMatrix> inputs;
+        MMatrix              output;
+        bool                 ready;
+        SpeculativeFrame()
+            : revision(-1),
+            ready(false)
+        {
+        };
+    };
+    // ring buffer keyed by time, filled by the background worker; empty while
+    // Speculative Frames is 0
+    struct SpeculativeCache
+    {
+        std::mutex                    mutex;
+        std::vector<SpeculativeFrame> frames;
+        int                           next;
+        long                          numSampled;      // frames sampled on the main thread
+        double                        sampleSeconds;   // and the time spent on them
+        long                          numEvaluated;    // frames evaluated in the background
+        double                        evaluateSeconds; // and the time spent on them
+        long                          numHits;         // frames whose output compute took
+        bool                          off;             // sampling measured slower than evaluating
+        SpeculativeCache()
+            : next(0),
+            numSampled(0),
+            sampleSeconds(0.0),
+            numEvaluated(0),
+            evaluateSeconds(0.0),
+            numHits(0),
+            off(false)
+        {
+        };
+    };
+    std::shared_ptr<SpeculativeCache>  speculativeCache;
+    void
+    resizeSpeculation(
+        int depth);
+    bool
+    speculativeOutput(
+        const MTime& time,
+        MMatrix& output);
 //
 // constructor & destructor
 public:
-    SrtRbfNode() { };
-    virtual ~SrtRbfNode() { };
+    SrtRbfNode()
+        : modelDirty(true),
+        modelRevision(0),
+        snapshotRevision(-1),
+        editVersion(nullptr),
+        lastApproxError(0.0),
+        lastValid(false),
+        cacheHits(0),
+        cacheMisses(0),
+        lastQuality(kQualityCustom),
+        nearestError(0.0),
+        nearestRevision(-1),
+        nearestK(0),
+        speculativeCache(std::make_shared<SpeculativeCache>())
+    {
+    };
+    virtual ~SrtRbfNode();
 //
 // overrides
 public:
@@ -80,6 +397,60 @@ public:
     MStatus
     gotoExample(
         int eid);
+    MStatus
+    compress(
+        double tolerance,
+        int& numBefore,
+        int& numAfter,
+        double& maxError);
+    MStatus
+    tune(
+        int numPasses,
+        double& errorBefore,
+        double& errorAfter);
+    MStatus
+    validatePrecision(
+        int numSamples,
+        double& maxTranslate,
+        double& maxRotate,
+        double& maxScale);
+    MStatus
+    validatePaths(
+        int numSamples,
+        std::vector<SrtRbfPathReport>& reports);
+    MStatus
+    jacobian(
+        double step,
+        Eigen::MatrixXd& jac,
+        double& maxError);
+    void
+    stats(
+        SrtRbfNodeStats& stats);
+    bool
+    runtimeImage(
+        std::vector<double>& buffer);
+    MStatus
+    exportRuntime(
+        const MString& path,
+        double& maxError);
+    void
+    sampleInputs(
+        std::vector<MMatrix>& samples) const;
+    MStatus
+    bake(
+        const MTimeArray& times,
+        const std::vector<MMatrix>& samples,
+        MDGModifier& dgModifier,
+        MAnimCurveChange& curveChange);
+    bool
+    sampleTarget(
+        MMatrix& matrix) const;
+    MStatus
+    learnSamples(
+        const std::vector<MMatrix>& inputs,
+        const std::vector<MMatrix>& targets,
+        int maxExamples,
+        int& numAdded);
 protected:
     MStatus
     addExampleSupport(
@@ -111,6 +482,166 @@ public:
     virtual MStatus
     doIt(
         const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    std::vector<std::pair<MObject, SrtRbfVersion>> edits;
+};
+
+///
+
+class CompressSrtRbfNode : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    std::vector<std::pair<MObject, SrtRbfVersion>> edits;
+};
+
+///
+
+class TuneSrtRbfNode : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    std::vector<std::pair<MObject, SrtRbfVersion>> edits;
+};
+
+///
+
+class ValidateSrtRbfPrecision : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class ValidateSrtRbfPaths : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class DifferentiateSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class ExportSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class RecordSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class SampleSrtRbfExamples : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    std::vector<std::pair<MObject, SrtRbfVersion>> edits;
+};
+
+///
+
+class SrtRbfStats : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+};
+
+///
+
+class RetrainSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    MDGModifier          dgModifier;
+    std::vector<MObject> retrained;
+};
+
+///
+
+class BakeSrtRbf : public MPxCommand
+{
+public:
+    virtual MStatus
+    doIt(
+        const MArgList& args);
+    virtual MStatus
+    undoIt();
+    virtual MStatus
+    redoIt();
+    virtual bool
+    isUndoable() const;
+private:
+    MDGModifier      dgModifier;
+    MAnimCurveChange curveChange;
 };
 
 #endif //SRTRBF_NODE_H
@@ -1,20 +1,80 @@
 #include "SrtRbfNode.h"
+#include "SrtRbfBatchNode.h"
+#include "SrtRbfModelData.h"
 #include <maya/MFnPlugin.h>
+#include <maya/MSceneMessage.h>
+#include <maya/MDGMessage.h>
+
+static MCallbackId afterOpenCallbackId   = 0;
+static MCallbackId afterImportCallbackId = 0;
+static MCallbackId timeChangeCallbackId  = 0;
 
 MStatus initializePlugin(MObject obj)
 {
     MStatus status;
     MFnPlugin plugin(obj, "Mukai Lab", "v.2022.4.1", "2018-2022");
+    status = plugin.registerData(SrtRbfModelData::typeName, SrtRbfModelData::SrtRbfModelDataID,
+        SrtRbfModelData::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
     status = plugin.registerNode(SrtRbfNode::className, SrtRbfNode::SrtRbfNodeID,
         []()->void* {return new SrtRbfNode(); },
         SrtRbfNode::initSrtRbfNode);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = plugin.registerNode(SrtRbfBatchNode::className, SrtRbfBatchNode::SrtRbfBatchNodeID,
+        []()->void* {return new SrtRbfBatchNode(); },
+        SrtRbfBatchNode::initSrtRbfBatchNode);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
     status = plugin.registerCommand("CreateSrtRbfNode",
         []()->void* { return new CreateSrtRbfNode; });
     CHECK_MSTATUS(status);
     status = plugin.registerCommand("AddSrtRbfExample",
         []()->void* { return new AddSrtRbfExample; });
     CHECK_MSTATUS(status);
+    status = plugin.registerCommand("CompressSrtRbfNode",
+        []()->void* { return new CompressSrtRbfNode; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("TuneSrtRbfNode",
+        []()->void* { return new TuneSrtRbfNode; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("ValidateSrtRbfPrecision",
+        []()->void* { return new ValidateSrtRbfPrecision; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("ValidateSrtRbfPaths",
+        []()->void* { return new ValidateSrtRbfPaths; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("DifferentiateSrtRbf",
+        []()->void* { return new DifferentiateSrtRbf; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("ExportSrtRbf",
+        []()->void* { return new ExportSrtRbf; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("RecordSrtRbf",
+        []()->void* { return new RecordSrtRbf; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("SampleSrtRbfExamples",
+        []()->void* { return new SampleSrtRbfExamples; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("SrtRbfStats",
+        []()->void* { return new SrtRbfStats; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("RetrainSrtRbf",
+        []()->void* { return new RetrainSrtRbf; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("BakeSrtRbf",
+        []()->void* { return new BakeSrtRbf; });
+    CHECK_MSTATUS(status);
+    status = plugin.registerCommand("BatchSrtRbf",
+        []()->void* { return new BatchSrtRbf; });
+    CHECK_MSTATUS(status);
+    afterOpenCallbackId = MSceneMessage::addCallback(MSceneMessage::kAfterOpen,
+        SrtRbfNode::migrateScene, nullptr, &status);
+    CHECK_MSTATUS(status);
+    afterImportCallbackId = MSceneMessage::addCallback(MSceneMessage::kAfterImport,
+        SrtRbfNode::migrateScene, nullptr, &status);
+    CHECK_MSTATUS(status);
+    timeChangeCallbackId = MDGMessage::addTimeChangeCallback(
+        SrtRbfNode::speculate, nullptr, &status);
+    CHECK_MSTATUS(status);
     return status;
 }
 
@@ -22,11 +82,43 @@ MStatus uninitializePlugin(MObject obj)
 {
     MStatus status;
     MFnPlugin plugin(obj);
+    MMessage::removeCallback(afterOpenCallbackId);
+    MMessage::removeCallback(afterImportCallbackId);
+    MMessage::removeCallback(timeChangeCallbackId);
+    SrtRbfNode::finishSpeculation();
     status = plugin.deregisterCommand("CreateSrtRbfNode");
     CHECK_MSTATUS(status);
     status = plugin.deregisterCommand("AddSrtRbfExample");
     CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("CompressSrtRbfNode");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("TuneSrtRbfNode");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("ValidateSrtRbfPrecision");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("ValidateSrtRbfPaths");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("DifferentiateSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("ExportSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("RecordSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("SampleSrtRbfExamples");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("SrtRbfStats");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("RetrainSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("BakeSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterCommand("BatchSrtRbf");
+    CHECK_MSTATUS(status);
+    status = plugin.deregisterNode(SrtRbfBatchNode::SrtRbfBatchNodeID);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
     status = plugin.deregisterNode(SrtRbfNode::SrtRbfNodeID);
     CHECK_MSTATUS_AND_RETURN_IT(status);
+    status = plugin.deregisterData(SrtRbfModelData::SrtRbfModelDataID);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
     return status;
 }
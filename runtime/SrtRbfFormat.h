@@ -0,0 +1,93 @@
+#ifndef SRTRBF_FORMAT_H
+#define SRTRBF_FORMAT_H
+#pragma once
+
+#include <stdint.h>
+
+//
+// binary layout of an exported SrtRbfNode
+//
+// The file is a header followed by sections of little-endian doubles, each
+// starting at a multiple of SRTRBF_ALIGNMENT bytes, so that a mapped file is
+// evaluated in place without parsing.
+//
+//  primRef : numInputs x 10              reference primary transformations
+//  centers : numCenters x numInputs x 10 relativized primary transformations
+//  coef    : numCoefs x 10               coefficients of the kernel columns
+//
+// Poses are stored as s(3), q(4: x, y, z, w), t(3) like PoseVariable.
+// The blended feature of a pose is
+//   f = sum_j rbf(d(x, center_j)) * coef_j (+ coef_numCenters under affinity)
+// and the rotation part of f is a log quaternion that is exponentiated and,
+// under affinity, composed after secRotate.
+#define SRTRBF_MAGIC          "SRTRBF\0"
+#define SRTRBF_FORMAT_VERSION 1
+#define SRTRBF_ENDIAN_TAG     0x01020304u
+#define SRTRBF_ALIGNMENT      64
+
+struct SrtRbfFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t headerSize;
+    uint64_t fileSize;
+    int32_t  numInputs;
+    int32_t  numCenters;
+    int32_t  numCoefs;     // numCenters + 1 under affinity
+    int32_t  rbfType;      // 0: linear, 1: thin plate, 2: gaussian
+    int32_t  distType;     // 0: hemisphere angle, 1: log quaternion, 2: shortest angle, 3: Frobenius
+    int32_t  affinity;
+    double   width;        // gaussian width
+    double   scaleWeight;
+    double   rotateWeight;
+    double   translateWeight;
+    double   secRotate[4]; // reference rotation of the secondary transformation
+    uint64_t primRefOffset;
+    uint64_t centersOffset;
+    uint64_t coefOffset;
+    uint64_t reserved[4];
+};
+
+//
+// binary layout of a recording written by the RecordSrtRbf command
+//
+// The input matrices of all SrtRbfNodes of a scene over a frame range, with
+// the trained data of each node as an export above, for replaying the
+// evaluation without Maya (runtime/SrtRbfReplay.cpp).
+//
+//  nodes  : numNodes x SrtRbfRecordNode
+//  export : a file of the layout above per node, at its offset
+//  inputs : numFrames x numMatrices x 16 row-major matrices, where each frame
+//           holds the inputs of the nodes in the order of the node table
+#define SRTRBF_RECORD_MAGIC   "SRTREC\0"
+#define SRTRBF_RECORD_VERSION 1
+
+struct SrtRbfRecordHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t headerSize;
+    uint64_t fileSize;
+    int32_t  numNodes;
+    int32_t  numFrames;
+    int32_t  numMatrices;  // sum of numInputs of the nodes
+    int32_t  reserved0;
+    double   frameStart;
+    double   frameStep;
+    uint64_t nodesOffset;
+    uint64_t inputsOffset;
+    uint64_t reserved[4];
+};
+
+struct SrtRbfRecordNode
+{
+    uint64_t offset;       // of the export of the node
+    uint64_t size;
+    int32_t  numInputs;
+    int32_t  firstMatrix;  // index of the first input of the node in a frame
+    char     name[64];
+};
+
+#endif //SRTRBF_FORMAT_H
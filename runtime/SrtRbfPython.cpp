@@ -0,0 +1,431 @@
+//
+// Python module "srtrbf" evaluating files written by the ExportSrtRbf command
+//
+//   import srtrbf
+//   rt = srtrbf.open("node.srtrbf")
+//   out = rt.evaluate(inputs)                         # (F, numInputs, 4, 4) -> (F, 4, 4)
+//   out, k = rt.evaluate(inputs, kernel_values=True)  # k: (F, numCenters) kernel values
+//
+// The arrays are accessed through the buffer protocol without copies, and the
+// evaluation runs on all hardware threads with the GIL released. NumPy is
+// needed only to allocate the results; out= and kernel_values= also take
+// writable float64 buffers. Builds against Python 2.7 (mayapy of Maya 2020) and 3.x,
+// for example,
+//   g++ -O2 -std=c++11 -pthread -shared -fPIC $(python3-config --includes)
+//       SrtRbfPython.cpp SrtRbfRuntime.cpp -o srtrbf$(python3-config --extension-suffix)
+#include <Python.h>
+#include "SrtRbfRuntime.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct RuntimeObject
+{
+    PyObject_HEAD
+    SrtRbfRuntime*       runtime;
+    Py_buffer*           view;  // memory of from_buffer held while the runtime lives
+    std::vector<double>* copy;  // 8-byte aligned copy of a misaligned buffer
+};
+
+// zero-initialized and set up by name in ReadyType; the fields of the type
+// object differ between the versions of Python
+PyTypeObject RuntimeType = PyTypeObject();
+
+PyObject*
+NewRuntime(
+    SrtRbfRuntime* runtime,
+    Py_buffer* view,
+    std::vector<double>* copy)
+{
+    RuntimeObject* self = PyObject_New(RuntimeObject, &RuntimeType);
+    if (self == NULL)
+    {
+        SrtRbfClose(runtime);
+        return NULL;
+    }
+    self->runtime = runtime;
+    self->view = view;
+    self->copy = copy;
+    return reinterpret_cast<PyObject*>(self);
+}
+
+void
+DeleteRuntime(
+    PyObject* obj)
+{
+    RuntimeObject* self = reinterpret_cast<RuntimeObject*>(obj);
+    SrtRbfClose(self->runtime);
+    if (self->view != NULL)
+    {
+        PyBuffer_Release(self->view);
+        delete self->view;
+    }
+    delete self->copy;
+    PyObject_Del(obj);
+}
+
+// C-contiguous float64 buffer of obj
+bool
+GetDoubles(
+    PyObject* obj,
+    Py_buffer* view,
+    bool writable,
+    const char* name)
+{
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    if (PyObject_GetBuffer(obj, view, flags) != 0)
+    {
+        PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous%s float64 array", name, writable ? " writable" : "");
+        return false;
+    }
+    const char* format = view->format == NULL ? "B" : view->format;
+    if (view->itemsize != sizeof(double)
+        || (std::strcmp(format, "d") != 0 && std::strcmp(format, "=d") != 0 && std::strcmp(format, "<d") != 0))
+    {
+        PyBuffer_Release(view);
+        PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous float64 array", name);
+        return false;
+    }
+    return true;
+}
+
+// whether view has the given shape
+bool
+HasShape(
+    const Py_buffer& view,
+    const std::vector<Py_ssize_t>& shape)
+{
+    if (view.ndim != static_cast<int>(shape.size()) || view.shape == NULL)
+    {
+        return false;
+    }
+    return std::equal(shape.begin(), shape.end(), view.shape);
+}
+
+// numpy.empty(shape)
+PyObject*
+NewArray(
+    const std::vector<Py_ssize_t>& shape)
+{
+    PyObject* numpy = PyImport_ImportModule("numpy");
+    if (numpy == NULL)
+    {
+        return NULL;
+    }
+    PyObject* dims = PyTuple_New(static_cast<Py_ssize_t>(shape.size()));
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        PyTuple_SET_ITEM(dims, i, PyLong_FromSsize_t(shape[i]));
+    }
+    PyObject* array = PyObject_CallMethod(numpy, const_cast<char*>("empty"), const_cast<char*>("(O)"), dims);
+    Py_DECREF(dims);
+    Py_DECREF(numpy);
+    return array;
+}
+
+// evaluate(inputs, out=None, kernel_values=False, threads=0)
+// The kernel values are those of SrtRbfEvaluateKernelValues, not blend weights.
+PyObject*
+Evaluate(
+    PyObject* obj,
+    PyObject* args,
+    PyObject* kwargs)
+{
+    const SrtRbfRuntime* runtime = reinterpret_cast<RuntimeObject*>(obj)->runtime;
+    static const char* keywords[] = { "inputs", "out", "kernel_values", "threads", NULL };
+    PyObject* inputsObj = NULL;
+    PyObject* outObj = Py_None;
+    PyObject* kernelsObj = Py_False;
+    int numThreads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOi", const_cast<char**>(keywords),
+        &inputsObj, &outObj, &kernelsObj, &numThreads))
+    {
+        return NULL;
+    }
+    const int numInputs = SrtRbfNumInputs(runtime);
+    const int numCenters = SrtRbfNumCenters(runtime);
+    Py_buffer inputs;
+    if (!GetDoubles(inputsObj, &inputs, false, "inputs"))
+    {
+        return NULL;
+    }
+    const Py_ssize_t numPoses = inputs.ndim > 0 && inputs.shape != NULL ? inputs.shape[0] : 0;
+    std::vector<Py_ssize_t> inputShape(4, 4);
+    inputShape[0] = numPoses;
+    inputShape[1] = numInputs;
+    if (!HasShape(inputs, inputShape))
+    {
+        PyBuffer_Release(&inputs);
+        PyErr_Format(PyExc_ValueError, "inputs must be an F x %d x 4 x 4 array", numInputs);
+        return NULL;
+    }
+    std::vector<Py_ssize_t> outputShape(3, 4);
+    outputShape[0] = numPoses;
+    std::vector<Py_ssize_t> kernelShape(2, numCenters);
+    kernelShape[0] = numPoses;
+
+    // results allocated by NumPy unless given
+    if (outObj == Py_None)
+    {
+        outObj = NewArray(outputShape);
+    }
+    else
+    {
+        Py_INCREF(outObj);
+    }
+    const bool withKernels = kernelsObj != Py_None && kernelsObj != Py_False;
+    if (kernelsObj == Py_True)
+    {
+        kernelsObj = NewArray(kernelShape);
+    }
+    else if (withKernels)
+    {
+        Py_INCREF(kernelsObj);
+    }
+    Py_buffer outputs, kernels;
+    bool ok = outObj != NULL && (!withKernels || kernelsObj != NULL)
+        && GetDoubles(outObj, &outputs, true, "out");
+    if (ok && !HasShape(outputs, outputShape))
+    {
+        PyErr_Format(PyExc_ValueError, "out must be a %zd x 4 x 4 array", numPoses);
+        PyBuffer_Release(&outputs);
+        ok = false;
+    }
+    if (ok && withKernels)
+    {
+        if (!GetDoubles(kernelsObj, &kernels, true, "kernel_values"))
+        {
+            PyBuffer_Release(&outputs);
+            ok = false;
+        }
+        else if (!HasShape(kernels, kernelShape))
+        {
+            PyErr_Format(PyExc_ValueError, "kernel_values must be a %zd x %d array", numPoses, numCenters);
+            PyBuffer_Release(&kernels);
+            PyBuffer_Release(&outputs);
+            ok = false;
+        }
+    }
+    if (!ok)
+    {
+        PyBuffer_Release(&inputs);
+        Py_XDECREF(outObj);
+        if (withKernels)
+        {
+            Py_XDECREF(kernelsObj);
+        }
+        return NULL;
+    }
+
+    // the poses are split among the threads; a runtime may be evaluated concurrently
+    const double* in = static_cast<const double*>(inputs.buf);
+    double* out = static_cast<double*>(outputs.buf);
+    double* k = withKernels ? static_cast<double*>(kernels.buf) : NULL;
+    Py_BEGIN_ALLOW_THREADS
+    if (numThreads <= 0)
+    {
+        numThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    numThreads = static_cast<int>(std::min<Py_ssize_t>(numThreads, std::max<Py_ssize_t>(numPoses / 16, 1)));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        const Py_ssize_t begin = numPoses * t / numThreads;
+        const Py_ssize_t end = numPoses * (t + 1) / numThreads;
+        auto evaluate = [=]()
+        {
+            SrtRbfEvaluateKernelValues(runtime, static_cast<int>(end - begin),
+                in + begin * numInputs * 16, out + begin * 16, k == NULL ? NULL : k + begin * numCenters);
+        };
+        if (t + 1 < numThreads)
+        {
+            threads.push_back(std::thread(evaluate));
+        }
+        else
+        {
+            evaluate();
+        }
+    }
+    for (std::thread& th : threads)
+    {
+        th.join();
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&inputs);
+    PyBuffer_Release(&outputs);
+    if (!withKernels)
+    {
+        return outObj;
+    }
+    PyBuffer_Release(&kernels);
+    PyObject* result = PyTuple_Pack(2, outObj, kernelsObj);
+    Py_DECREF(outObj);
+    Py_DECREF(kernelsObj);
+    return result;
+}
+
+PyObject*
+NumInputs(
+    PyObject* obj,
+    void*)
+{
+    return PyLong_FromLong(SrtRbfNumInputs(reinterpret_cast<RuntimeObject*>(obj)->runtime));
+}
+
+PyObject*
+NumCenters(
+    PyObject* obj,
+    void*)
+{
+    return PyLong_FromLong(SrtRbfNumCenters(reinterpret_cast<RuntimeObject*>(obj)->runtime));
+}
+
+// open(path)
+PyObject*
+Open(
+    PyObject*,
+    PyObject* args)
+{
+    const char* path = NULL;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        return NULL;
+    }
+    SrtRbfRuntime* runtime = SrtRbfOpen(path);
+    if (runtime == NULL)
+    {
+        PyErr_Format(PyExc_IOError, "cannot read %s as an SrtRbf export", path);
+        return NULL;
+    }
+    return NewRuntime(runtime, NULL, NULL);
+}
+
+// from_buffer(data): the contents of an export held in memory, e.g. bytes
+PyObject*
+FromBuffer(
+    PyObject*,
+    PyObject* args)
+{
+    PyObject* data = NULL;
+    if (!PyArg_ParseTuple(args, "O", &data))
+    {
+        return NULL;
+    }
+    Py_buffer* view = new Py_buffer;
+    if (PyObject_GetBuffer(data, view, PyBUF_SIMPLE) != 0)
+    {
+        delete view;
+        return NULL;
+    }
+    std::vector<double>* copy = NULL;
+    const void* memory = view->buf;
+    if (reinterpret_cast<size_t>(memory) % sizeof(double) != 0)
+    {
+        copy = new std::vector<double>((view->len + sizeof(double) - 1) / sizeof(double));
+        std::memcpy(copy->data(), view->buf, view->len);
+        memory = copy->data();
+    }
+    SrtRbfRuntime* runtime = SrtRbfOpenMemory(memory, static_cast<size_t>(view->len));
+    if (copy != NULL)
+    {
+        PyBuffer_Release(view);
+        delete view;
+        view = NULL;
+    }
+    if (runtime == NULL)
+    {
+        if (view != NULL)
+        {
+            PyBuffer_Release(view);
+            delete view;
+        }
+        delete copy;
+        PyErr_SetString(PyExc_ValueError, "not an SrtRbf export");
+        return NULL;
+    }
+    return NewRuntime(runtime, view, copy);
+}
+
+PyMethodDef runtimeMethods[] = {
+    // through void (*)(void), which converts to any function pointer without a warning
+    { "evaluate", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(Evaluate)), METH_VARARGS | METH_KEYWORDS,
+      "evaluate(inputs, out=None, kernel_values=False, threads=0)\n"
+      "outputs (F x 4 x 4) of input matrices (F x numInputs x 4 x 4), with the kernel values\n"
+      "(F x numCenters) multiplying the dual coefficients of the centers if kernel_values is True\n"
+      "or a buffer; they are not the blend weights of the examples and do not sum to 1" },
+    { NULL, NULL, 0, NULL }
+};
+
+PyGetSetDef runtimeGetSet[] = {
+    { const_cast<char*>("num_inputs"), NumInputs, NULL, const_cast<char*>("# of input matrices"), NULL },
+    { const_cast<char*>("num_centers"), NumCenters, NULL, const_cast<char*>("# of kernel centers"), NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+PyMethodDef moduleMethods[] = {
+    { "open", Open, METH_VARARGS, "open(path): runtime of a file written by ExportSrtRbf" },
+    { "from_buffer", FromBuffer, METH_VARARGS, "from_buffer(data): runtime of the contents of such a file" },
+    { NULL, NULL, 0, NULL }
+};
+
+const char* moduleDoc = "evaluator of SrtRbfNode exports";
+
+bool
+ReadyType()
+{
+    if ((RuntimeType.tp_flags & Py_TPFLAGS_READY) != 0)
+    {
+        return true;
+    }
+    Py_INCREF(&RuntimeType); // the reference of PyVarObject_HEAD_INIT
+    RuntimeType.tp_name = "srtrbf.Runtime";
+    RuntimeType.tp_basicsize = sizeof(RuntimeObject);
+    RuntimeType.tp_dealloc = DeleteRuntime;
+    RuntimeType.tp_flags = Py_TPFLAGS_DEFAULT;
+    RuntimeType.tp_doc = "trained data of an SrtRbfNode; create with srtrbf.open or srtrbf.from_buffer";
+    RuntimeType.tp_methods = runtimeMethods;
+    RuntimeType.tp_getset = runtimeGetSet;
+    return PyType_Ready(&RuntimeType) == 0;
+}
+
+} // namespace
+
+#if PY_MAJOR_VERSION >= 3
+static PyModuleDef moduleDef = { PyModuleDef_HEAD_INIT, "srtrbf", moduleDoc, -1, moduleMethods, NULL, NULL, NULL, NULL };
+
+PyMODINIT_FUNC
+PyInit_srtrbf()
+{
+    if (!ReadyType())
+    {
+        return NULL;
+    }
+    PyObject* module = PyModule_Create(&moduleDef);
+    if (module != NULL)
+    {
+        Py_INCREF(&RuntimeType);
+        PyModule_AddObject(module, "Runtime", reinterpret_cast<PyObject*>(&RuntimeType));
+    }
+    return module;
+}
+#else
+PyMODINIT_FUNC
+initsrtrbf()
+{
+    if (!ReadyType())
+    {
+        return;
+    }
+    PyObject* module = Py_InitModule3("srtrbf", moduleMethods, moduleDoc);
+    if (module != NULL)
+    {
+        Py_INCREF(&RuntimeType);
+        PyModule_AddObject(module, "Runtime", reinterpret_cast<PyObject*>(&RuntimeType));
+    }
+}
+#endif
@@ -0,0 +1,281 @@
+//
+// replays a recording written by the RecordSrtRbf command without Maya
+//
+//   SrtRbfReplay recording [threads [passes]]
+//
+// Evaluates all recorded nodes for all frames on one thread and on the given
+// number of threads (default: all hardware threads), where the nodes of a frame
+// are shared among the threads like independent nodes in the parallel
+// evaluation of Maya, and reports the throughput, the per-frame latency and
+// the scaling efficiency. Build with, for example,
+//   g++ -O2 -std=c++11 -pthread SrtRbfReplay.cpp SrtRbfRuntime.cpp -o SrtRbfReplay
+#include "SrtRbfRuntime.h"
+#include "SrtRbfFormat.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+
+struct Recording
+{
+    std::vector<double>         data;  // 8-byte aligned for SrtRbfOpenMemory
+    const SrtRbfRecordHeader*   header;
+    const SrtRbfRecordNode*     nodes;
+    const double*               inputs;
+    std::vector<SrtRbfRuntime*> runtimes;
+};
+
+bool
+LoadRecording(
+    const char* path,
+    Recording& rec)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(file.tellg());
+    if (size < sizeof(SrtRbfRecordHeader))
+    {
+        return false;
+    }
+    rec.data.resize((size + sizeof(double) - 1) / sizeof(double));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(rec.data.data()), size);
+    if (!file)
+    {
+        return false;
+    }
+    const char* base = reinterpret_cast<const char*>(rec.data.data());
+    rec.header = reinterpret_cast<const SrtRbfRecordHeader*>(base);
+    const SrtRbfRecordHeader& h = *rec.header;
+    if (std::memcmp(h.magic, SRTRBF_RECORD_MAGIC, sizeof(h.magic)) != 0
+        || h.version != SRTRBF_RECORD_VERSION
+        || h.endianTag != SRTRBF_ENDIAN_TAG
+        || h.headerSize != sizeof(SrtRbfRecordHeader)
+        || h.fileSize > size
+        || h.numNodes <= 0 || h.numFrames <= 0 || h.numMatrices < 0
+        || h.nodesOffset + h.numNodes * sizeof(SrtRbfRecordNode) > size
+        || h.inputsOffset + static_cast<uint64_t>(h.numFrames) * h.numMatrices * 16 * sizeof(double) > size)
+    {
+        return false;
+    }
+    rec.nodes = reinterpret_cast<const SrtRbfRecordNode*>(base + h.nodesOffset);
+    rec.inputs = reinterpret_cast<const double*>(base + h.inputsOffset);
+    for (int nid = 0; nid < h.numNodes; ++nid)
+    {
+        const SrtRbfRecordNode& node = rec.nodes[nid];
+        SrtRbfRuntime* runtime = node.offset + node.size <= size && node.offset % sizeof(double) == 0
+            ? SrtRbfOpenMemory(base + node.offset, node.size) : NULL;
+        if (runtime == NULL || SrtRbfNumInputs(runtime) != node.numInputs
+            || node.firstMatrix < 0 || node.firstMatrix + node.numInputs > h.numMatrices)
+        {
+            std::fprintf(stderr, "invalid node %d (%.64s)\n", nid, node.name);
+            SrtRbfClose(runtime);
+            return false;
+        }
+        rec.runtimes.push_back(runtime);
+    }
+    return true;
+}
+
+//
+// threads that share the nodes of one frame at a time; the calling thread is one of them
+class FrameWorkers
+{
+public:
+    FrameWorkers(
+        const Recording& rec,
+        int numThreads,
+        double* outputs)
+        : rec(rec),
+        outputs(outputs),
+        numThreads(numThreads),
+        frame(0),
+        generation(0),
+        next(0),
+        done(0),
+        quit(false)
+    {
+        for (int tid = 1; tid < numThreads; ++tid)
+        {
+            threads.push_back(std::thread(&FrameWorkers::work, this));
+        }
+    }
+    ~FrameWorkers()
+    {
+        quit.store(true);
+        for (std::thread& t : threads)
+        {
+            t.join();
+        }
+    }
+    void
+    run(
+        int fid)
+    {
+        next.store(0);
+        done.store(0);
+        frame.store(fid);
+        generation.fetch_add(1);
+        evaluate(fid);
+        while (done.load() < numThreads)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    void
+    work()
+    {
+        int seen = 0;
+        for (;;)
+        {
+            while (generation.load() == seen && !quit.load())
+            {
+                std::this_thread::yield();
+            }
+            if (quit.load())
+            {
+                return;
+            }
+            seen = generation.load();
+            evaluate(frame.load());
+        }
+    }
+    void
+    evaluate(
+        int fid)
+    {
+        const SrtRbfRecordHeader& h = *rec.header;
+        const double* frameInputs = rec.inputs + static_cast<size_t>(fid) * h.numMatrices * 16;
+        double* frameOutputs = outputs + static_cast<size_t>(fid) * h.numNodes * 16;
+        for (int nid; (nid = next.fetch_add(1)) < h.numNodes; )
+        {
+            SrtRbfEvaluate(rec.runtimes[nid], 1,
+                frameInputs + rec.nodes[nid].firstMatrix * 16, frameOutputs + nid * 16);
+        }
+        done.fetch_add(1);
+    }
+
+    const Recording&         rec;
+    double*                  outputs;
+    const int                numThreads;
+    std::vector<std::thread> threads;
+    std::atomic<int>         frame;
+    std::atomic<int>         generation;  // incremented per run to wake up the threads
+    std::atomic<int>         next;
+    std::atomic<int>         done;
+    std::atomic<bool>        quit;
+};
+
+struct Measurement
+{
+    double evalsPerSec;
+    double p50;  // milliseconds per frame
+    double p99;
+};
+
+Measurement
+Replay(
+    const Recording& rec,
+    int numThreads,
+    int numPasses,
+    std::vector<double>& outputs)
+{
+    typedef std::chrono::steady_clock Clock;
+    const SrtRbfRecordHeader& h = *rec.header;
+    outputs.assign(static_cast<size_t>(h.numFrames) * h.numNodes * 16, 0.0);
+    FrameWorkers workers(rec, numThreads, outputs.data());
+    for (int fid = 0; fid < h.numFrames; ++fid) // warm up
+    {
+        workers.run(fid);
+    }
+    std::vector<double> latency;
+    latency.reserve(static_cast<size_t>(numPasses) * h.numFrames);
+    const Clock::time_point begin = Clock::now();
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        for (int fid = 0; fid < h.numFrames; ++fid)
+        {
+            const Clock::time_point t0 = Clock::now();
+            workers.run(fid);
+            latency.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+        }
+    }
+    const double total = std::chrono::duration<double>(Clock::now() - begin).count();
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&latency](double p) {
+        const size_t i = static_cast<size_t>(std::ceil(p * latency.size())) - 1;
+        return latency[std::min(i, latency.size() - 1)];
+    };
+    Measurement m;
+    m.evalsPerSec = static_cast<double>(numPasses) * h.numFrames * h.numNodes / total;
+    m.p50 = percentile(0.50);
+    m.p99 = percentile(0.99);
+    return m;
+}
+
+} // namespace
+
+int
+main(
+    int argc,
+    char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s recording [threads [passes]]\n", argv[0]);
+        return 2;
+    }
+    const unsigned int hardware = std::thread::hardware_concurrency();
+    const int numThreads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::max(1u, hardware));
+    const int numPasses = argc > 3 ? std::atoi(argv[3]) : 10;
+    if (numThreads < 1 || numPasses < 1)
+    {
+        std::fprintf(stderr, "threads and passes must be positive\n");
+        return 2;
+    }
+    Recording rec;
+    if (!LoadRecording(argv[1], rec))
+    {
+        std::fprintf(stderr, "cannot read recording %s\n", argv[1]);
+        return 1;
+    }
+    const SrtRbfRecordHeader& h = *rec.header;
+    std::printf("%d nodes, %d inputs, %d frames from %g by %g, %d passes\n",
+        h.numNodes, h.numMatrices, h.numFrames, h.frameStart, h.frameStep, numPasses);
+
+    std::vector<double> serialOutputs, parallelOutputs;
+    const Measurement serial = Replay(rec, 1, numPasses, serialOutputs);
+    const Measurement parallel = Replay(rec, numThreads, numPasses, parallelOutputs);
+    double maxDiff = 0.0;
+    for (size_t i = 0; i < serialOutputs.size(); ++i)
+    {
+        maxDiff = std::max(maxDiff, std::abs(serialOutputs[i] - parallelOutputs[i]));
+    }
+    const double speedup = parallel.evalsPerSec / serial.evalsPerSec;
+    std::printf("threads  evals/sec     p50 ms    p99 ms    speedup  efficiency\n");
+    std::printf("%7d  %12.0f  %8.4f  %8.4f  %7.2f  %9.1f%%\n",
+        1, serial.evalsPerSec, serial.p50, serial.p99, 1.0, 100.0);
+    std::printf("%7d  %12.0f  %8.4f  %8.4f  %7.2f  %9.1f%%\n",
+        numThreads, parallel.evalsPerSec, parallel.p50, parallel.p99, speedup, 100.0 * speedup / numThreads);
+    std::printf("max difference between the runs %g\n", maxDiff);
+
+    for (SrtRbfRuntime* runtime : rec.runtimes)
+    {
+        SrtRbfClose(runtime);
+    }
+    return maxDiff == 0.0 ? 0 : 1;
+}
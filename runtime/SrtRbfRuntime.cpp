@@ -0,0 +1,570 @@
+#include "SrtRbfRuntime.h"
+#include "SrtRbfFormat.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct SrtRbfRuntime
+{
+    const SrtRbfFileHeader* header;
+    const double* primRef;
+    const double* centers;
+    const double* coef;
+    void*  mapping;     // NULL when the memory is owned by the caller
+    size_t mappedSize;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE fileMapping;
+#endif
+};
+
+namespace
+{
+
+//
+// Maya-free counterparts of the pose math in PoseVariable.h and SrtRbfModel.cpp
+struct Quat
+{
+    double x, y, z, w;
+};
+
+struct Pose
+{
+    double s[3];
+    Quat   q;
+    double t[3];
+};
+static_assert(sizeof(Pose) == 10 * sizeof(double), "poses are mapped from arrays of doubles");
+
+// same order as MQuaternion::operator*, i.e. a followed by b
+Quat
+QMul(
+    const Quat& a,
+    const Quat& b)
+{
+    Quat r;
+    r.x = b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y;
+    r.y = b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x;
+    r.z = b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w;
+    r.w = b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z;
+    return r;
+}
+
+Quat
+QConjugate(
+    const Quat& q)
+{
+    Quat r = { -q.x, -q.y, -q.z, q.w };
+    return r;
+}
+
+double
+QDot(
+    const Quat& a,
+    const Quat& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+Quat
+QLog(
+    const Quat& q)
+{
+    const double l = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+    if (l < 1.0e-12)
+    {
+        Quat r = { q.x, q.y, q.z, 0.0 };
+        return r;
+    }
+    const double t = std::atan2(l, q.w) / l;
+    Quat r = { q.x * t, q.y * t, q.z * t, 0.0 };
+    return r;
+}
+
+Quat
+QExp(
+    const Quat& q)
+{
+    const double l = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z);
+    if (l < 1.0e-12)
+    {
+        Quat r = { q.x, q.y, q.z, 1.0 };
+        return r;
+    }
+    const double s = std::sin(l) / l;
+    Quat r = { q.x * s, q.y * s, q.z * s, std::cos(l) };
+    return r;
+}
+
+Quat
+QNormalize(
+    const Quat& q)
+{
+    const double l = std::sqrt(QDot(q, q));
+    Quat r = { q.x / l, q.y / l, q.z / l, q.w / l };
+    return r;
+}
+
+// MTransformationMatrix::asMatrix; rows are the scaled rotated axes
+void
+ToMatrix(
+    const Pose& pose,
+    double* m)
+{
+    const Quat q = QNormalize(pose.q);
+    const double x = q.x, y = q.y, z = q.z, w = q.w;
+    const double rot[9] = {
+        1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y),
+        2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x),
+        2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y) };
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            m[r * 4 + c] = pose.s[r] * rot[r * 3 + c];
+        }
+        m[r * 4 + 3] = 0.0;
+    }
+    m[12] = pose.t[0];
+    m[13] = pose.t[1];
+    m[14] = pose.t[2];
+    m[15] = 1.0;
+}
+
+// PoseVariable::fromMatrix for matrices without shear
+Pose
+FromMatrix(
+    const double* m)
+{
+    Pose pose;
+    double rot[9];
+    const double det =
+        m[0] * (m[5] * m[10] - m[6] * m[9]) -
+        m[1] * (m[4] * m[10] - m[6] * m[8]) +
+        m[2] * (m[4] * m[9] - m[5] * m[8]);
+    for (int r = 0; r < 3; ++r)
+    {
+        double l = std::sqrt(m[r * 4] * m[r * 4] + m[r * 4 + 1] * m[r * 4 + 1] + m[r * 4 + 2] * m[r * 4 + 2]);
+        l = det < 0 ? -l : l;
+        pose.s[r] = l;
+        for (int c = 0; c < 3; ++c)
+        {
+            rot[r * 3 + c] = m[r * 4 + c] / l;
+        }
+    }
+    Quat& q = pose.q;
+    const double tr = rot[0] + rot[4] + rot[8];
+    if (tr > 0)
+    {
+        const double s = std::sqrt(tr + 1.0) * 2;
+        q.w = 0.25 * s;
+        q.x = (rot[5] - rot[7]) / s;
+        q.y = (rot[6] - rot[2]) / s;
+        q.z = (rot[1] - rot[3]) / s;
+    }
+    else if (rot[0] > rot[4] && rot[0] > rot[8])
+    {
+        const double s = std::sqrt(1.0 + rot[0] - rot[4] - rot[8]) * 2;
+        q.w = (rot[5] - rot[7]) / s;
+        q.x = 0.25 * s;
+        q.y = (rot[3] + rot[1]) / s;
+        q.z = (rot[6] + rot[2]) / s;
+    }
+    else if (rot[4] > rot[8])
+    {
+        const double s = std::sqrt(1.0 + rot[4] - rot[0] - rot[8]) * 2;
+        q.w = (rot[6] - rot[2]) / s;
+        q.x = (rot[3] + rot[1]) / s;
+        q.y = 0.25 * s;
+        q.z = (rot[7] + rot[5]) / s;
+    }
+    else
+    {
+        const double s = std::sqrt(1.0 + rot[8] - rot[0] - rot[4]) * 2;
+        q.w = (rot[1] - rot[3]) / s;
+        q.x = (rot[6] + rot[2]) / s;
+        q.y = (rot[7] + rot[5]) / s;
+        q.z = 0.25 * s;
+    }
+    pose.t[0] = m[12];
+    pose.t[1] = m[13];
+    pose.t[2] = m[14];
+    return pose;
+}
+
+void
+TruncateEpsilon(
+    Quat& q,
+    double epsilon = 1.0e-9)
+{
+    q.x = std::abs(q.x) < epsilon ? 0 : q.x;
+    q.y = std::abs(q.y) < epsilon ? 0 : q.y;
+    q.z = std::abs(q.z) < epsilon ? 0 : q.z;
+    q.w = std::abs(q.w) < epsilon ? 0 : q.w;
+}
+
+// SrtRbfModel::relativize
+void
+Relativize(
+    Pose& pose,
+    const Pose& ref)
+{
+    TruncateEpsilon(pose.q);
+    if (QDot(ref.q, pose.q) < 0
+        || pose.q.x == -1 || pose.q.y == -1 || pose.q.z == -1)
+    {
+        pose.q.x = -pose.q.x;
+        pose.q.y = -pose.q.y;
+        pose.q.z = -pose.q.z;
+        pose.q.w = -pose.q.w;
+    }
+    pose.q = QMul(QConjugate(ref.q), pose.q);
+}
+
+// PoseVariable::dissimilaritySq
+double
+DissimilaritySq(
+    const Pose& a,
+    const Pose& b,
+    const SrtRbfFileHeader& header)
+{
+    if (header.distType == 3)
+    {
+        double am[16], bm[16];
+        ToMatrix(a, am);
+        ToMatrix(b, bm);
+        double fnrm = 0.0;
+        for (int j = 0; j < 16; ++j)
+        {
+            fnrm += std::pow(am[j] - bm[j], 2.0);
+        }
+        return fnrm;
+    }
+    double dssq = 0.0, dtsq = 0.0;
+    for (int j = 0; j < 3; ++j)
+    {
+        dssq += (a.s[j] - b.s[j]) * (a.s[j] - b.s[j]);
+        dtsq += (a.t[j] - b.t[j]) * (a.t[j] - b.t[j]);
+    }
+    double sqe = header.scaleWeight * dssq + header.translateWeight * dtsq;
+    switch (header.distType)
+    {
+    case 1:
+    {
+        const Quat la = QLog(a.q), lb = QLog(b.q);
+        const Quat qd = { la.x - lb.x, la.y - lb.y, la.z - lb.z, la.w - lb.w };
+        sqe += header.rotateWeight * QDot(qd, qd);
+        break;
+    }
+    case 2:
+        sqe += header.rotateWeight * std::pow(2.0 * std::acos(std::min(std::abs(QDot(a.q, b.q)), 1.0)), 2.0);
+        break;
+    case 0:
+    default:
+        sqe += header.rotateWeight * std::pow(2.0 * std::acos(std::max(std::min(QDot(a.q, b.q), 1.0), -1.0)), 2.0);
+        break;
+    }
+    return sqe;
+}
+
+// PoseVariable::rbf
+double
+Rbf(
+    double d,
+    const SrtRbfFileHeader& header)
+{
+    switch (header.rbfType)
+    {
+    case 1:
+        return std::abs(d) < 1.0e-6 ? 0 : std::pow(d, 2) * std::log(d);
+    case 2:
+        return std::exp(-d * d / header.width);
+    case 0:
+    default:
+        return d;
+    }
+}
+
+// blends the coefficients for relativized poses and composes the output pose;
+// kernels receives the kernel values of the centers unless it is NULL
+Pose
+Blend(
+    const SrtRbfRuntime* rt,
+    const Pose* poses,
+    double* kernels = NULL)
+{
+    const SrtRbfFileHeader& header = *rt->header;
+    const int numInputs  = header.numInputs;
+    const int numCenters = header.numCenters;
+    double feature[10] = { 0 };
+    if (header.affinity)
+    {
+        std::memcpy(feature, rt->coef + numCenters * 10, sizeof(feature));
+    }
+    for (int j = 0; j < numCenters; ++j)
+    {
+        const Pose* center = reinterpret_cast<const Pose*>(rt->centers) + j * numInputs;
+        double distSq = 0.0;
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            distSq += DissimilaritySq(center[iid], poses[iid], header);
+        }
+        const double k = Rbf(std::sqrt(distSq), header);
+        if (kernels != NULL)
+        {
+            kernels[j] = k;
+        }
+        const double* c = rt->coef + j * 10;
+        for (int f = 0; f < 10; ++f)
+        {
+            feature[f] += k * c[f];
+        }
+    }
+    Pose out;
+    std::memcpy(&out, feature, sizeof(feature));
+    out.q = QExp(out.q);
+    if (header.affinity)
+    {
+        const Quat sref = { header.secRotate[0], header.secRotate[1], header.secRotate[2], header.secRotate[3] };
+        out.q = QMul(sref, out.q);
+    }
+    return out;
+}
+
+bool
+IsSection(
+    uint64_t offset,
+    uint64_t count,
+    uint64_t size)
+{
+    return offset % SRTRBF_ALIGNMENT == 0 && offset <= size && count * sizeof(double) <= size - offset;
+}
+
+SrtRbfRuntime*
+Attach(
+    SrtRbfRuntime* rt,
+    const void* data,
+    size_t size)
+{
+    const SrtRbfFileHeader* header = static_cast<const SrtRbfFileHeader*>(data);
+    if (data == NULL || size < sizeof(SrtRbfFileHeader)
+        || reinterpret_cast<uintptr_t>(data) % sizeof(double) != 0
+        || std::memcmp(header->magic, SRTRBF_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SRTRBF_FORMAT_VERSION
+        || header->endianTag != SRTRBF_ENDIAN_TAG
+        || header->headerSize != sizeof(SrtRbfFileHeader)
+        || header->fileSize > size
+        || header->numInputs <= 0 || header->numCenters <= 0
+        || header->numCoefs != header->numCenters + (header->affinity ? 1 : 0)
+        || header->rbfType < 0 || header->rbfType > 2
+        || header->distType < 0 || header->distType > 3)
+    {
+        return NULL;
+    }
+    const uint64_t numInputs  = header->numInputs;
+    const uint64_t numCenters = header->numCenters;
+    const uint64_t fileSize   = header->fileSize;
+    if (!IsSection(header->primRefOffset, numInputs * 10, fileSize)
+        || !IsSection(header->centersOffset, numCenters * numInputs * 10, fileSize)
+        || !IsSection(header->coefOffset, static_cast<uint64_t>(header->numCoefs) * 10, fileSize))
+    {
+        return NULL;
+    }
+    const char* base = static_cast<const char*>(data);
+    rt->header  = header;
+    rt->primRef = reinterpret_cast<const double*>(base + header->primRefOffset);
+    rt->centers = reinterpret_cast<const double*>(base + header->centersOffset);
+    rt->coef    = reinterpret_cast<const double*>(base + header->coefOffset);
+    return rt;
+}
+
+} // namespace
+
+SrtRbfRuntime*
+SrtRbfOpen(
+    const char* path)
+{
+    SrtRbfRuntime* rt = new SrtRbfRuntime();
+#ifdef _WIN32
+    rt->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (rt->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(rt->file, &size))
+    {
+        SrtRbfClose(rt);
+        return NULL;
+    }
+    rt->fileMapping = CreateFileMappingA(rt->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (rt->fileMapping == NULL)
+    {
+        SrtRbfClose(rt);
+        return NULL;
+    }
+    rt->mapping = MapViewOfFile(rt->fileMapping, FILE_MAP_READ, 0, 0, 0);
+    rt->mappedSize = static_cast<size_t>(size.QuadPart);
+#else
+    const int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        SrtRbfClose(rt);
+        return NULL;
+    }
+    void* mapping = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    rt->mapping = mapping == MAP_FAILED ? NULL : mapping;
+    rt->mappedSize = static_cast<size_t>(st.st_size);
+#endif
+    if (rt->mapping == NULL || Attach(rt, rt->mapping, rt->mappedSize) == NULL)
+    {
+        SrtRbfClose(rt);
+        return NULL;
+    }
+    return rt;
+}
+
+SrtRbfRuntime*
+SrtRbfOpenMemory(
+    const void* data,
+    size_t size)
+{
+    SrtRbfRuntime* rt = new SrtRbfRuntime();
+    if (Attach(rt, data, size) == NULL)
+    {
+        SrtRbfClose(rt);
+        return NULL;
+    }
+    return rt;
+}
+
+void
+SrtRbfClose(
+    SrtRbfRuntime* rt)
+{
+    if (rt == NULL)
+    {
+        return;
+    }
+#ifdef _WIN32
+    if (rt->mapping != NULL)
+    {
+        UnmapViewOfFile(rt->mapping);
+    }
+    if (rt->fileMapping != NULL)
+    {
+        CloseHandle(rt->fileMapping);
+    }
+    if (rt->file != NULL && rt->file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(rt->file);
+    }
+#else
+    if (rt->mapping != NULL)
+    {
+        munmap(rt->mapping, rt->mappedSize);
+    }
+#endif
+    delete rt;
+}
+
+int
+SrtRbfNumInputs(
+    const SrtRbfRuntime* rt)
+{
+    return rt == NULL ? 0 : rt->header->numInputs;
+}
+
+int
+SrtRbfNumCenters(
+    const SrtRbfRuntime* rt)
+{
+    return rt == NULL ? 0 : rt->header->numCenters;
+}
+
+int
+SrtRbfEvaluate(
+    const SrtRbfRuntime* rt,
+    int numPoses,
+    const double* inputs,
+    double* outputs)
+{
+    return SrtRbfEvaluateKernelValues(rt, numPoses, inputs, outputs, NULL);
+}
+
+int
+SrtRbfEvaluateKernelValues(
+    const SrtRbfRuntime* rt,
+    int numPoses,
+    const double* inputs,
+    double* outputs,
+    double* kernelValues)
+{
+    if (rt == NULL || numPoses < 0)
+    {
+        return -1;
+    }
+    const int numInputs = rt->header->numInputs;
+    const Pose* primRef = reinterpret_cast<const Pose*>(rt->primRef);
+    Pose poses[64];
+    Pose* buffer = numInputs <= 64 ? poses : new Pose[numInputs];
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            buffer[iid] = FromMatrix(inputs + (pid * numInputs + iid) * 16);
+            Relativize(buffer[iid], primRef[iid]);
+        }
+        ToMatrix(Blend(rt, buffer, kernelValues == NULL ? NULL : kernelValues + pid * rt->header->numCenters),
+            outputs + pid * 16);
+    }
+    if (buffer != poses)
+    {
+        delete[] buffer;
+    }
+    return 0;
+}
+
+int
+SrtRbfEvaluatePoses(
+    const SrtRbfRuntime* rt,
+    int numPoses,
+    const double* inputs,
+    double* outputs)
+{
+    if (rt == NULL || numPoses < 0)
+    {
+        return -1;
+    }
+    const int numInputs = rt->header->numInputs;
+    const Pose* primRef = reinterpret_cast<const Pose*>(rt->primRef);
+    Pose poses[64];
+    Pose* buffer = numInputs <= 64 ? poses : new Pose[numInputs];
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        std::memcpy(buffer, inputs + pid * numInputs * 10, numInputs * sizeof(Pose));
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            buffer[iid].q = QNormalize(buffer[iid].q);
+            Relativize(buffer[iid], primRef[iid]);
+        }
+        Pose out = Blend(rt, buffer);
+        out.q = QNormalize(out.q);
+        std::memcpy(outputs + pid * 10, &out, sizeof(Pose));
+    }
+    if (buffer != poses)
+    {
+        delete[] buffer;
+    }
+    return 0;
+}
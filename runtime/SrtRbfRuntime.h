@@ -0,0 +1,87 @@
+#ifndef SRTRBF_RUNTIME_H
+#define SRTRBF_RUNTIME_H
+#pragma once
+
+#include <stddef.h>
+
+//
+// standalone evaluator of files written by the ExportSrtRbf command
+//
+// Depends only on the C++ standard library. A runtime is immutable once
+// opened, so it may be evaluated from several threads at the same time.
+#if defined(_WIN32) && defined(SRTRBF_RUNTIME_DLL)
+#define SRTRBF_API __declspec(dllexport)
+#else
+#define SRTRBF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SrtRbfRuntime SrtRbfRuntime;
+
+// maps a file into memory; returns NULL if it cannot be read or is not a valid export
+SRTRBF_API SrtRbfRuntime*
+SrtRbfOpen(
+    const char* path);
+
+// uses a buffer owned by the caller; it must be 8-byte aligned and outlive the runtime
+SRTRBF_API SrtRbfRuntime*
+SrtRbfOpenMemory(
+    const void* data,
+    size_t size);
+
+SRTRBF_API void
+SrtRbfClose(
+    SrtRbfRuntime* runtime);
+
+SRTRBF_API int
+SrtRbfNumInputs(
+    const SrtRbfRuntime* runtime);
+
+// # of kernel centers: the examples, or the landmarks of the low-rank solver
+SRTRBF_API int
+SrtRbfNumCenters(
+    const SrtRbfRuntime* runtime);
+
+// inputs  : numPoses x numInputs x 16 row-major matrices (row-vector convention, no shear)
+// outputs : numPoses x 16 row-major matrices
+// returns 0 on success
+SRTRBF_API int
+SrtRbfEvaluate(
+    const SrtRbfRuntime* runtime,
+    int numPoses,
+    const double* inputs,
+    double* outputs);
+
+// the same as SrtRbfEvaluate, also writing the kernel values k(pose, center)
+// of the centers, which multiply the dual coefficients of the centers in the
+// blend. They are not the blend weights of the examples (the inverse kernel
+// matrix times them), which the file does not hold, and they do not sum to 1;
+// the centers are the landmarks of a low-rank node, and the constant term of
+// the affinity is not included.
+// kernelValues : numPoses x numCenters, or NULL
+SRTRBF_API int
+SrtRbfEvaluateKernelValues(
+    const SrtRbfRuntime* runtime,
+    int numPoses,
+    const double* inputs,
+    double* outputs,
+    double* kernelValues);
+
+// inputs  : numPoses x numInputs x 10 poses, s(3), q(4: x, y, z, w), t(3)
+// outputs : numPoses x 10 poses
+// returns 0 on success
+SRTRBF_API int
+SrtRbfEvaluatePoses(
+    const SrtRbfRuntime* runtime,
+    int numPoses,
+    const double* inputs,
+    double* outputs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SRTRBF_RUNTIME_H
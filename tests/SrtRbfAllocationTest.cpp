@@ -0,0 +1,230 @@
+//
+// counts the heap allocations of the per-frame evaluation of SrtRbfNode
+//
+//   SrtRbfAllocationTest
+//
+// Runs the per-frame calls of SrtRbfNode::compute on trained models:
+// relativizing the inputs, SrtRbfModel::frameFeatures, which the node calls
+// for the blend of all examples of every solver, the nearest examples with a
+// new neighborhood at every frame and single precision, the composition of
+// the output and the error measurement. After the first frames, which size
+// the buffers, no frame may allocate; allocations through operator new and
+// the heap allocations of Eigen are counted, and the test fails with the
+// number of allocating cases. The heap check of Eigen reports through
+// eigen_assert, which stays fatal for every other assertion. The inputs are
+// relativized from poses, not from matrices through MTransformationMatrix, so
+// that only the code of the plug-in is checked. Build against the Maya devkit
+// with, e.g.,
+//   g++ -O2 -std=c++11 -pthread -I$MAYA_LOCATION/include -I<eigen> SrtRbfAllocationTest.cpp
+//       -L$MAYA_LOCATION/lib -lOpenMaya -lFoundation -o SrtRbfAllocationTest
+// (SrtRbfModel.cpp is compiled into the test with the checks of Eigen on.)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace
+{
+bool counting = false;
+long numAllocations = 0;
+
+// the heap allocations of Eigen go through malloc, not operator new, and are
+// reported by its heap check; any other failed assertion aborts
+void
+FailAssertion(
+    const char* expression,
+    const char* file,
+    int line)
+{
+    if (std::strstr(expression, "heap allocation is forbidden") != nullptr)
+    {
+        ++numAllocations;
+        return;
+    }
+    std::fprintf(stderr, "%s:%d: assertion failed: %s\n", file, line, expression);
+    std::abort();
+}
+}
+
+#define EIGEN_RUNTIME_NO_MALLOC
+#define eigen_assert(x) do { if (!(x)) { FailAssertion(#x, __FILE__, __LINE__); } } while (false)
+
+#include "../SrtRbfModel.cpp"
+#include "SrtRbfTestData.h"
+
+void*
+operator new(
+    std::size_t size)
+{
+    if (counting)
+    {
+        ++numAllocations;
+    }
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void*
+operator new[](
+    std::size_t size)
+{
+    return operator new(size);
+}
+
+void
+operator delete(
+    void* p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete[](
+    void* p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(
+    void* p,
+    std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete[](
+    void* p,
+    std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+enum Path
+{
+    kPathFull,
+    kPathNearest,
+    kPathSingle
+};
+
+// one evaluation as in SrtRbfNode::updateWeight and SrtRbfNode::compute
+MMatrix
+EvaluateFrame(
+    SrtRbfModel& model,
+    const std::vector<PoseVariable>& inputs,
+    Path path,
+    bool measureError,
+    SrtRbfFrame& frame,
+    SrtRbfWorkspace& workspace)
+{
+    const int numInputs = model.numInputs;
+    for (int iid = 0; iid < numInputs; ++iid)
+    {
+        frame.poses[iid] = model.relativize(iid, inputs[iid]);
+        frame.dirty[iid] = 1;
+    }
+    model.frameFeatures(path == kPathNearest ? 8 : 0, path == kPathSingle, frame, workspace, workspace.feature);
+    const MMatrix output = model.compose(workspace.feature);
+    if (measureError)
+    {
+        Eigen::VectorXd& exactFeature = workspace.exactFeature;
+        model.evaluate(frame.poses, workspace, exactFeature);
+        model.compose(exactFeature);
+    }
+    return output;
+}
+
+// allocations over the frames after the warm-up
+long
+CountAllocations(
+    SrtRbfModel& model,
+    Path path,
+    bool measureError,
+    const std::vector<std::vector<PoseVariable>>& frames)
+{
+    // sized like SrtRbfNode::loadModel
+    SrtRbfFrame frame;
+    SrtRbfWorkspace workspace;
+    frame.reserve(model);
+    workspace.reserve(model);
+    const int numWarmUp = 2;
+    for (int fid = 0; fid < numWarmUp; ++fid)
+    {
+        EvaluateFrame(model, frames[fid], path, measureError, frame, workspace);
+    }
+    numAllocations = 0;
+    counting = true;
+    Eigen::internal::set_is_malloc_allowed(false);
+    double checksum = 0.0;
+    for (size_t fid = numWarmUp; fid < frames.size(); ++fid)
+    {
+        checksum += EvaluateFrame(model, frames[fid], path, measureError, frame, workspace)(3, 0);
+    }
+    Eigen::internal::set_is_malloc_allowed(true);
+    counting = false;
+    if (checksum != checksum)
+    {
+        std::printf("  the output is not a number\n");
+        return numAllocations + 1;
+    }
+    return numAllocations;
+}
+
+} // namespace
+
+int
+main()
+{
+    const char* solverNames[3] = { "dense", "low-rank", "iterative" };
+    const char* pathNames[3] = { "full", "nearest", "single" };
+    const int numInputs = 3;
+    const int numFrames = 200;
+    SrtRbfTestData data;
+    std::vector<std::vector<PoseVariable>> frames(numFrames);
+    for (int fid = 0; fid < numFrames; ++fid)
+    {
+        frames[fid] = data.primaryPoses(numInputs);
+    }
+
+    int numFailures = 0;
+    for (int solver = 0; solver < 3; ++solver)
+    {
+        for (int path = kPathFull; path <= kPathSingle; ++path)
+        {
+            for (int measureError = 0; measureError < 2; ++measureError)
+            {
+                SrtRbfModel model;
+                data.makeModel(model, 120, numInputs, 2, 1, true);
+                if (!data.fit(model, solver, 40))
+                {
+                    std::printf("%s: cannot fit the model\n", solverNames[solver]);
+                    ++numFailures;
+                    continue;
+                }
+                const long count = CountAllocations(model, static_cast<Path>(path), measureError != 0, frames);
+                std::printf("%-9s %-7s %-13s %ld allocations in %d frames\n",
+                    solverNames[solver], pathNames[path], measureError ? "measure error" : "",
+                    count, numFrames - 2);
+                if (count > 0)
+                {
+                    ++numFailures;
+                }
+            }
+        }
+    }
+    if (numFailures > 0)
+    {
+        std::printf("FAILED: %d cases allocate in the per-frame path\n", numFailures);
+        return 1;
+    }
+    std::printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,362 @@
+//
+// compares the evaluation paths of SrtRbfModel with the reference and the
+// analytic Jacobian with central differences, without Maya
+//
+//   SrtRbfPathTest [samples]
+//
+// Trains synthetic models for every solver over the kernels and distances, and
+// evaluates them at the inputs of SrtRbfModel::testInputs (default: 200 poses
+// around the examples, with the rotations near pi and the components near zero
+// of the hemisphere cases) like ValidateSrtRbfPaths. The reference is a dense
+// solve of all examples; the low-rank solver must match it with landmarks on
+// all examples and is only reported with fewer. The per-input distances of the
+// node, the batch evaluation of SrtRbfBatchNode, single precision, the nearest
+// examples where the node allows them and the exported runtime are compared
+// with the model itself. The Jacobian is checked at random poses away from the
+// examples, where the kernels are smooth, and must be undefined at the
+// antipode of an example under the quaternion distance. The test fails with
+// the number of paths beyond their tolerances. Build against the Maya devkit
+// with, e.g.,
+//   g++ -O2 -std=c++11 -pthread -I$MAYA_LOCATION/include -I<eigen> SrtRbfPathTest.cpp ../SrtRbfModel.cpp
+//       ../runtime/SrtRbfRuntime.cpp -L$MAYA_LOCATION/lib -lOpenMaya -lFoundation -o SrtRbfPathTest
+#include "SrtRbfTestData.h"
+#include "../runtime/SrtRbfRuntime.h"
+#include <maya/MTransformationMatrix.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+
+// max deviation of a path from the reference, as ValidateSrtRbfPaths reports it
+struct PathDeviation
+{
+    double maxTranslate;
+    double maxRotate; // degrees
+    double maxScale;
+};
+
+void
+AddDeviation(
+    const MMatrix& a,
+    const MMatrix& b,
+    PathDeviation& deviation)
+{
+    const PoseVariable pa = PoseVariable::fromMatrix(a);
+    const PoseVariable pb = PoseVariable::fromMatrix(b);
+    // angle of the relative rotation, stable near zero unlike acos
+    const MQuaternion dq = pa.rotate.conjugate() * pb.rotate;
+    const double sinHalf = std::sqrt(dq.x * dq.x + dq.y * dq.y + dq.z * dq.z);
+    const MVector ds = pa.scale - pb.scale;
+    deviation.maxTranslate = std::max(deviation.maxTranslate, (pa.translate - pb.translate).length());
+    deviation.maxRotate = std::max(deviation.maxRotate,
+        2.0 * std::atan2(sinHalf, std::abs(dq.w)) * (180.0 / 3.14159265358979323846));
+    deviation.maxScale = std::max(deviation.maxScale,
+        std::max(std::abs(ds.x), std::max(std::abs(ds.y), std::abs(ds.z))));
+}
+
+// deviations of every path of a trained model; returns the number of paths
+// beyond their tolerances
+int
+ComparePaths(
+    SrtRbfModel& model,
+    int numSamples)
+{
+    typedef std::chrono::steady_clock Clock;
+    const int numInputs = model.numInputs;
+    std::vector<MMatrix> inputs;
+    model.testInputs(numSamples, inputs);
+    const int numPoses = static_cast<int>(inputs.size()) / numInputs;
+    std::vector<PoseVariable> poses(inputs.size());
+    std::vector<std::vector<PoseVariable>> poseSets(numPoses);
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            const int i = pid * numInputs + iid;
+            poses[i] = model.relativize(iid, MTransformationMatrix(inputs[i]));
+        }
+        poseSets[pid].assign(poses.begin() + pid * numInputs, poses.begin() + (pid + 1) * numInputs);
+    }
+
+    std::vector<MMatrix> expected(numPoses), outputs(numPoses);
+    Clock::time_point start;
+    int numFailures = 0;
+    auto report = [&](const char* name, double translateTolerance, double rotateTolerance)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        PathDeviation d = { 0.0, 0.0, 0.0 };
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            AddDeviation(expected[pid], outputs[pid], d);
+        }
+        // a tolerance of 0 only reports the path
+        const bool failed = translateTolerance > 0.0
+            && (!(std::max(d.maxTranslate, d.maxScale) <= translateTolerance) || !(d.maxRotate <= rotateTolerance));
+        std::printf("    %-12s %10.3g %10.3g %10.3g %10.3f us%s\n", name,
+            d.maxTranslate, d.maxRotate, d.maxScale, 1.0e6 * seconds / numPoses, failed ? "  FAILED" : "");
+        numFailures += failed ? 1 : 0;
+    };
+    const double exact = 1.0e-6;
+    const double exactRotate = 1.0e-4;
+    // the default Nearest Tolerance bounds the matrix elements, and so the
+    // translation and scale by sqrt(3) times it and the rotation by about 115
+    // degrees times it
+    const double nearestTolerance = 0.01;
+    const double nearestTranslate = 0.02;
+    const double nearestRotate = 2.0;
+    // the low-rank solve on all examples goes through the normal equations
+    const double lowRankTolerance = 1.0e-5;
+    const double lowRankRotate = 1.0e-3;
+    Eigen::VectorXd feature;
+
+    // reference: a dense solve of all examples
+    std::vector<int> centers;
+    Eigen::MatrixXd reference;
+    if (!model.referenceCoefficients(centers, reference))
+    {
+        std::printf("    cannot solve the reference\n");
+        return 1;
+    }
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        model.referenceFeatures(poseSets[pid], centers, reference, feature);
+        expected[pid] = model.compose(feature);
+    }
+
+    // blend of all examples; the low-rank solver approximates the reference
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        model.evaluate(poseSets[pid], feature);
+        outputs[pid] = model.compose(feature);
+    }
+    if (model.solver == 1)
+    {
+        // an approximation with fewer landmarks than examples, only reported
+        const bool allLandmarks = static_cast<int>(model.landmarks.size()) == model.numExs;
+        report("low-rank", allLandmarks ? lowRankTolerance : 0.0, lowRankRotate);
+
+        // the other paths evaluate the landmarks, measured pose by pose
+        const Eigen::MatrixXd landmarkCoef = model.coef;
+        for (int pid = 0; pid < numPoses; ++pid)
+        {
+            model.referenceFeatures(poseSets[pid], model.landmarks, landmarkCoef, feature);
+            expected[pid] = model.compose(feature);
+        }
+    }
+    else
+    {
+        report("full", exact, exactRotate);
+    }
+
+    // per-input distances summed like SrtRbfNode::updateWeight
+    SrtRbfWorkspace workspace;
+    workspace.reserve(model);
+    RowMatrixXd partial(numInputs, model.numCenters());
+    Eigen::VectorXd distSq, weight;
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            model.partialDistance(iid, poseSets[pid][iid], partial.row(iid).data());
+        }
+        distSq.noalias() = partial.colwise().sum().transpose();
+        if (model.solver != 0)
+        {
+            model.featuresFromDistance(distSq, feature);
+        }
+        else
+        {
+            model.weightFromDistance(distSq, workspace, weight);
+            model.features(weight, std::vector<int>(), feature);
+        }
+        outputs[pid] = model.compose(feature);
+    }
+    report("incremental", exact, exactRotate);
+
+    // all poses at once as SrtRbfBatchNode
+    RowMatrixXd coefficients, features;
+    model.dualCoefficients(centers, coefficients);
+    start = Clock::now();
+    model.evaluateBatch(poses, coefficients, features);
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        outputs[pid] = model.compose(features.row(pid).transpose());
+    }
+    report("batch", exact, exactRotate);
+
+    // single precision
+    model.buildSingle();
+    workspace.reserve(model);
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        model.singleFeatures(poseSets[pid], workspace, workspace.feature);
+        outputs[pid] = model.compose(workspace.feature);
+    }
+    report("single", 1.0e-3, 5.0e-2);
+
+    // nearest examples where the node allows them, the blend of all examples
+    // otherwise (SrtRbfNode::nearestAllowed with the default tolerance)
+    const bool nearest = model.nearestError(8, 200) <= nearestTolerance;
+    std::vector<int> ids;
+    start = Clock::now();
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        if (nearest && model.localWeight(poseSets[pid], 8, workspace, ids, weight))
+        {
+            model.features(weight, ids, feature);
+        }
+        else
+        {
+            model.evaluate(poseSets[pid], feature);
+        }
+        outputs[pid] = model.compose(feature);
+    }
+    if (nearest)
+    {
+        report("nearest 8", nearestTranslate, nearestRotate);
+    }
+    else
+    {
+        report("nearest off", exact, exactRotate);
+    }
+
+    // exported runtime, from the input matrices
+    std::vector<double> image;
+    SrtRbfRuntime* runtime = model.runtimeImage(image)
+        ? SrtRbfOpenMemory(image.data(), image.size() * sizeof(double)) : nullptr;
+    if (runtime == nullptr)
+    {
+        std::printf("    cannot open the runtime image\n");
+        return numFailures + 1;
+    }
+    std::vector<double> flatInputs(inputs.size() * 16), flatOutputs(numPoses * 16);
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        inputs[i].get(reinterpret_cast<double(*)[4]>(flatInputs.data() + i * 16));
+    }
+    start = Clock::now();
+    SrtRbfEvaluate(runtime, numPoses, flatInputs.data(), flatOutputs.data());
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        outputs[pid] = MMatrix(reinterpret_cast<const double(*)[4]>(flatOutputs.data() + pid * 16));
+    }
+    report("runtime", exact, exactRotate);
+    SrtRbfClose(runtime);
+    return numFailures;
+}
+
+// largest difference of the analytic Jacobian from central differences,
+// relative to the largest derivative, at random poses
+double
+JacobianError(
+    const SrtRbfModel& model,
+    SrtRbfTestData& data,
+    int numPoses)
+{
+    double maxError = 0.0;
+    Eigen::MatrixXd jac;
+    for (int pid = 0; pid < numPoses; ++pid)
+    {
+        const std::vector<PoseVariable> poses = data.primaryPoses(model.numInputs);
+        model.jacobian(poses, jac);
+        const double scale = std::max(1.0, jac.cwiseAbs().maxCoeff());
+        maxError = std::max(maxError, model.jacobianError(poses, 1.0e-6) / scale);
+    }
+    return maxError;
+}
+
+// the quaternion distance has a cone at the antipode of a center, which is
+// only reached on the hemisphere border; the Jacobian must be reported undefined
+bool
+AntipodeUndefined()
+{
+    SrtRbfTestData data;
+    SrtRbfModel model;
+    data.makeModel(model, 10, 1, 2, 0, false);
+    model.primary[0][0].rotate = MQuaternion(0.0, 0.6, 0.8, 0.0);
+    if (!data.fit(model, 0, 0))
+    {
+        return false;
+    }
+    std::vector<PoseVariable> poses(model.primary[0]);
+    poses[0].rotate = MQuaternion(0.0, -0.6, -0.8, 0.0);
+    Eigen::MatrixXd jac;
+    return !model.jacobian(poses, jac) && jac.hasNaN()
+        && std::isinf(model.jacobianError(poses, 1.0e-6));
+}
+
+} // namespace
+
+int
+main(
+    int argc,
+    char** argv)
+{
+    const int numSamples = argc > 1 ? std::atoi(argv[1]) : 200;
+    const char* solverNames[3] = { "dense", "low-rank", "iterative" };
+    const int solvers[][2] = { { 0, 0 }, { 1, 30 }, { 1, 60 }, { 2, 0 } }; // solver, landmarks
+    const char* rbfNames[3] = { "linear", "thinplate", "gaussian" };
+    // rbfType, distType, width; the narrow gaussians allow the nearest examples
+    const double kernels[][3] = { { 0, 1, 10.0 }, { 1, 1, 10.0 }, { 2, 0, 10.0 }, { 2, 1, 10.0 }, { 2, 2, 10.0 },
+        { 2, 3, 10.0 }, { 2, 1, 1.0 }, { 2, 3, 0.5 } };
+    const double jacobianTolerance = 1.0e-5;
+    const int numInputs = 2;
+
+    int numFailures = 0;
+    for (const int* solver : solvers)
+    {
+        for (const double* kernel : kernels)
+        {
+            for (int affinity = 0; affinity < 2; ++affinity)
+            {
+                const int rbfType = static_cast<int>(kernel[0]);
+                const int distType = static_cast<int>(kernel[1]);
+                SrtRbfTestData data;
+                SrtRbfModel model;
+                data.makeModel(model, 60, numInputs, rbfType, distType, affinity != 0);
+                model.width = kernel[2];
+                std::printf("%s, %s kernel, distance %d%s", solverNames[solver[0]], rbfNames[rbfType],
+                    distType, affinity ? ", affinity" : "");
+                if (solver[0] == 1)
+                {
+                    std::printf(", %d landmarks", solver[1]);
+                }
+                if (rbfType == 2)
+                {
+                    std::printf(", width %g", kernel[2]);
+                }
+                std::printf("\n");
+                if (!data.fit(model, solver[0], solver[1]))
+                {
+                    std::printf("    cannot fit the model\n");
+                    ++numFailures;
+                    continue;
+                }
+                std::printf("    %-12s %10s %10s %10s %13s\n", "path", "translate", "rotate", "scale", "time");
+                numFailures += ComparePaths(model, numSamples);
+                const double jacError = JacobianError(model, data, 10);
+                const bool failed = !(jacError <= jacobianTolerance);
+                std::printf("    %-12s %10.3g%s\n", "jacobian", jacError, failed ? "  FAILED" : "");
+                numFailures += failed ? 1 : 0;
+            }
+        }
+    }
+    const bool antipode = AntipodeUndefined();
+    std::printf("jacobian at the antipode of an example: %s\n", antipode ? "undefined" : "FAILED");
+    numFailures += antipode ? 0 : 1;
+    if (numFailures > 0)
+    {
+        std::printf("FAILED: %d paths beyond their tolerances\n", numFailures);
+        return 1;
+    }
+    std::printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef SRTRBF_TEST_DATA_H
+#define SRTRBF_TEST_DATA_H
+#pragma once
+
+//
+// synthetic trained models for the headless tests; the poses are drawn from a
+// fixed seed so that every run checks the same examples
+#include "../SrtRbfModel.h"
+#include <random>
+#include <vector>
+
+class SrtRbfTestData
+{
+public:
+    explicit SrtRbfTestData(
+        unsigned int seed = 1)
+        : rng(seed),
+        uniform(-1.0, 1.0)
+    {
+    }
+
+    // primary pose around the identity, relativized like addExample
+    PoseVariable
+    primaryPose()
+    {
+        PoseVariable pose;
+        pose.scale = MVector(1.0 + 0.2 * uniform(rng), 1.0 + 0.2 * uniform(rng), 1.0 + 0.2 * uniform(rng));
+        pose.rotate = MQuaternion(uniform(rng), uniform(rng), uniform(rng), 2.0 + uniform(rng));
+        pose.rotate.normalizeIt();
+        pose.translate = MVector(uniform(rng), uniform(rng), uniform(rng));
+        return pose;
+    }
+
+    std::vector<PoseVariable>
+    primaryPoses(
+        int numInputs)
+    {
+        std::vector<PoseVariable> poses(numInputs);
+        for (int iid = 0; iid < numInputs; ++iid)
+        {
+            poses[iid] = primaryPose();
+        }
+        return poses;
+    }
+
+    // examples of the given kernel and distance; the secondary poses after the
+    // first one are log quaternions relative to it, as stored by the node
+    void
+    makeModel(
+        SrtRbfModel& model,
+        int numExs,
+        int numInputs,
+        int rbfType,
+        int distType,
+        bool affinity)
+    {
+        model.numInputs = numInputs;
+        model.numExs    = numExs;
+        model.rbfType   = rbfType;
+        model.distType  = distType;
+        model.affinity  = affinity;
+        model.primRef.assign(numInputs, PoseVariable());
+        model.primary.resize(numExs);
+        model.secondary.resize(numExs);
+        for (int eid = 0; eid < numExs; ++eid)
+        {
+            model.primary[eid] = primaryPoses(numInputs);
+            model.secondary[eid] = primaryPose();
+            if (eid > 0)
+            {
+                model.secondary[eid].rotate = model.secondary[eid].rotate.log();
+            }
+        }
+    }
+
+    // solves the model with the given solver like the node
+    bool
+    fit(
+        SrtRbfModel& model,
+        int solver,
+        int numLandmarks)
+    {
+        model.solver = solver;
+        double residual = 0.0;
+        int numIterations = 0;
+        const bool solved = solver == 1 ? model.fitLowRank(numLandmarks, residual)
+            : solver == 2 ? model.fitIterative(1.0e-10, 1000, nullptr, model.landmarks, model.coef, numIterations, residual)
+            : model.fitDense();
+        model.update();
+        return solved;
+    }
+
+private:
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform;
+};
+
+#endif //SRTRBF_TEST_DATA_H